@@ -1,15 +1,24 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each with its own lock, so lookups of different blocks don't
+// contend.  The number of buffers is chosen at boot from the
+// amount of free memory (at least NBUF).
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
+// * To get a buffer for a block that will be overwritten entirely,
+//     without reading it first, call bgetblank.
 // * After changing buffer data, call bwrite to write it to disk.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
+// * To start reading a block that will be wanted soon, without
+//     waiting for it, call breadahead.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 
@@ -22,34 +31,80 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
 
-struct {
+#define HASH(dev, blockno) ((((uint)(dev)) * 31 + (blockno)) % NBUCKET)
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // chain through buf.next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  // serializes recycling, so that two processes missing on
+  // the same block can't both insert it.  never held while
+  // waiting for a sleeplock.
+  struct spinlock lock;
+  struct bucket bucket[NBUCKET];
+  uint clock;   // source of buf.lastuse stamps
+  int nbuf;
+  uint64 rablocks;  // counters for bstat(), updated atomically
+  uint64 rahits;
+  uint64 misses;
+  uint64 reads;
 } bcache;
 
+extern int num_free_pages;
+
+// unlink b from its bucket's chain. caller holds the bucket lock.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->next){
+    if(*pp == b){
+      *pp = b->next;
+      b->next = 0;
+      return;
+    }
+  }
+  panic("bunlink");
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  char *pg;
+  int perpage = PGSIZE / sizeof(struct buf);
 
   initlock(&bcache.lock, "bcache");
+  for(int i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+
+  // give the cache 1/NBUFMEM of memory, carved out of whole pages
+  // so that no buffer's data crosses a page boundary.
+  int want = num_free_pages / NBUFMEM * perpage;
+  if(want < NBUF)
+    want = NBUF;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // every buffer starts out empty (blockno 0 of dev 0) in bucket 0;
+  // bget moves buffers between buckets as it recycles them.
+  while(bcache.nbuf < want){
+    if((pg = kalloc()) == 0)
+      break;
+    for(int i = 0; i < perpage && bcache.nbuf < want; i++){
+      b = (struct buf*)(pg + i * sizeof(struct buf));
+      memset(b, 0, sizeof(*b));
+      initsleeplock(&b->lock, "buffer");
+      b->next = bcache.bucket[0].head;
+      bcache.bucket[0].head = b;
+      bcache.nbuf++;
+    }
   }
+  if(bcache.nbuf < NBUF)
+    panic("binit: out of memory");
 }
 
 // Look through buffer cache for block on device dev.
@@ -59,33 +114,82 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
+  struct bucket *bk = &bcache.bucket[HASH(dev, blockno)];
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
+  release(&bk->lock);
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Only one process recycles at a time; check again in case
+  // someone else brought the block in while bk->lock was free.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      release(&bk->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+  trace(TR_BMISS, dev, blockno);
+
+  // Recycle the least recently used (LRU) unused buffer.
+  // Keep the lock of the bucket holding the best candidate so far,
+  // so that it can't be picked up again while we look at the rest.
+  // holding two bucket locks is safe because only the holder of
+  // bcache.lock ever does so.
+  struct buf *victim = 0;
+  struct bucket *vbk = 0;
+  for(int i = 0; i < NBUCKET; i++){
+    struct bucket *cur = &bcache.bucket[i];
+    int found = 0;
+    acquire(&cur->lock);
+    for(b = cur->head; b; b = b->next){
+      if(b->refcnt == 0 && (victim == 0 || b->lastuse < victim->lastuse)){
+        victim = b;
+        found = 1;
+      }
+    }
+    if(found){
+      if(vbk)
+        release(&vbk->lock);
+      vbk = cur;
+    } else {
+      release(&cur->lock);
+    }
+  }
+  if(victim == 0)
+    panic("bget: no buffers");
+
+  if(vbk != bk){
+    bunlink(vbk, victim);
+    release(&vbk->lock);
+    acquire(&bk->lock);
+    victim->next = bk->head;
+    bk->head = victim;
+  }
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->readahead = 0;
+  victim->refcnt = 1;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -95,13 +199,89 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
-  if(!b->valid) {
+  __sync_fetch_and_add(&bcache.reads, 1);
+  if(b->readahead) {
+    b->readahead = 0;
+    __sync_fetch_and_add(&bcache.rahits, 1);
+  } else if(!b->valid) {
+    __sync_fetch_and_add(&bcache.misses, 1);
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// pa4: return a locked buf for the indicated block without
+// reading it from disk. the caller must overwrite all of
+// b->data before releasing it.
+struct buf*
+bgetblank(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->readahead = 0;
+  b->valid = 1;
+  return b;
+}
+
+// drop a reference to b, whose sleeplock the caller
+// has released; stamp it as the most recently used.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[HASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->lastuse = __sync_fetch_and_add(&bcache.clock, 1);
+  }
+  release(&bk->lock);
+}
+
+// called by virtio_disk_intr() when a read started by
+// breadahead() finishes. release the buffer on behalf of
+// the process that started it; a bread() sleeping on the
+// buffer's lock wakes up to find it valid.
+static void
+breaddone(struct buf *b)
+{
+  b->valid = 1;
+  b->iodone = 0;
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// pa4: start reading a block into the cache without waiting
+// for it. does nothing if the block is cached or being read.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+  struct bucket *bk = &bcache.bucket[HASH(dev, blockno)];
+
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      release(&bk->lock);
+      return;
+    }
+  }
+  release(&bk->lock);
+
+  b = bget(dev, blockno);
+  if(b->valid){
+    // someone else read it in meanwhile.
+    brelse(b);
+    return;
+  }
+  b->readahead = 1;
+  b->iodone = breaddone;
+  __sync_fetch_and_add(&bcache.rablocks, 1);
+  virtio_disk_submit(b, 0);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,8 +291,28 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Start writing b's contents to disk and return without
+// waiting, so that many writes can be in flight at once.
+// b must stay locked, and unmodified, until bwait(b).
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  virtio_disk_submit(b, 1);
+}
+
+// Wait for a write started by bawrite() to finish.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  virtio_disk_wait(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Stamp it as the most recently used.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +320,31 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[HASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[HASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
-
+// pa4: copy the readahead counters to *st.
+void
+bstat(struct fsstat *st)
+{
+  st->rablocks = bcache.rablocks;
+  st->rahits = bcache.rahits;
+  st->bmisses = bcache.misses;
+  st->breads = bcache.reads;
+}
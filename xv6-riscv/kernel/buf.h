@@ -1,12 +1,14 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int readahead; // read ahead and not yet asked for by bread()?
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;     // bcache.clock when refcnt last dropped to 0
+  struct buf *next; // hash bucket chain
+  void (*iodone)(struct buf*); // called by virtio_disk_intr() when an async request completes
   uchar data[BSIZE];
 };
 
@@ -25,6 +25,8 @@
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
 
+extern volatile int panicking; // from printf.c
+
 //
 // send one character to the uart.
 // called by printf(), and to echo input characters,
@@ -33,11 +35,13 @@
 void
 consputc(int c)
 {
+  void (*put)(int) = panicking ? uartputc_sync : uartputc_kernel;
+
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    put('\b'); put(' '); put('\b');
   } else {
-    uartputc_sync(c);
+    put(c);
   }
 }
 
@@ -58,13 +62,15 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
+  char buf[128];
+  int i, m;
 
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  // pa4: copy in and queue a chunk at a time.
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(buf) ? n - i : sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
 
   return i;
@@ -3,22 +3,34 @@
 struct buf;
 struct context;
 struct file;
+struct fsstat;
+struct vmstat;
 struct inode;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vma;
 
-// pa4: page structure는 riscv.h에 정의됨
+// pa4: page structure는 riscv.h에 정의됨. pages[]는 RAM
+// [KERNBASE, PHYSTOP)의 frame만 가짐
+#define NFRAMES ((PHYSTOP - KERNBASE) / PGSIZE)
 extern struct page pages[];  // kalloc.c에 정의된 pages 배열
+#define PA2PG(pa) (&pages[((uint64)(pa) - KERNBASE) / PGSIZE])  // 물리 주소 -> struct page
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bawrite(struct buf*);
+void            bwait(struct buf*);
+void            breadahead(uint, uint);
+struct buf*     bgetblank(uint, uint);
+void            bstat(struct fsstat*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
@@ -29,6 +41,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execinto(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -38,10 +51,13 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepread(struct file*, uint64, int, uint);
+int             filepwrite(struct file*, uint64, int, uint);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+void            dcache_remove(struct inode*, char*);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
@@ -57,10 +73,12 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writeblocks(uint);
 void            itrunc(struct inode*);
 // pa5: function defs
 void swapread(uint64 ptr, int blkno);
 void swapwrite(uint64 ptr, int blkno);
+void swapreadv(char **pages, int n, int blkno);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -69,19 +87,43 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_noevict(void);
 void            kfree(void*);
 void            kinit(void);
+void            kinithart(void);
+void            kinitwait(void);
 struct page*    get_page(void);
+void*           kalloc_order(int);
+void            kfree_order(void*, int);
+void*           superalloc(void);
+void            superfree(void*);
 void            lru_add(struct page*, pagetable_t, uint64, int);
+void            pagevec_init(void);
 void            lru_remove(struct page*, int);
+int             vmfault(pagetable_t, uint64, int);
+int             vmacopy(pagetable_t, pagetable_t, struct vma*, struct vma*);
+void            vmafree(struct vma*);
+uint64          vmamap(struct proc*, uint64, uint64, struct vma*);
+int             vmaunmap(struct proc*, uint64, uint64);
+void            vmaunmapall(struct proc*);
+int             vmadvise(struct proc*, uint64, uint64, int);
+void            vmstats(struct vmstat*);
+void            uvmstat(pagetable_t, struct vmstat*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_freed(uint);
+int             log_reusable(uint);
 void            begin_op(void);
+void            begin_opn(int);
+int             log_maxop(void);
 void            end_op(void);
+void            logstat(struct fsstat*);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -96,7 +138,14 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**);
 int             growproc(int);
+void            kthread_create(char*, void (*)(void));
+int             procvmstat(int, struct vmstat*);
+int             oomkill(void);
+int             setaffinity(int, uint64);
+int             cpustats(uint64, int);
+uint64          ringsetup(void);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -114,6 +163,7 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            preempt(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -126,6 +176,7 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             lockstats(uint64, int);
 void            push_off(void);
 void            pop_off(void);
 
@@ -151,9 +202,16 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             syscallstats(uint64, int);
+int             ringrun(int);
 
 // trap.c
 extern uint     ticks;
+void            tickupdate(void);
+void            tickwait(uint);
+void            timerwait(uint64);
+void            idletimer(void);
+void            busytimer(void);
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -162,7 +220,8 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartwrite(char*, int);
+void            uartputc_kernel(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -187,11 +246,20 @@ int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             evictpage(void);
+int             cowfault(pagetable_t, uint64);
+void            kswapd(void);
+int             mempressure(void);
 void            print_swap_stats(void);
+int             swapin(pagetable_t, uint64, pte_t*);
+void            ws_restore(struct proc*);
 // pa4: swap functions
 void            init_swapbitmap(void);
+void            swapinit(void);
+int             swapblock(int, int*);
+void            rmap_init(void);
 int             allocswap(void);
 void            freeswap(int);
+void            dupswap(int);
 
 // plic.c
 void            plicinit(void);
@@ -202,7 +270,33 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
-void            virtio_disk_intr(void);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_rwraw(int, void *, uint, uint, int);
+void            virtio_disk_rwpages(int, void **, int, uint, int);
+void            virtio_disk_rwblocks(void **, int, uint, int);
+uint64          virtio_disk_capacity(int);
+void            virtio_disk_intr(int);
+
+// zswap.c
+void            zswapinit(void);
+int             zswap_store(uint64, int);
+int             zswap_load(uint64, int);
+int             zswap_has(int);
+void            zswap_free(int);
+void            zswapstats(struct vmstat*);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabstats(struct vmstat*);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64, uint64);
+int             ktrace(int, uint64, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -7,8 +7,6 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
-
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -19,8 +17,15 @@ int flags2perm(int flags)
     return perm;
 }
 
+extern struct proc *initproc;
+static int booted;   // the boot time has been reported
+
+// replace the user image of p with the program in path, with
+// arguments argv in kernel memory. p is the current process, or
+// a new one spawn() has not yet made runnable. returns argc,
+// or -1 leaving p as it was.
 int
-exec(char *path, char **argv)
+execinto(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -29,7 +34,10 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  struct vma vma[NVMA];
+  int nvma = 0;
+
+  memset(vma, 0, sizeof(vma));
 
   begin_op();
 
@@ -49,7 +57,8 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // pa4: map the program lazily. each segment becomes a VMA,
+  // and vmfault() reads its pages from ip on first touch.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -61,18 +70,24 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.vaddr + ph.memsz >= MAXVA || ph.off + ph.filesz < ph.off)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nvma == NVMA)
       goto bad;
+    vma[nvma].start = ph.vaddr;
+    vma[nvma].end = ph.vaddr + ph.memsz;
+    vma[nvma].ip = idup(ip);
+    vma[nvma].off = ph.off;
+    vma[nvma].filesz = ph.filesz;
+    vma[nvma].perm = PTE_R|PTE_W|PTE_U|flags2perm(ph.flags);
+    nvma++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate some pages at the next page boundary.
@@ -121,12 +136,27 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  vmaunmapall(p);
+  // vmstat() may be walking the old page table under p->lock.
+  acquire(&p->lock);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  release(&p->lock);
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  begin_op();
+  vmafree(p->vma);
+  end_op();
+  memmove(p->vma, vma, sizeof(vma));
+
+  // pa4: boot is over once init has started its first program
+  // (sh), by fork() and exec() or by spawn(). time counts from
+  // reset at 10 MHz.
+  struct proc *starter = p == myproc() ? p->parent : myproc();
+  if(starter == initproc && p != initproc && !__sync_lock_test_and_set(&booted, 1))
+    printf("boot: %s started %ld ms after reset\n", path, r_time() / 10000);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -134,33 +164,20 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    iunlock(ip);
+    vmafree(vma);
+    iput(ip);
+    end_op();
+  } else {
+    begin_op();
+    vmafree(vma);
     end_op();
   }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+int
+exec(char *path, char **argv)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
+  return execinto(myproc(), path, argv);
 }
@@ -3,3 +3,15 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// mmap()
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
+#define MAP_SHARED  0x1
+#define MAP_PRIVATE 0x2
+
+// madvise()
+#define MADV_DONTNEED 1   // drop the pages; they read back as zero
+#define MADV_WILLNEED 2   // read swapped-out and file pages in now
+#define MADV_COLD     3   // evict these pages before others
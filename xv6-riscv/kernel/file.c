@@ -14,15 +14,20 @@
 #include "proc.h"
 
 struct devsw devsw[NDEV];
+// file structures come from a slab cache; at most NFILE
+// are open at once.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  int nfile;
 } ftable;
 
+static struct kmem_cache *filecache;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  filecache = kmem_cache_create("file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -32,15 +37,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= NFILE){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+
+  if((f = kmem_cache_alloc(filecache)) == 0){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -71,7 +83,9 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmem_cache_free(filecache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -101,6 +115,57 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// pa4: read n bytes of inode file f at *off into user address
+// addr, and advance *off past them.
+static int
+inoderead(struct file *f, uint64 addr, int n, uint *off)
+{
+  int r;
+
+  ilock(f->ip);
+  if((r = readi(f->ip, 1, addr, *off, n)) > 0)
+    *off += r;
+  iunlock(f->ip);
+  return r;
+}
+
+// pa4: write n bytes from user address addr to inode file f
+// at *off, and advance *off past them.
+static int
+inodewrite(struct file *f, uint64 addr, int n, uint *off)
+{
+  int r;
+
+  // pa4: reserve log space for as much of the write as the
+  // log can take, so a large write is a few big transactions
+  // rather than many of MAXOPBLOCKS. chunks after the first
+  // start on a block boundary.
+  int cap = log_maxop();
+  int i = 0;
+  while(i < n){
+    int nb = cap;
+    while(nb > 1 && writeblocks(nb * BSIZE) > cap)
+      nb--;
+    int n1 = nb * BSIZE - *off % BSIZE;
+    if(n1 > n - i)
+      n1 = n - i;
+
+    begin_opn(writeblocks(n1));
+    ilock(f->ip);
+    if ((r = writei(f->ip, 1, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_op();
+
+    if(r != n1){
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -118,10 +183,7 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    r = inoderead(f, addr, n, &f->off);
   } else {
     panic("fileread");
   }
@@ -129,12 +191,22 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// pa4: read from inode file f at offset off, leaving f->off
+// alone. returns -1 for pipes and devices, which have no offset.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  return inoderead(f, addr, n, &off);
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
@@ -146,33 +218,7 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    ret = inodewrite(f, addr, n, &f->off);
   } else {
     panic("filewrite");
   }
@@ -180,3 +226,13 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// pa4: write to inode file f at offset off, leaving f->off
+// alone. returns -1 for pipes and devices, which have no offset.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f, addr, n, &off);
+}
+
@@ -18,6 +18,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // pa4: itable hash chain
+  struct inode *fnext; // pa4: itable free list, under itable.lock
+  struct inode *fprev;
+  int onfree;         // on the free list?
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +30,13 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  // pa4: sequential readahead state, see readi().
+  uint ra_next;       // block after the last one read
+  uint ra_win;        // readahead window in blocks, 0 if not sequential
+  uint ra_end;        // block after the last one read ahead
+  uint alloc_next;    // pa4: where balloc() looks first for ip's next block
 };
 
 // map major device number to device functions.
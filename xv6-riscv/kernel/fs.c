@@ -39,6 +39,46 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+// pa4: free counts per bitmap block and per inode block, so
+// that balloc() and ialloc() skip full blocks without reading
+// them. a count is changed only with its block locked. blocks
+// past the end of the arrays are not summarised and are always
+// read.
+#define NBMAP  64    // bitmap blocks summarised: 512K disk blocks
+#define NIBLK  1024  // inode blocks summarised: 16K inodes
+
+static ushort bmfree[NBMAP];
+static uchar ibfree[NIBLK];
+
+// might bitmap block i (or inode block i) have a free entry?
+#define BMAYFREE(i) ((i) >= NBMAP || bmfree[i] > 0)
+#define IMAYFREE(i) ((i) >= NIBLK || ibfree[i] > 0)
+
+// count the free blocks and inodes. the log has been recovered.
+static void
+fssummary(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  int i, b;
+
+  for(i = 0; i < NBMAP && i * BPB < sb.size; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    for(b = 0; b < BPB && i * BPB + b < sb.size; b++)
+      if((bp->data[b/8] & (1 << (b%8))) == 0)
+        bmfree[i]++;
+    brelse(bp);
+  }
+  for(i = 0; i < NIBLK && i * IPB < sb.ninodes; i++){
+    bp = bread(dev, sb.inodestart + i);
+    dip = (struct dinode*)bp->data;
+    for(b = 0; b < IPB && i * IPB + b < sb.ninodes; b++)
+      if(dip[b].type == 0 && i * IPB + b != 0)
+        ibfree[i]++;
+    brelse(bp);
+  }
+}
+
 // Init fs
 void
 fsinit(int dev) {
@@ -46,40 +86,73 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  fssummary(dev);
 }
 
-// Zero a block.
+// Zero a block; data says it will hold file contents.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bgetblank(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// pa4: where balloc() starts looking when the caller has no
+// goal, just past the last block handed out, so that files
+// written one after another are laid out one after another.
+// only a hint, so it needs no lock.
+static uint balloc_cursor;
+
+// Allocate a zeroed disk block, the first free one at or
+// after goal (0 for no goal), wrapping around to the start.
+// data says it is for the contents of a regular file.
 // returns 0 if out of disk space.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal, int data)
 {
-  int b, bi, m;
+  int b, bi, m, end, k;
+  int nb = (sb.size + BPB - 1) / BPB;  // bitmap blocks
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  if(goal == 0 || goal >= sb.size)
+    goal = balloc_cursor;
+  if(goal >= sb.size)
+    goal = 0;
+
+  // the bitmap block holding goal is scanned from goal on,
+  // and its part before goal is scanned last.
+  for(k = 0; k <= nb; k++){
+    b = (goal / BPB + k) % nb * BPB;
+    bi = k == 0 ? goal % BPB : 0;
+    end = k == nb ? goal % BPB : BPB;
+    if(bi >= end)
+      break;
+    if(!BMAYFREE(b / BPB))
+      continue;
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(; bi < end && b + bi < sb.size; bi++){
+      if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+        bi += 7;  // whole byte in use
+        continue;
+      }
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      if((bp->data[bi/8] & m) == 0 && log_reusable(b + bi)){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
+        if(b / BPB < NBMAP)
+          bmfree[b / BPB]--;
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        bzero(dev, b + bi, data);
+        balloc_cursor = b + bi + 1;
         return b + bi;
       }
     }
@@ -102,7 +175,10 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  if(b / BPB < NBMAP)
+    bmfree[b / BPB]++;
   log_write(bp);
+  log_freed(b);
   brelse(bp);
 }
 
@@ -166,33 +242,126 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// pa4: in-use entries are hashed by (dev, inum) into NIHASH
+// buckets, each with its own spin-lock, which protects ip->ref
+// and the hash chain of every entry in the bucket. ip->dev and
+// ip->inum only change while the entry is recycled, under both
+// itable.lock and the bucket lock, so either lock is enough to
+// read them. Entries with ip->ref zero keep their contents and
+// wait on a free list in least-recently-used order, so that an
+// inode used again soon is found without reading it from disk.
+// The itable.lock spin-lock protects the free list and
+// serializes recycling.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;   // chain through inode.hnext
+};
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct ibucket bucket[NIHASH];
+  struct inode *freehead;  // least recently released first
+  struct inode *freetail;
 } itable;
 
+#define IHASH(dev, inum) ((((uint)(dev)) * 31 + (inum)) % NIHASH)
+
+struct dentry {
+  uint dev;
+  uint dinum;           // directory's inode number, 0 if unused
+  char name[DIRSIZ];
+  uint inum;            // inode name refers to, 0 if none
+  uint off;             // byte offset of the dirent in the directory
+  uint lastuse;         // dcache.clock when last looked up
+  struct dentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry ent[NDENTRY];
+  struct dentry *hash[NDHASH];
+  uint clock;
+} dcache;
+
+#define DHASH(dev, dinum, name) (((dev) * 31 + (dinum) * 7 + dnamehash(name)) % NDHASH)
+
+static uint
+dnamehash(char *name)
+{
+  uint h = 0;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h;
+}
+
+static void dcache_purge(uint, uint);
+
+static void ifree_append(struct inode*);
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  for(i = 0; i < NIHASH; i++)
+    initlock(&itable.bucket[i].lock, "itable.bucket");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    ifree_append(&itable.inode[i]);
   }
+  initlock(&dcache.lock, "dcache");
 }
 
 static struct inode* iget(uint dev, uint inum);
 
+// the free list holds entries with ip->ref zero, but entries
+// get new references without taking itable.lock, so it may
+// also hold some that are in use again. iget() skips those.
+// caller holds itable.lock.
+static void
+ifree_unlink(struct inode *ip)
+{
+  if(ip->fprev)
+    ip->fprev->fnext = ip->fnext;
+  else
+    itable.freehead = ip->fnext;
+  if(ip->fnext)
+    ip->fnext->fprev = ip->fprev;
+  else
+    itable.freetail = ip->fprev;
+  ip->fnext = ip->fprev = 0;
+  ip->onfree = 0;
+}
+
+// put ip at the most recently used end of the free list.
+// caller holds itable.lock.
+static void
+ifree_append(struct inode *ip)
+{
+  if(ip->onfree)
+    ifree_unlink(ip);
+  ip->fprev = itable.freetail;
+  ip->fnext = 0;
+  if(itable.freetail)
+    itable.freetail->fnext = ip;
+  else
+    itable.freehead = ip;
+  itable.freetail = ip;
+  ip->onfree = 1;
+}
+
+// pa4: the inode block ialloc() looks in first, the one it
+// last allocated from. only a hint, so it needs no lock.
+static uint ialloc_cursor;
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
@@ -200,19 +369,28 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int inum, k, blk;
+  int nib = (sb.ninodes + IPB - 1) / IPB;  // inode blocks
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+  for(k = 0; k < nib; k++){
+    blk = (ialloc_cursor + k) % nib;
+    if(!IMAYFREE(blk))
+      continue;
+    bp = bread(dev, sb.inodestart + blk);
+    for(inum = blk * IPB; inum < (blk + 1) * IPB && inum < sb.ninodes; inum++){
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum != 0 && dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        if(blk < NIBLK)
+          ibfree[blk]--;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        ialloc_cursor = blk;
+        return iget(dev, inum);
+      }
     }
     brelse(bp);
   }
@@ -232,6 +410,8 @@ iupdate(struct inode *ip)
 
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
+  if(dip->type != 0 && ip->type == 0 && ip->inum / IPB < NIBLK)
+    ibfree[ip->inum / IPB]++;  // freed by iput()
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
@@ -248,31 +428,64 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
-
-  acquire(&itable.lock);
+  struct inode *ip, **pp;
+  struct ibucket *bk = &itable.bucket[IHASH(dev, inum)];
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  acquire(&bk->lock);
+  for(ip = bk->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&itable.lock);
+      release(&bk->lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
+  release(&bk->lock);
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Not there. Only one process recycles at a time; check
+  // again in case someone else brought the inode in meanwhile.
+  acquire(&itable.lock);
+  acquire(&bk->lock);
+  for(ip = bk->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      ip->ref++;
+      release(&bk->lock);
+      release(&itable.lock);
+      return ip;
+    }
+  }
+  release(&bk->lock);
+
+  // Recycle the least recently used free entry.
+  struct ibucket *vbk;
+  while(1){
+    if((ip = itable.freehead) == 0)
+      panic("iget: no inodes");
+    ifree_unlink(ip);
+    if(ip->inum == 0)   // never used
+      break;
+    vbk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+    acquire(&vbk->lock);
+    if(ip->ref == 0){
+      for(pp = &vbk->head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      release(&vbk->lock);
+      break;
+    }
+    release(&vbk->lock);  // in use again; it rejoins on iput()
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ra_next = ip->ra_win = ip->ra_end = 0;
+  ip->alloc_next = 0;
+  acquire(&bk->lock);
+  ip->hnext = bk->head;
+  bk->head = ip;
+  release(&bk->lock);
   release(&itable.lock);
 
   return ip;
@@ -283,9 +496,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *bk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&bk->lock);
   ip->ref++;
-  release(&itable.lock);
+  release(&bk->lock);
   return ip;
 }
 
@@ -338,7 +553,10 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *bk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+  int last;
+
+  acquire(&bk->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -347,20 +565,27 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&bk->lock);
 
     itrunc(ip);
+    dcache_purge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(&bk->lock);
   }
 
-  ip->ref--;
-  release(&itable.lock);
+  last = --ip->ref == 0;
+  release(&bk->lock);
+
+  if(last){
+    acquire(&itable.lock);
+    ifree_append(ip);
+    release(&itable.lock);
+  }
 }
 
 // Common idiom: unlock, then put.
@@ -376,7 +601,43 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT], and the NDINDIRECT after
+// that in the indirect blocks listed in block ip->addrs[NDIRECT+1].
+
+// pa4: allocate a block for ip, right after the last one it
+// got if that is free, so that a file written sequentially
+// ends up contiguous on disk.
+// data is 0 for an indirect block.
+static uint
+iballoc(struct inode *ip, int data)
+{
+  uint addr = balloc(ip->dev, ip->alloc_next, data && ip->type == T_FILE);
+  if(addr)
+    ip->alloc_next = addr + 1;
+  return addr;
+}
+
+// return the bn'th entry of the indirect block at addr,
+// allocating the data block if necessary.
+// returns 0 if out of disk space.
+static uint
+bmapind(struct inode *ip, uint addr, uint bn)
+{
+  uint *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[bn]) == 0){
+    addr = iballoc(ip, 1);
+    if(addr){
+      a[bn] = addr;
+      log_write(bp);
+    }
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -389,7 +650,7 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = iballoc(ip, 1);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
@@ -401,27 +662,59 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = iballoc(ip, 0);
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
     }
+    return bmapind(ip, addr, bn);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect block
+    // it points to, allocating either if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      addr = iballoc(ip, 0);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr;
+    }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
+    if((addr = a[bn / NINDIRECT]) == 0){
+      addr = iballoc(ip, 0);
       if(addr){
-        a[bn] = addr;
+        a[bn / NINDIRECT] = addr;
         log_write(bp);
       }
     }
     brelse(bp);
-    return addr;
+    if(addr == 0)
+      return 0;
+    return bmapind(ip, addr, bn % NINDIRECT);
   }
 
   panic("bmap: out of range");
 }
 
+// free the indirect block at addr and the data blocks it lists.
+static void
+itruncind(struct inode *ip, uint addr)
+{
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(int j = 0; j < NINDIRECT; j++){
+    if(a[j])
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -431,6 +724,14 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->type == T_FILE && (ip->minor & I_INLINE)){
+    // addrs[] holds data, not block numbers.
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->minor &= ~I_INLINE;
+  }
+  if(ip->type == T_DIR)
+    ip->minor &= ~I_HASHED;
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -439,18 +740,24 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip, ip->addrs[NDIRECT]);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
       if(a[j])
-        bfree(ip->dev, a[j]);
+        itruncind(ip, a[j]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
   }
 
   ip->size = 0;
+  ip->ra_next = ip->ra_win = ip->ra_end = 0;
   iupdate(ip);
 }
 
@@ -466,37 +773,180 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// pa4: called by readi() before it reads blocks first..last.
+// if the read continues where the last one stopped, keep
+// up to ra_win blocks past it in flight, doubling the window
+// each time half of it has been consumed. any other read
+// closes the window.
+static void
+readahead(struct inode *ip, uint first, uint last)
+{
+  uint nblocks = (ip->size + BSIZE - 1) / BSIZE;
+
+  if(first != ip->ra_next && first + 1 != ip->ra_next){
+    ip->ra_win = 0;
+    ip->ra_end = 0;
+  } else if(ip->ra_end <= last + 1 + ip->ra_win / 2){
+    ip->ra_win = ip->ra_win ? min(ip->ra_win * 2, FS_RA_MAX) : FS_RA_MIN;
+    uint bn = ip->ra_end > last + 1 ? ip->ra_end : last + 1;
+    uint end = min(last + 1 + ip->ra_win, nblocks);
+    for(; bn < end; bn++){
+      // every block below ip->size is allocated, so bmap()
+      // only looks it up.
+      uint addr = bmap(ip, bn);
+      if(addr == 0)
+        break;
+      breadahead(ip->dev, addr);
+    }
+    ip->ra_end = bn;
+  }
+  ip->ra_next = last + 1;
+}
+
+// pa4: either_copyout() and either_copyin() for readi() and
+// writei(), which hold ip->lock: a user copy must not fault, as
+// the fault may fill a page of an mmap()ed file in vma_fill(),
+// which locks that file's inode, perhaps ip itself. a copy that
+// needs a fault fails, and the caller goes to userfault().
+static int
+copyout_locked(int user_dst, uint64 dst, void *src, uint64 len)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(!user_dst)
+    return either_copyout(0, dst, src, len);
+  p->nofault = 1;
+  r = either_copyout(1, dst, src, len);
+  p->nofault = 0;
+  return r;
+}
+
+static int
+copyin_locked(void *dst, int user_src, uint64 src, uint64 len)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(!user_src)
+    return either_copyin(dst, 0, src, len);
+  p->nofault = 1;
+  r = either_copyin(dst, 1, src, len);
+  p->nofault = 0;
+  return r;
+}
+
+// pa4: after copyout_locked() or copyin_locked() failed, fault
+// in the user pages of [va, va+n) with ip->lock dropped, and
+// lock it again. the caller must hold no buffers, and must
+// re-check what it knew about ip. returns -1 if the address
+// is bad.
+static int
+userfault(struct inode *ip, int user, uint64 va, uint n, int write)
+{
+  int r = 0;
+
+  if(!user)
+    return -1;
+  iunlock(ip);
+  for(uint64 a = PGROUNDDOWN(va); r == 0 && a < va + n; a += PGSIZE)
+    r = vmfault(myproc()->pagetable, a, write);
+  ilock(ip);
+  return r;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// pa4: ip->lock is dropped while a user page is faulted in.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
 
+again:
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
-
+  if(ip->type == T_FILE && (ip->minor & I_INLINE)){
+    if(copyout_locked(user_dst, dst, (char*)ip->addrs + off, n) == -1){
+      if(userfault(ip, user_dst, dst, n, 1) < 0)
+        return -1;
+      goto again;
+    }
+    return n;
+  }
+  if(n > 0)
+    readahead(ip, off/BSIZE, (off+n-1)/BSIZE);
+
+  // pa4: a read of several blocks keeps the next FS_RA_MAX of
+  // them past the one being copied in flight, so the disk sees
+  // them together, but a huge read does not fill the buffer
+  // cache with blocks it won't reach for a while.
+  uint ra = off/BSIZE + 1;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    uint last = (off + (n - tot) - 1) / BSIZE;
+    for(; ra <= last && ra <= off/BSIZE + FS_RA_MAX; ra++){
+      uint addr = bmap(ip, ra);
+      if(addr == 0)
+        break;
+      breadahead(ip->dev, addr);
+    }
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
+    if(copyout_locked(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
-      tot = -1;
-      break;
+      if(userfault(ip, user_dst, dst, m, 1) < 0){
+        tot = -1;
+        break;
+      }
+      // the file may have shrunk while ip->lock was dropped.
+      if(off >= ip->size)
+        break;
+      if(n - tot > ip->size - off)
+        n = tot + ip->size - off;
+      m = 0;
+      continue;
     }
     brelse(bp);
   }
   return tot;
 }
 
+// pa4: a regular file of at most NINLINE bytes keeps them in
+// ip->addrs[], with I_INLINE set, instead of in a data block.
+// move them to a block of their own before the file grows
+// larger. returns -1 if out of disk space.
+static int
+uninline(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+  uint addr;
+
+  memmove(data, ip->addrs, NINLINE);
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->minor &= ~I_INLINE;
+  if(ip->size == 0)
+    return 0;
+  if((addr = bmap(ip, 0)) == 0){
+    memmove(ip->addrs, data, NINLINE);
+    ip->minor |= I_INLINE;
+    return -1;
+  }
+  bp = bread(ip->dev, addr);
+  memmove(bp->data, data, ip->size);
+  log_data(bp);
+  brelse(bp);
+  return 0;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -504,28 +954,58 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // Returns the number of bytes successfully written.
 // If the return value is less than the requested n,
 // there was an error of some kind.
+// pa4: ip->lock is dropped while a user page is faulted in.
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
 
+again:
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  if(ip->type == T_FILE){
+    // an empty file has no blocks, so it can start out inline.
+    if(ip->size == 0 && ip->addrs[0] == 0 && off + n <= NINLINE)
+      ip->minor |= I_INLINE;
+    if((ip->minor & I_INLINE) && off + n <= NINLINE){
+      if(copyin_locked((char*)ip->addrs + off, user_src, src, n) == -1){
+        if(userfault(ip, user_src, src, n, 0) < 0)
+          return -1;
+        goto again;
+      }
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if((ip->minor & I_INLINE) && uninline(ip) < 0)
+      return -1;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+    if(copyin_locked(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
-      break;
+      if(userfault(ip, user_src, src, m, 0) < 0)
+        break;
+      // the file may have been truncated while ip->lock was dropped.
+      if(off > ip->size)
+        break;
+      m = 0;
+      continue;
     }
-    log_write(bp);
+    if(ip->type == T_FILE)
+      log_data(bp);
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -540,6 +1020,21 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// pa4: an upper bound on the blocks writei() logs for n bytes
+// at any offset: the data blocks, the indirect blocks that map
+// them (up to three bordering ones besides one per NINDIRECT),
+// a bitmap block per BPB allocations plus two at the ends, and
+// the inode.
+int
+writeblocks(uint n)
+{
+  int nd, nind;
+
+  nd = (n + BSIZE - 1) / BSIZE + 1;
+  nind = nd / NINDIRECT + 3;
+  return nd + nind + (nd + nind) / BPB + 2 + 1;
+}
+
 // Directories
 
 int
@@ -548,6 +1043,251 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// pa4: directory name cache.
+//
+// The dcache remembers what dirlookup() found: the inode that
+// name refers to in directory dinum, or that there is none (a
+// negative entry, inum 0). namex() consults it before locking
+// each directory on a path, so a path that is cached resolves
+// without sleeplocks or directory reads.
+//
+// Entries change only while the directory is locked:
+// dirlookup() adds them, dirlink() overwrites them and
+// unlink removes them with dcache_remove(). iput() drops a
+// freed inode's entries with dcache_purge(), since its inode
+// number will be reused.
+
+static struct dentry*
+dfind(uint dev, uint dinum, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[DHASH(dev, dinum, name)]; d; d = d->next){
+    if(d->dev == dev && d->dinum == dinum && namecmp(d->name, name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// unlink d from its hash chain and mark it unused.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[DHASH(d->dev, d->dinum, d->name)]; *pp; pp = &(*pp)->next){
+    if(*pp == d){
+      *pp = d->next;
+      d->next = 0;
+      d->dinum = 0;
+      return;
+    }
+  }
+  panic("dunhash");
+}
+
+// look name up in directory (dev, dinum). on a hit, return 1
+// and set *ipp to a reference to the inode, or to 0 for a
+// negative entry; the iget() happens under dcache.lock, so
+// an unlink can't free the inode in between.
+static int
+dcache_get(uint dev, uint dinum, char *name, struct inode **ipp, uint *poff)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dinum, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  d->lastuse = dcache.clock++;
+  *ipp = 0;
+  if(d->inum){
+    *ipp = iget(dev, d->inum);
+    if(poff)
+      *poff = d->off;
+  }
+  release(&dcache.lock);
+  return 1;
+}
+
+// record that name in dp is inum (0 for none) at offset off.
+// caller holds dp->lock.
+static void
+dcache_put(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d, *victim;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    // recycle an unused or the least recently used entry.
+    victim = &dcache.ent[0];
+    for(d = dcache.ent; d < &dcache.ent[NDENTRY]; d++){
+      if(d->dinum == 0){
+        victim = d;
+        break;
+      }
+      if(d->lastuse < victim->lastuse)
+        victim = d;
+    }
+    d = victim;
+    if(d->dinum)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    d->next = dcache.hash[DHASH(d->dev, d->dinum, d->name)];
+    dcache.hash[DHASH(d->dev, d->dinum, d->name)] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  d->lastuse = dcache.clock++;
+  release(&dcache.lock);
+}
+
+// forget name in dp. caller holds dp->lock.
+void
+dcache_remove(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0)
+    dunhash(d);
+  release(&dcache.lock);
+}
+
+// forget the entries of inode inum, which is being freed:
+// those in it, if it was a directory, and those naming it.
+static void
+dcache_purge(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.ent; d < &dcache.ent[NDENTRY]; d++){
+    if(d->dinum && d->dev == dev && (d->dinum == inum || d->inum == inum))
+      dunhash(d);
+  }
+  release(&dcache.lock);
+}
+
+#define DPB (BSIZE / sizeof(struct dirent))  // entries per block
+
+// pa4: look name up in hashed directory dp, reading only the
+// blocks of its chain. returns the inum, 0 if not found.
+static uint
+dirfindhashed(struct inode *dp, char *name, uint *poff)
+{
+  uint blk = dnamehash(name) % NDIRCHAIN, inum;
+  struct dirent *de;
+  struct buf *bp;
+
+  do {
+    bp = bread(dp->dev, bmap(dp, blk));
+    de = (struct dirent*)bp->data;
+    for(int i = 1; i < DPB; i++){
+      if(de[i].inum && namecmp(name, de[i].name) == 0){
+        *poff = blk * BSIZE + i * sizeof(*de);
+        inum = de[i].inum;
+        brelse(bp);
+        return inum;
+      }
+    }
+    blk = ((struct dirhead*)bp->data)->next;
+    brelse(bp);
+  } while(blk);
+  return 0;
+}
+
+// pa4: add (name, inum) to the chain of name in hashed
+// directory dp, growing the chain by a block if it is full.
+// returns the entry's offset, or -1 if out of disk space.
+static int
+dirinsert(struct inode *dp, char *name, uint inum)
+{
+  uint blk = dnamehash(name) % NDIRCHAIN, next;
+  struct dirent *de;
+  struct buf *bp;
+
+  for(;;){
+    bp = bread(dp->dev, bmap(dp, blk));
+    de = (struct dirent*)bp->data;
+    for(int i = 1; i < DPB; i++){
+      if(de[i].inum == 0){
+        memset(&de[i], 0, sizeof(de[i]));
+        strncpy(de[i].name, name, DIRSIZ);
+        de[i].inum = inum;
+        log_write(bp);
+        brelse(bp);
+        return blk * BSIZE + i * sizeof(*de);
+      }
+    }
+    if((next = ((struct dirhead*)bp->data)->next) == 0){
+      // a new block, zeroed, so it ends the chain.
+      next = dp->size / BSIZE;
+      if(bmap(dp, next) == 0){
+        brelse(bp);
+        return -1;
+      }
+      dp->size += BSIZE;
+      iupdate(dp);
+      ((struct dirhead*)bp->data)->next = next;
+      log_write(bp);
+    }
+    brelse(bp);
+    blk = next;
+  }
+}
+
+// pa4: turn dp, a plain directory of one full block, into a
+// hashed one: its entries are reinserted into NDIRCHAIN new
+// chains, the first of which reuses its block. if they would
+// not fit in the chains' first blocks, dp stays as it is.
+// returns -1 if out of memory or disk space.
+static int
+dirhash(struct inode *dp)
+{
+  struct dirent *old;
+  struct buf *bp;
+  uint blk;
+  int n[NDIRCHAIN];
+
+  if((old = (struct dirent*)kalloc()) == 0)
+    return -1;
+  bp = bread(dp->dev, bmap(dp, 0));
+  memmove(old, bp->data, BSIZE);
+  brelse(bp);
+  memset(n, 0, sizeof(n));
+  for(int i = 0; i < DPB; i++){
+    if(old[i].inum && ++n[dnamehash(old[i].name) % NDIRCHAIN] == DPB){
+      kfree((char*)old);
+      return 0;
+    }
+  }
+  for(blk = 1; blk < NDIRCHAIN; blk++){
+    if(bmap(dp, blk) == 0){
+      kfree((char*)old);  // the blocks are freed with dp
+      return -1;
+    }
+  }
+  bp = bread(dp->dev, bmap(dp, 0));
+  memset(bp->data, 0, BSIZE);
+  log_write(bp);
+  brelse(bp);
+  dp->size = NDIRCHAIN * BSIZE;
+  dp->minor |= I_HASHED;
+  iupdate(dp);
+  // the offsets of its entries change.
+  dcache_purge(dp->dev, dp->inum);
+  for(int i = 0; i < DPB; i++){
+    if(old[i].inum && dirinsert(dp, old[i].name, old[i].inum) < 0)
+      panic("dirhash");  // checked above that no chain grows
+  }
+  kfree((char*)old);
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -555,10 +1295,21 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
   struct dirent de;
+  struct inode *ip;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_get(dp->dev, dp->inum, name, &ip, poff))
+    return ip;
+
+  if(dp->minor & I_HASHED){
+    if((inum = dirfindhashed(dp, name, &off)) != 0)
+      goto found;
+    dcache_put(dp, name, 0, 0);
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -566,14 +1317,19 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       continue;
     if(namecmp(name, de.name) == 0){
       // entry matches path element
-      if(poff)
-        *poff = off;
       inum = de.inum;
-      return iget(dp->dev, inum);
+      goto found;
     }
   }
 
+  dcache_put(dp, name, 0, 0);
   return 0;
+
+found:
+  if(poff)
+    *poff = off;
+  dcache_put(dp, name, inum, off);
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -591,6 +1347,24 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  // pa4: a directory that outgrows its first block is hashed.
+  if(!(dp->minor & I_HASHED) && dp->size == BSIZE){
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    if(off == dp->size && dirhash(dp) < 0)
+      return -1;
+  }
+  if(dp->minor & I_HASHED){
+    if((off = dirinsert(dp, name, inum)) < 0)
+      return -1;
+    dcache_put(dp, name, inum, off);
+    return 0;
+  }
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -603,6 +1377,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcache_put(dp, name, inum, off);
 
   return 0;
 }
@@ -661,6 +1436,16 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    if(!(nameiparent && *path == '\0') &&
+       dcache_get(ip->dev, ip->inum, name, &next, 0)){
+      // resolved without locking ip. only directories have
+      // dcache entries, so ip is one.
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -699,42 +1484,72 @@ nameiparent(char *path, char *name)
 }
 
 // pa4: swapread
+// read swap slot blkno into the physical page at ptr,
+// as a single PGSIZE disk request that skips the buffer cache.
 void
 swapread(uint64 ptr, int blkno)
 {
-  struct buf *bp;
-  int i;
   const int BLKS_PER_PG = PGSIZE/BSIZE;
 
-  if (blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG)
+  int dev, b = swapblock(blkno, &dev);
+
+  if (b < 0)
     panic("swapread: blkno exceeded range");
 
-  for(i = 0; i < BLKS_PER_PG; i++){
-    nr_sectors_read++;
-    bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-    if(either_copyout(1, ptr + i * BSIZE, bp->data, BSIZE) == -1)
-      panic("swapread: either_copyout failed");
-    brelse(bp);
+  if (zswap_load(ptr, blkno))
+    return;
+  nr_sectors_read += BLKS_PER_PG;
+  virtio_disk_rwraw(dev, (void*)ptr, b, PGSIZE, 0);
+}
+
+// pa4: swapreadv
+// read the n consecutive swap slots starting at blkno into
+// pages[0..n-1] as one scatter-gather disk request, apart from
+// slots that zswap holds. a run that crosses into another swap
+// area is split.
+void
+swapreadv(char **pages, int n, int blkno)
+{
+  const int BLKS_PER_PG = PGSIZE/BSIZE;
+  int dev, b, dj;
+
+  if (blkno < 0 || n < 1)
+    panic("swapreadv: blkno exceeded range");
+
+  for (int i = 0; i < n; ) {
+    if ((b = swapblock(blkno + i, &dev)) < 0)
+      panic("swapreadv: blkno exceeded range");
+    if (zswap_load((uint64)pages[i], blkno + i)) {
+      i++;
+      continue;
+    }
+    int j = i + 1;
+    while (j < n && !zswap_has(blkno + j) &&
+           swapblock(blkno + j, &dj) == b + (j - i) * BLKS_PER_PG && dj == dev)
+      j++;
+    nr_sectors_read += (j - i) * BLKS_PER_PG;
+    virtio_disk_rwpages(dev, (void**)(pages + i), j - i, b, 0);
+    i = j;
   }
 }
 
 // pa4: swapwrite
+// write the physical page at ptr to swap slot blkno, unless
+// zswap keeps it compressed in memory.
+// swap blocks are never cached, so there is nothing to
+// read first or to invalidate in bcache.
 void
 swapwrite(uint64 ptr, int blkno)
 {
-  struct buf *bp;
-  int i;
   const int BLKS_PER_PG = PGSIZE / BSIZE;
 
-  if (blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG)
+  int dev, b = swapblock(blkno, &dev);
+
+  if (b < 0)
     panic("swapwrite: blkno exceeded range");
 
-  for(i = 0; i < BLKS_PER_PG; i++){
-    nr_sectors_write++;
-    bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-    if(either_copyin(bp->data, 1, ptr + i * BSIZE, BSIZE) == -1)
-      panic("swapwrite: either_copyin failed");
-    bwrite(bp);
-    brelse(bp);
-  }
-}
\ No newline at end of file
+  if (zswap_store(ptr, blkno))
+    return;
+  nr_sectors_write += BLKS_PER_PG;
+  virtio_disk_rwraw(dev, (void*)ptr, b, PGSIZE, 1);
+}
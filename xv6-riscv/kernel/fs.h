@@ -24,9 +24,10 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,9 +36,15 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses: direct, indirect, double indirect
 };
 
+// pa4: for a T_FILE or T_DIR, minor holds flags rather than a
+// device number.
+#define I_INLINE 1    // T_FILE: the contents are in addrs[] itself
+#define I_HASHED 2    // T_DIR: entries are hashed, see struct dirhead
+#define NINLINE  (sizeof(uint) * (NDIRECT+2))  // most bytes it holds
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -58,6 +65,20 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// pa4: a hashed directory (I_HASHED) is NDIRCHAIN chains of
+// blocks, chain i starting at block i. an entry lives in chain
+// (hash of its name) % NDIRCHAIN. slot 0 of every block links
+// the chain instead of holding an entry; its inum is 0, so code
+// that reads the directory as plain dirents skips it.
+#define NDIRCHAIN 8
+
+struct dirhead {
+  ushort inum;          // always 0
+  ushort pad;
+  uint next;            // next block of the chain, 0 if none
+  char unused[8];
+};
+
 
 
 extern int nr_sectors_read;
@@ -1,6 +1,7 @@
 // Physical memory allocator, for user pages,
 // kernel stacks, page table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or 2^order physically contiguous ones.
 
 #include "types.h"
 #include "param.h"
@@ -10,7 +11,7 @@
 #include "defs.h"
 #include "proc.h"
 
-void freerange(void *pa_start, void *pa_end);
+static void buddy_put(uint64, int);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
@@ -19,16 +20,48 @@ struct run {
   struct run *next;
 };
 
-struct {
+// one freelist per CPU, so that kalloc()/kfree() on different
+// harts don't contend. a CPU whose list runs dry steals a batch
+// of pages from another CPU's list.
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;
+} kmem[NCPU];
+
+#define KSTEAL_BATCH 32  // pages moved per steal or buddy refill
+#define KFREE_HIGH   64  // a CPU's list beyond this goes back to the buddy lists
+
+// pa4: buddy allocator. per-CPU freelist 밑에서 모든 free 메모리를
+// 2^order 페이지 block으로 가짐 (order 0..SUPERORDER, 최대 2MB).
+// block은 크기에 맞춰 정렬되어 있고, 풀릴 때 짝(buddy)도 free면
+// 합쳐서 한 order 위로 올림. block의 첫 frame struct page의
+// buddy/order가 freelist에 있는지를 나타냄
+#define SUPERORDER 9     // 2MB superpage = 2^9 페이지
+#define NORDER (SUPERORDER+1)
+
+struct bblock {
+  struct bblock *next;
+  struct bblock *prev;
+};
+
+struct {
+  struct spinlock lock;
+  struct bblock *free[NORDER];
+  int n[NORDER];
+} kbuddy;
 
 // pa4: page control variables
-struct page pages[PHYSTOP/PGSIZE];
-struct page *page_lru_head;
+struct page pages[NFRAMES];
 int num_free_pages;
 int num_lru_pages;
+uint reclaim_until;  // 이 tick까지 mempressure()는 MP_CRITICAL
+
+// pa4: 부팅 때 RAM 초기화 (kinithart())
+static uint64 kinit_start;        // kinit() 때의 r_time()
+static volatile int kinit_next;   // 다음에 가져갈 2MB chunk
+static volatile int kinit_harts;  // kinithart()에 들어온 hart 수
+static volatile int kinit_done;   // 그중 끝난 수
 
 // vm.c의 락들
 extern struct { struct spinlock lock; } page_lock;
@@ -38,35 +71,85 @@ extern struct { struct spinlock lock; } swap_bitmap_lock;
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
   initlock(&page_lock.lock, "page");
   initlock(&lru_lock.lock, "lru");
   initlock(&swap_bitmap_lock.lock, "swapbitmap");
+  initlock(&kbuddy.lock, "kbuddy");
   init_swapbitmap();  // 스왑 비트맵 초기화
+  rmap_init();        // COW 공유 매핑 pool 초기화
+  pagevec_init();     // per-CPU LRU 추가 배치 초기화
+  zswapinit();        // 압축 swap cache 초기화
+
+  // pages[]는 bss라 이미 0. 0이 아닌 초기값은 swapslot뿐이고,
+  // free 메모리의 것은 kinithart()가 채움
+  for(uint64 pa = KERNBASE; pa < PGROUNDUP((uint64)end); pa += PGSIZE)
+    PA2PG(pa)->swapslot = -1;
+  kinit_start = r_time();
+}
 
-  // pages[] 배열의 필드들을 명시적으로 초기화
-  for(int i = 0; i < PHYSTOP/PGSIZE; i++) {
-    pages[i].in_lru = 0;
-    pages[i].is_page_table = 0;
-    pages[i].vaddr = 0;
+// pa4: [pa, pend)의 struct page를 초기화하고 buddy freelist에 넣음.
+// 정렬된 2MB chunk는 block 하나로 들어가므로 kfree()를 페이지마다
+// 부르지 않고, 부팅 때는 junk도 채우지 않음
+static void
+kinitchunk(uint64 pa, uint64 pend)
+{
+  for(uint64 a = pa; a < pend; a += PGSIZE)
+    PA2PG(a)->swapslot = -1;
+
+  acquire(&kbuddy.lock);
+  while(pa < pend){
+    int order = SUPERORDER;
+    while(order > 0 && (pa % ((uint64)PGSIZE << order) != 0 ||
+                        pa + ((uint64)PGSIZE << order) > pend))
+      order--;
+    buddy_put(pa, order);
+    pa += (uint64)PGSIZE << order;
   }
+  release(&kbuddy.lock);
+}
+
+// pa4: 부팅 때 모든 hart가 부름. kernel 뒤의 RAM을 2MB chunk 단위로
+// 하나씩 가져가 초기화하므로, 뜬 hart 수와 상관없이 나눠서 끝남
+void
+kinithart(void)
+{
+  uint64 base = SUPERPGROUNDDOWN(PGROUNDUP((uint64)end));
+  int nchunk = (PHYSTOP - base + SUPERPGSIZE - 1) / SUPERPGSIZE;
+  int c, n = 0;
 
-  freerange(end, (void*)PHYSTOP);
+  __sync_fetch_and_add(&kinit_harts, 1);
+  while((c = __sync_fetch_and_add(&kinit_next, 1)) < nchunk){
+    uint64 pa = base + (uint64)c * SUPERPGSIZE;
+    uint64 pend = pa + SUPERPGSIZE < PHYSTOP ? pa + SUPERPGSIZE : PHYSTOP;
+    if(pa < PGROUNDUP((uint64)end))
+      pa = PGROUNDUP((uint64)end);
+    kinitchunk(pa, pend);
+    n += (pend - pa) / PGSIZE;
+  }
+  __sync_fetch_and_add(&num_free_pages, n);
+  __sync_fetch_and_add(&kinit_done, 1);
 }
 
+// pa4: hart 0이 kinithart() 뒤에 부름. 모든 chunk가 free list에
+// 들어갈 때까지 기다리고 걸린 시간을 알림
 void
-freerange(void *pa_start, void *pa_end)
+kinitwait(void)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  // kinithart()에 들어온 hart가 모두 끝나야 함. 늦게 온 hart는 빈
+  // chunk만 보고 곧 끝나므로, 들어온 수와 끝난 수가 같으면 됨
+  while(kinit_done < kinit_harts)
+    ;
+  __sync_synchronize();
+  printf("kinit: %d pages free in %ld us on %d harts\n",
+         num_free_pages, (r_time() - kinit_start) / 10, kinit_harts);
 }
 
 // Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// which should have been returned by a call to kalloc().
+// (pa4: boot hands RAM to the buddy lists directly; see
+// kinithart above.)
 void
 kfree(void *pa)
 {
@@ -74,16 +157,247 @@ kfree(void *pa)
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  if(PA2PG(pa)->refcnt > 1)
+    panic("kfree: shared page");
+  PA2PG(pa)->refcnt = 0;
+  // swap cache에 물려 있던 슬롯 참조 반환
+  // (swapcache_reclaim과 겹칠 수 있으므로 원자적으로 떼어냄)
+  int slot = __sync_lock_test_and_set(&PA2PG(pa)->swapslot, -1);
+  if(slot >= 0)
+    freeswap(slot);
 
+#ifndef NOJUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  struct kmem *km = &kmem[cpuid()];
+  acquire(&km->lock);
+  r->next = km->freelist;
+  km->freelist = r;
+  km->nfree++;
+  // 너무 많이 쌓이면 일부를 buddy로 돌려 합쳐질 수 있게 함
+  struct run *batch = 0;
+  if(km->nfree > KFREE_HIGH){
+    struct run *last = km->freelist;
+    for(int n = 1; n < KSTEAL_BATCH; n++)
+      last = last->next;
+    batch = km->freelist;
+    km->freelist = last->next;
+    last->next = 0;
+    km->nfree -= KSTEAL_BATCH;
+  }
+  release(&km->lock);
+  pop_off();
+
+  __sync_fetch_and_add(&num_free_pages, 1);
+
+  if(batch){
+    acquire(&kbuddy.lock);
+    for(; batch; batch = r){
+      r = batch->next;
+      buddy_put((uint64)batch, 0);
+    }
+    release(&kbuddy.lock);
+  }
+}
+
+// pa4: buddy freelist 조작. caller가 kbuddy.lock을 잡고 있음
+static void
+buddy_link(uint64 pa, int order)
+{
+  struct bblock *b = (struct bblock*)pa;
+
+  b->prev = 0;
+  b->next = kbuddy.free[order];
+  if(b->next)
+    b->next->prev = b;
+  kbuddy.free[order] = b;
+  kbuddy.n[order]++;
+  PA2PG(pa)->buddy = 1;
+  PA2PG(pa)->order = order;
+}
+
+static void
+buddy_unlink(uint64 pa, int order)
+{
+  struct bblock *b = (struct bblock*)pa;
+
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    kbuddy.free[order] = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+  kbuddy.n[order]--;
+  PA2PG(pa)->buddy = 0;
+}
+
+// pa의 2^order 페이지 block을 돌려놓음. 짝 block이 같은 order로
+// free면 떼어 합치고 위 order에서 다시 확인
+static void
+buddy_put(uint64 pa, int order)
+{
+  while(order < SUPERORDER){
+    uint64 bpa = pa ^ ((uint64)PGSIZE << order);
+    if(bpa < KERNBASE || bpa >= PHYSTOP)
+      break;
+    struct page *bp = PA2PG(bpa);
+    if(!bp->buddy || bp->order != order)
+      break;
+    buddy_unlink(bpa, order);
+    if(bpa < pa)
+      pa = bpa;
+    order++;
+  }
+  buddy_link(pa, order);
+}
+
+// 2^order 페이지 block 하나를 떼어 줌. 그 크기가 없으면 가장 작은
+// 큰 block을 반씩 쪼개고 남는 위쪽 반들은 freelist에 둠. 없으면 0
+static uint64
+buddy_get(int order)
+{
+  int o;
+
+  for(o = order; o < NORDER && kbuddy.free[o] == 0; o++)
+    ;
+  if(o == NORDER)
+    return 0;
+  uint64 pa = (uint64)kbuddy.free[o];
+  buddy_unlink(pa, o);
+  while(o > order){
+    o--;
+    buddy_link(pa + ((uint64)PGSIZE << o), o);
+  }
+  return pa;
+}
+
+// pa4: 물리적으로 연속인 2^order 페이지를 줌 (2^order 페이지로 정렬됨).
+// evict하지 않으므로 없으면 바로 0. 첫 frame의 struct page만 초기화함
+void *
+kalloc_order(int order)
+{
+  uint64 pa;
+
+  if(order < 0 || order > SUPERORDER)
+    panic("kalloc_order");
+  acquire(&kbuddy.lock);
+  pa = buddy_get(order);
+  release(&kbuddy.lock);
+  if(pa == 0)
+    return 0;
+  __sync_fetch_and_sub(&num_free_pages, 1 << order);
+  struct page *pg = PA2PG(pa);
+  pg->refcnt = 1;
+  pg->readahead = 0;
+  pg->refill = 0;
+  pg->ip = 0;
+  return (void*)pa;
+}
+
+// pa4: kalloc_order(order)로 받은 block을 통째로 돌려줌
+void
+kfree_order(void *pa, int order)
+{
+  if(order < 0 || order > SUPERORDER || ((uint64)pa % ((uint64)PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + ((uint64)PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+  PA2PG(pa)->refcnt = 0;
+
+  acquire(&kbuddy.lock);
+  buddy_put((uint64)pa, order);
+  release(&kbuddy.lock);
+  __sync_fetch_and_add(&num_free_pages, 1 << order);
+}
+
+// pa4: 2MB superpage 하나, 없으면 0.
+// the caller maps it with a single level-1 PTE; only the first
+// frame's struct page is used until it is split.
+void *
+superalloc(void)
+{
+  void *pa;
+
+  if((pa = kalloc_order(SUPERORDER)) == 0)
+    return 0;
+  PA2PG(pa)->super = 1;
+  return pa;
+}
+
+// pa4: give back a whole 2MB superpage.
+void
+superfree(void *pa)
+{
+  PA2PG(pa)->super = 0;
+  kfree_order(pa, SUPERORDER);
+}
+
+// km의 freelist가 비었을 때 buddy에서 4KB 페이지를 KSTEAL_BATCH개까지
+// 가져와 채움. caller가 km->lock을 잡고 있음. 하나도 없으면 0
+static struct run*
+buddy_refill(struct kmem *km)
+{
+  struct run *r = 0;
+  uint64 pa;
+  int n;
+
+  acquire(&kbuddy.lock);
+  for(n = 0; n < KSTEAL_BATCH && (pa = buddy_get(0)) != 0; n++){
+    ((struct run*)pa)->next = r;
+    r = (struct run*)pa;
+  }
+  release(&kbuddy.lock);
+  if(r == 0)
+    return 0;
+  km->freelist = r->next;
+  km->nfree += n - 1;
+  return r;
+}
+
+// Move up to KSTEAL_BATCH pages from another CPU's freelist to km,
+// which the caller holds locked. Takes the other lists' locks one at
+// a time, never two at once, so CPUs stealing from each other can't
+// deadlock; km's own lock is released meanwhile.
+// Returns a page for the caller, or 0 if every list is empty.
+static struct run*
+steal(struct kmem *km)
+{
+  struct run *r, *first, *last;
+  int n;
+
+  release(&km->lock);
+  for(struct kmem *victim = kmem; victim < &kmem[NCPU]; victim++){
+    if(victim == km)
+      continue;
+    acquire(&victim->lock);
+    if(victim->freelist == 0){
+      release(&victim->lock);
+      continue;
+    }
+    // take the first n pages of victim's list.
+    first = last = victim->freelist;
+    for(n = 1; n < KSTEAL_BATCH && last->next; n++)
+      last = last->next;
+    victim->freelist = last->next;
+    victim->nfree -= n;
+    release(&victim->lock);
+
+    // keep the first for the caller, give the rest to km.
+    r = first;
+    acquire(&km->lock);
+    if(n > 1){
+      last->next = km->freelist;
+      km->freelist = r->next;
+      km->nfree += n - 1;
+    }
+    return r;
+  }
+  acquire(&km->lock);
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -92,29 +406,61 @@ kfree(void *pa)
 // pa4: kalloc function
 #include "defs.h"      // select_victim, evictpage 프로토타입
 
+// pa4: free list(다른 CPU 것, buddy 포함)에서만 가져옴.
+// evict하지 않으므로 evictpage() 도중(zswap)에도 부를 수 있음. 없으면 0
 void *
-kalloc(void)
+kalloc_noevict(void)
 {
   struct run *r;
 
-retry:
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  push_off();
+  struct kmem *km = &kmem[cpuid()];
+  acquire(&km->lock);
+  r = km->freelist;
   if (r) {
-    kmem.freelist = r->next;
-    release(&kmem.lock);
+    km->freelist = r->next;
+    km->nfree--;
+  } else if ((r = buddy_refill(km)) == 0) {
+    r = steal(km);
+  }
+  release(&km->lock);
+  pop_off();
+
+  if (r) {
+    __sync_fetch_and_sub(&num_free_pages, 1);
+    PA2PG(r)->refcnt = 1;
+    PA2PG(r)->readahead = 0;
+    PA2PG(r)->refill = 0;
+    PA2PG(r)->ip = 0;
+#ifndef NOJUNK
     memset((char*)r, 5, PGSIZE); // fill with junk
-    return (void*)r;
+#endif
   }
-  release(&kmem.lock);
+  return (void*)r;
+}
+
+void *
+kalloc(void)
+{
+  void *r;
+
+retry:
+  if((r = kalloc_noevict()) != 0)
+    return r;
 
-  // freelist가 비어있으면 스왑 아웃 시도
+  // 모든 CPU의 freelist가 비어있으면 스왑 아웃 시도
+  // (평소에는 kswapd가 워터마크를 유지하므로 여기까지 오는 일은 드묾)
   // printf("[KALLOC] Free list empty, attempting to evict a page\n");
+  reclaim_until = ticks + MP_HOLD;
   if(evictpage()) {
     // printf("[KALLOC] Page eviction successful, retrying allocation\n");
     goto retry;  // 스왑 성공했으면 다시 시도
   }
 
   // printf("[KALLOC] Page eviction failed\n");
+  // usertrap()이 보고 oomkill()을 부름
+  struct proc *p = myproc();
+  if(p)
+    p->oom = 1;
   return 0;
 }
@@ -6,6 +6,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -16,10 +18,13 @@
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end. begin_op() reserves MAXOPBLOCKS blocks
+// of log space; a call that knows it may write more, like a
+// large write(), reserves what it needs with begin_opn().
+// Usually this just adds to the reserved count and returns.
+// But if the reservation does not fit in what is left of
+// the log, it sleeps until the last outstanding end_op()
+// commits.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +33,28 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// The log holds sb.nlog-1 blocks (at most LOGSIZE), as sized by mkfs.
+// Log appends are synchronous, but go to disk as one multi-block
+// request straight from the cached buffers, and installs are sorted
+// by block number so that runs of adjacent blocks share a request.
+//
+// Ordered mode (LOGORDERED): the contents of regular files do
+// not go through the log. log_data() only pins and records such
+// a block, and commit() writes the recorded blocks to their home
+// locations before it writes the log, so a committed inode never
+// points at data that did not reach the disk. Only inodes,
+// bitmaps, indirect blocks and directories are written twice.
+// A block freed by the running transaction is still in use on
+// disk until it commits, so balloc() does not hand it out again
+// until then (log_reusable()); otherwise writing it in place
+// could overwrite a block an uncommitted truncate freed.
+//
+// Group commit: when the last outstanding FS system call ends,
+// it waits up to LOGWINDOW timer cycles for other calls to join
+// the transaction before committing, so that one header write
+// covers all of them. It only waits if the previous commit held
+// more than one call (so a lone writer never pays for the window),
+// and stops waiting as soon as the log is too full for another call.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -41,13 +67,32 @@ struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // data blocks the log can hold: min(size-1, LOGSIZE)
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by them.
   int committing;  // in commit(), please wait.
+  int grouping;    // an end_op() is waiting for others to join.
+  int ntrans;      // FS sys calls in the current transaction.
+  int lastntrans;  // ... and in the previous commit.
   int dev;
+  int ordered;     // file data bypasses the log
+  int ndata;       // file blocks to write in place at commit
+  int data[LOGSIZE];
   struct logheader lh;
+  struct fsstat st;
 };
 struct log log;
 
+// scratch space for commit(). only the committer, or recovery
+// before any FS call can run, uses it.
+static struct buf *logbufs[LOGSIZE];
+static void *logdata[LOGSIZE];
+static int order[LOGSIZE];
+
+// ordered mode: bit b set if block b was freed by the running
+// transaction.
+static uchar freed[(FSSIZE+7)/8];
+
 static void recover_from_log(void);
 static void commit();
 
@@ -60,25 +105,72 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  log.cap = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
+  if (log.cap < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  log.ordered = LOGORDERED && sb->size <= FSSIZE;
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// fill order[] with the indices of block[0..n-1],
+// sorted by block number.
+static void
+sortblocks(int *block, int n)
+{
+  int i, j;
+
+  for (i = 0; i < n; i++) {
+    for (j = i; j > 0 && block[order[j-1]] > block[i]; j--)
+      order[j] = order[j-1];
+    order[j] = i;
+  }
+}
+
+// write the cached blocks logbufs[0..n-1], whose numbers in
+// sorted order are block[order[0..n-1]], one request per run
+// of adjacent blocks.
+static void
+writeruns(int *block, int n)
+{
+  int i, j;
+
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; j < n && block[order[j]] == block[order[j-1]] + 1; j++)
+      ;
+    virtio_disk_rwblocks(logdata + i, j - i, block[order[i]], 1);
+  }
+}
+
+// Copy committed blocks from log to their home location.
+// The blocks are sorted by home block number, and each run of
+// adjacent blocks is written with one request.
 static void
 install_trans(int recovering)
 {
-  int tail;
+  int n = log.lh.n;
+  int i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
+  sortblocks(log.lh.block, n);
+
+  for (i = 0; i < n; i++) {
+    int tail = order[i];
+    // outside recovery, the pinned cache block already holds
+    // exactly what was logged.
+    logbufs[i] = bread(log.dev, log.lh.block[tail]); // read dst
+    if (recovering) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+      memmove(logbufs[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    logdata[i] = logbufs[i]->data;
+  }
+  writeruns(log.lh.block, n);
+
+  for (i = 0; i < n; i++) {
     if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+      bunpin(logbufs[i]);
+    brelse(logbufs[i]);
   }
 }
 
@@ -122,45 +214,107 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// the most blocks one FS system call may reserve.
+int
+log_maxop(void)
+{
+  return log.cap;
+}
+
+// called at the start of an FS system call that writes at
+// most n blocks. n is at most log_maxop(). the reservation is
+// kept in p->logres until end_op(), so calls must not nest.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  struct proc *p = myproc();
+
+  if(n < 1 || n > log.cap)
+    panic("begin_opn");
+  if(p->logres != 0)
+    panic("begin_opn: nested");
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.ndata + log.reserved + n > log.cap){
       // this op might exhaust log space; wait for commit.
+      // an end_op() waiting in the group window should commit
+      // now rather than at its deadline.
+      if(log.grouping)
+        wakeup(&ticks);
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      p->logres = n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// is there room in the log for another FS system call?
+static int
+log_room(void)
+{
+  return log.lh.n + log.ndata + log.reserved + MAXOPBLOCKS <= log.cap;
+}
+
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
 end_op(void)
 {
+  struct proc *p = myproc();
   int do_commit = 0;
 
+  if(p->logres == 0)
+    panic("end_op: no begin_op");
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= p->logres;
+  p->logres = 0;
+  log.ntrans += 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 && !log.grouping){
     do_commit = 1;
-    log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
+
+  if(do_commit && log.lh.n + log.ndata > 0 && log.lastntrans > 1 && log_room()){
+    // group commit: let other FS calls join for a short while.
+    // end_op()s that finish meanwhile leave the commit to us.
+    log.grouping = 1;
+    release(&log.lock);
+    uint64 deadline = r_time() + LOGWINDOW;
+    acquire(&tickslock);
+    while(r_time() < deadline && log_room())
+      timerwait(deadline);
+    release(&tickslock);
+    acquire(&log.lock);
+    log.grouping = 0;
+    log.st.grouped++;
+    if(log.outstanding > 0){
+      // a call that joined is still running; the last of
+      // them to end will commit.
+      do_commit = 0;
+    }
+  }
+  if(do_commit)
+    log.committing = 1;
   release(&log.lock);
 
   if(do_commit){
@@ -174,25 +328,67 @@ end_op(void)
   }
 }
 
+// copy the logging counters to *st.
+void
+logstat(struct fsstat *st)
+{
+  acquire(&log.lock);
+  *st = log.st;
+  release(&log.lock);
+}
+
 // Copy modified blocks from cache to log.
+// The log is contiguous on disk, so the whole transaction goes
+// out as one multi-block write straight from the cache buffers;
+// write_head() runs only after it has finished.
 static void
 write_log(void)
 {
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+    logbufs[tail] = bread(log.dev, log.lh.block[tail]); // cache block
+    logdata[tail] = logbufs[tail]->data;
+  }
+  if (log.lh.n > 0)
+    virtio_disk_rwblocks(logdata, log.lh.n, log.start+1, 1);  // write the log
+  for (tail = 0; tail < log.lh.n; tail++)
+    brelse(logbufs[tail]);
+}
+
+// ordered mode: write the file blocks of the transaction
+// to their home locations, and unpin them.
+static void
+write_data(void)
+{
+  int i;
+
+  sortblocks(log.data, log.ndata);
+  for (i = 0; i < log.ndata; i++) {
+    logbufs[i] = bread(log.dev, log.data[order[i]]);
+    logdata[i] = logbufs[i]->data;
   }
+  writeruns(log.data, log.ndata);
+  for (i = 0; i < log.ndata; i++) {
+    bunpin(logbufs[i]);
+    brelse(logbufs[i]);
+  }
+  log.st.datablocks += log.ndata;
+  log.ndata = 0;
 }
 
 static void
 commit()
 {
+  // log.ntrans is stable: begin_op() waits while committing.
+  if (log.lh.n + log.ndata > 0) {
+    log.st.commits++;
+    log.st.trans += log.ntrans;
+    log.st.logblocks += log.lh.n;
+    if (log.ntrans > log.st.maxtrans)
+      log.st.maxtrans = log.ntrans;
+    write_data();    // File data first, in place
+  }
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
@@ -200,6 +396,10 @@ commit()
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
   }
+  if (log.ordered)
+    memset(freed, 0, sizeof(freed));
+  log.lastntrans = log.ntrans;
+  log.ntrans = 0;
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -217,7 +417,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n + log.ndata >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -234,3 +434,58 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+
+// Like log_write(), for a block of a regular file. In ordered
+// mode the block is only pinned and recorded, and commit()
+// writes it in place before the log; otherwise it is logged.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  if (!log.ordered) {
+    log_write(b);
+    return;
+  }
+  acquire(&log.lock);
+  if (log.lh.n + log.ndata >= log.cap)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  // a block logged earlier in the transaction, as a directory
+  // or indirect block that has since been freed, stays logged.
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno) {
+      release(&log.lock);
+      return;
+    }
+  }
+  for (i = 0; i < log.ndata; i++) {
+    if (log.data[i] == b->blockno)   // absorption
+      break;
+  }
+  if (i == log.ndata) {
+    log.data[i] = b->blockno;
+    bpin(b);
+    log.ndata++;
+  }
+  release(&log.lock);
+}
+
+// ordered mode: the running transaction freed block b.
+// called with b's bitmap block locked, which covers the
+// blocks sharing b's byte of freed[].
+void
+log_freed(uint b)
+{
+  if (log.ordered)
+    freed[b/8] |= 1 << (b%8);
+}
+
+// may balloc() hand out block b, free in the bitmap?
+int
+log_reusable(uint b)
+{
+  return !log.ordered || (freed[b/8] & (1 << (b%8))) == 0;
+}
@@ -13,10 +13,16 @@ main()
   if(cpuid() == 0){
     consoleinit();
     printfinit();
+    traceinit();     // event trace rings
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    __sync_synchronize();
+    started = 1;     // let the other harts help free RAM
+    kinithart();     // free this hart's share of RAM
+    kinitwait();     // ... and wait for theirs
+    slabinit();      // small-object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
@@ -27,14 +33,21 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
     virtio_disk_init(); // emulated hard disk
+    swapinit();      // swap areas
     userinit();      // first user process
+    kthread_create("kswapd", kswapd); // background page-out daemon
     __sync_synchronize();
-    started = 1;
+    started = 2;
   } else {
     while(started == 0)
       ;
     __sync_synchronize();
+    kinithart();      // free a share of RAM
+    while(started < 2)
+      ;
+    __sync_synchronize();
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
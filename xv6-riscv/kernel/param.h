@@ -2,16 +2,54 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
+#ifndef NINODE
 #define NINODE       50  // maximum number of active i-nodes
+#endif
+#define NIHASH       61  // inode table hash buckets
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define NPRIO         3  // scheduler priority levels
+#define BOOSTTICKS   20  // every process returns to the top level this often
+#define IDLETICKS    10  // max ticks an idle hart waits without a timer interrupt
+#define NSLEEPQ      61  // sleep/wakeup hash buckets
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NIOV         16  // max buffers per readv()/writev()
+#define MAXOPBLOCKS  16  // max # of blocks any FS op writes
+#define LOGSIZE      254   // max data blocks in on-disk log (sb.nlog may be less)
+#define LOGORDERED   1     // journal only metadata; file data is written in place
+#define LOGWINDOW    10000 // group commit window, in timer cycles (1ms)
+#define NBUF         (LOGSIZE+MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define NBUFMEM      64    // block cache gets 1/NBUFMEM of free memory
+#define NBUCKET      61    // block cache hash buckets
+#define NDENTRY      128   // directory name cache entries
+#define NDHASH       31    // directory name cache hash buckets
+#define FS_RA_MIN    4     // first readahead window of a sequential file read
+#define FS_RA_MAX    16    // max blocks read ahead of a sequential file read
 #define FSSIZE       30000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
+#define NVMA         16    // lazily filled memory ranges per process
 // pa4: parameters
 #define SWAPBASE     2000	
 #define SWAPMAX		(30000 - SWAPBASE)
+#define NSWAPAREA    2     // swap areas: the swap disk, or else the above
+#define NSWAPSLOT    8192  // swap slots (pages) zswap can keep
+#define NDISK        2     // virtio disks: file system, swap
+#define KSWAPD_LOW   64    // kswapd starts evicting below this many free pages
+#define KSWAPD_HIGH  128   // ... and stops once this many are free
+#define KSWAPD_BATCH 16    // pages evicted between yields
+#define MP_HOLD      10    // ticks mempressure() stays critical after a direct eviction
+#define NRMAP        4096  // extra mappings of COW-shared pages
+#define PAGEVEC_SIZE 15    // pages batched per CPU before joining the LRU
+#define LRU_REFILL   32    // max active pages examined per inactive refill
+#define LRU_SCAN_BATCH 32  // inactive pages examined per lock hold
+#define LRU_SCAN_MAX 1024  // max inactive pages examined per victim search
+#define TLB_BATCH    16    // PTE updates per TLB invalidation batch
+#define NPTLOCK      64    // PTE locks, hashed by page-table page
+#define NTRACE       512   // events kept per CPU by trace() (power of 2)
+#define NLOCKCLASS   64    // lock names with their own contention counters
+#define LOCKNAME     16    // characters of a lock name that tell classes apart
+#define SWAP_RA_MAX  8     // max pages read ahead on a swap fault
+#define WS_PAGES     16    // evicted pages remembered per process (power of 2)
+#define WS_SLEEP     5     // ticks asleep before they are read back on wakeup
+#define ZSWAP_PAGES  256   // max pages of compressed swap cache, 0 to disable
@@ -8,17 +8,48 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
+// pa4: the ring buffer is PIPEPAGES whole pages, and bytes move
+// in as few copyin()/copyout() calls as possible: one for each
+// run that is contiguous in both the ring and a page.
+#define PIPEPAGES 4
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+
+// a writer copies into the ring past nwrite, and a reader out
+// of it before nread+PIPESIZE, without holding lock, so that
+// a copy can fault or sleep; wlock and rlock keep other
+// writers and readers out meanwhile.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  struct sleeplock wlock; // held by the writer that is copying
+  struct sleeplock rlock; // held by the reader that is copying
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+// struct pipe is small; the ring pages are whole pages.
+static struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = kmem_cache_create("pipe", sizeof(struct pipe));
+}
+
+static void
+pipefree(struct pipe *pi)
+{
+  for(int i = 0; i < PIPEPAGES; i++){
+    if(pi->data[i])
+      kfree(pi->data[i]);
+  }
+  kmem_cache_free(pipecache, pi);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,13 +59,20 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = kmem_cache_alloc(pipecache)) == 0)
     goto bad;
+  memset(pi, 0, sizeof(*pi));
+  for(int i = 0; i < PIPEPAGES; i++){
+    if((pi->data[i] = kalloc()) == 0)
+      goto bad;
+  }
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
   initlock(&pi->lock, "pipe");
+  initsleeplock(&pi->wlock, "pipew");
+  initsleeplock(&pi->rlock, "piper");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -47,7 +85,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +106,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
@@ -76,28 +114,39 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m, r;
+  uint off;
   struct proc *pr = myproc();
 
+  acquiresleep(&pi->wlock);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
       release(&pi->lock);
+      releasesleep(&pi->wlock);
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      continue;
     }
+    // copy as much as fits in the free space of this page.
+    off = pi->nwrite % PIPESIZE;
+    m = min(n - i, pi->nread + PIPESIZE - pi->nwrite);
+    m = min(m, PGSIZE - off % PGSIZE);
+    release(&pi->lock);
+    r = copyin(pr->pagetable, pi->data[off / PGSIZE] + off % PGSIZE, addr + i, m);
+    acquire(&pi->lock);
+    if(r == -1)
+      break;
+    pi->nwrite += m;
+    i += m;
+    wakeup(&pi->nread);
   }
   wakeup(&pi->nread);
   release(&pi->lock);
+  releasesleep(&pi->wlock);
 
   return i;
 }
@@ -105,26 +154,35 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i = 0, m, r;
+  uint off;
   struct proc *pr = myproc();
-  char ch;
 
+  acquiresleep(&pi->rlock);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(killed(pr)){
       release(&pi->lock);
+      releasesleep(&pi->rlock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  while(i < n && pi->nread != pi->nwrite){  //DOC: piperead-copy
+    // copy as much as is buffered in this page.
+    off = pi->nread % PIPESIZE;
+    m = min(n - i, pi->nwrite - pi->nread);
+    m = min(m, PGSIZE - off % PGSIZE);
+    release(&pi->lock);
+    r = copyout(pr->pagetable, addr + i, pi->data[off / PGSIZE] + off % PGSIZE, m);
+    acquire(&pi->lock);
+    if(r == -1)
       break;
+    pi->nread += m;
+    i += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
+  releasesleep(&pi->rlock);
   return i;
 }
@@ -16,6 +16,7 @@
 #include "proc.h"
 
 volatile int panicked = 0;
+volatile int panicking = 0; // pa4: print synchronously, without locks
 
 // lock to avoid interleaving concurrent printf's.
 static struct {
@@ -163,6 +164,7 @@ void
 panic(char *s)
 {
   pr.locking = 0;
+  panicking = 1;
   printf("panic: ");
   printf("%s\n", s);
   panicked = 1; // freeze uart output from other CPUs
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "stat.h"
 
 struct cpu cpus[NCPU];
 
@@ -16,16 +17,224 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// pa4: multi-level feedback queue scheduling.
+//
+// Each CPU has a run queue with NPRIO levels of RUNNABLE
+// processes, so picking the next process is O(1) and only
+// locks that queue. A process starts at level 0 and gets
+// TIMESLICE(prio) ticks at a level, counted across sleeps,
+// before it moves down one. Every BOOSTTICKS ticks all
+// processes return to level 0, so CPU-bound ones can't
+// starve.
+//
+// A process that wakes up goes back on the queue of the CPU it
+// last ran on, whose caches and TLB may still hold its state,
+// unless that CPU is busy and another one it may use is idle.
+// p->affinity limits the CPUs a process is queued on and run
+// by (setaffinity()). A CPU whose queue is empty steals from
+// the busiest queue; an idle one that is given work is sent an
+// IPI to leave wfi.
+//
+// A process is on a run queue exactly when it is RUNNABLE;
+// makerunnable() puts it there and the scheduler takes it
+// off. p->lock is acquired before a queue's lock.
+
+#define TIMESLICE(prio) (1 << (prio))
+#define EPOCH() (ticks / BOOSTTICKS)
+#define ALLOWED(p, c) (((p)->affinity >> (c)) & 1)
+
+static uint64 cpuonline;  // bit c: CPU c has entered scheduler()
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;          // processes on the queue, read without the lock
+  uint epoch;     // boost period the levels are sorted for
+} runq[NCPU];
+
+// pa4: sleeping processes wait in a hash table of queues
+// keyed by channel, so wakeup() looks only at processes
+// sleeping on channels that hash alike. A process is on the
+// queue of p->chan exactly while it is SLEEPING. A queue's
+// lock is acquired before the p->lock of its processes.
+#define SQHASH(chan) ((((uint64)(chan)) >> 3) % NSLEEPQ)
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;   // chain through proc.sqnext
+} sleepq[NSLEEPQ];
+
+// remove p from sq. caller holds sq->lock.
+static void
+sleepq_unlink(struct sleepq *sq, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &sq->head; *pp; pp = &(*pp)->sqnext){
+    if(*pp == p){
+      *pp = p->sqnext;
+      p->sqnext = 0;
+      return;
+    }
+  }
+  panic("sleepq_unlink");
+}
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// put p, which has just become RUNNABLE, at the tail of its
+// level on CPU c's run queue. caller holds p->lock.
+static void
+runq_add(struct proc *p, int c)
+{
+  struct runq *rq = &runq[c];
+
+  if(p->epoch != EPOCH()){
+    p->epoch = EPOCH();
+    p->prio = 0;
+    p->slice = 0;
+  }
+  p->cpu = c;
+  p->rqnext = 0;
+  acquire(&rq->lock);
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+  rq->n++;
+  release(&rq->lock);
+
+  // an idle CPU would not look at its queue before its next
+  // interrupt.
+  if(c != cpuid() && cpus[c].idle)
+    *(uint32*)CLINT_MSIP(c) = 1;
+}
+
+// take the highest priority process that may run on CPU me
+// off CPU c's queue, or return 0 if there is none. the process
+// stays RUNNABLE; the caller must acquire its lock before
+// running it.
+static struct proc*
+runq_take(int c, int me)
+{
+  struct runq *rq = &runq[c];
+  struct proc *p = 0, *prev;
+
+  if(rq->n == 0)
+    return 0;
+  acquire(&rq->lock);
+  if(rq->epoch != EPOCH()){
+    // a boost period has passed: move every level to level 0.
+    rq->epoch = EPOCH();
+    for(int i = 1; i < NPRIO; i++){
+      if(rq->head[i] == 0)
+        continue;
+      if(rq->tail[0])
+        rq->tail[0]->rqnext = rq->head[i];
+      else
+        rq->head[0] = rq->head[i];
+      rq->tail[0] = rq->tail[i];
+      rq->head[i] = rq->tail[i] = 0;
+    }
+  }
+  for(int i = 0; i < NPRIO && p == 0; i++){
+    prev = 0;
+    for(p = rq->head[i]; p && !ALLOWED(p, me); p = p->rqnext)
+      prev = p;
+    if(p == 0)
+      continue;
+    if(prev)
+      prev->rqnext = p->rqnext;
+    else
+      rq->head[i] = p->rqnext;
+    if(rq->tail[i] == p)
+      rq->tail[i] = prev;
+    p->rqnext = 0;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// CPU me's queue is empty: take a process from the busiest
+// other queue, or from any other if none on that may run here.
+static struct proc*
+runq_steal(int me)
+{
+  struct proc *p;
+  int busiest = -1;
+
+  for(int i = 0; i < NCPU; i++){
+    if(i != me && runq[i].n > 0 && (busiest < 0 || runq[i].n > runq[busiest].n))
+      busiest = i;
+  }
+  if(busiest < 0)
+    return 0;
+  if((p = runq_take(busiest, me)) != 0)
+    return p;
+  for(int i = 1; i < NCPU; i++){
+    int c = (me + i) % NCPU;
+    if(c != busiest && (p = runq_take(c, me)) != 0)
+      return p;
+  }
+  return 0;
+}
+
+// mark p RUNNABLE and queue it on CPU c.
+// caller holds p->lock.
+static void
+makerunnable(struct proc *p, int c)
+{
+  p->state = RUNNABLE;
+  runq_add(p, c);
+}
+
+// the CPU with the fewest queued processes that p may use,
+// for new processes and those whose CPU is no longer allowed.
+static int
+leastloaded(struct proc *p)
+{
+  int me = cpuid();
+  int best = ALLOWED(p, me) ? me : -1;
+
+  for(int i = 0; i < NCPU; i++){
+    if(!ALLOWED(p, i) || !((cpuonline >> i) & 1))
+      continue;
+    if(best < 0 || runq[i].n < runq[best].n)
+      best = i;
+  }
+  return best < 0 ? me : best;
+}
+
+// the CPU to queue p on when it wakes up: the one it last ran
+// on, unless that is busy and another CPU p may use is idle.
+static int
+wakecpu(struct proc *p)
+{
+  int home = p->lastcpu;
+
+  if(home < 0 || !ALLOWED(p, home))
+    return leastloaded(p);
+  if(cpus[home].idle)
+    return home;
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].idle && ALLOWED(p, i))
+      return i;
+  }
+  return home;
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -50,6 +259,10 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
   initlock(&wait_lock, "wait_lock");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
@@ -124,6 +337,8 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->affinity = ~0L;
+  p->lastcpu = -1;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -161,6 +376,12 @@ freeproc(struct proc *p)
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  if(p->ring){
+    if(PA2PG(p->ring)->in_lru)
+      lru_remove(PA2PG(p->ring), 1);
+    kfree((void*)p->ring);
+  }
+  p->ring = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -168,6 +389,19 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfunc = 0;
+  p->ra_win = 0;
+  p->ra_next = 0;
+  p->prio = 0;
+  p->slice = 0;
+  p->minflt = 0;
+  p->majflt = 0;
+  p->rsslimit = 0;
+  p->rss = 0;
+  p->rsshand = 0;
+  p->wsrestore = 0;
+  p->wshead = 0;
+  p->oom = 0;
   p->state = UNUSED;
 }
 
@@ -202,6 +436,15 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // pa4: a ring set up before exec() stays.
+  if(p->ring && mappages(pagetable, RING, PGSIZE,
+                         (uint64)p->ring, PTE_R | PTE_W | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +455,15 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  pte_t *pte = walk(pagetable, RING, 0);
+  if(pte && (*pte & PTE_V)){
+    // the ring is never on the LRU, but never leave a stale
+    // entry pointing at this page table either.
+    struct page *pg = PA2PG(PTE2PA(*pte));
+    if(pg->in_lru)
+      lru_remove(pg, 1);
+    uvmunmap(pagetable, RING, 1, 0);  // freed by freeproc()
+  }
   uvmfree(pagetable, sz);
 }
 
@@ -249,7 +501,26 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  makerunnable(p, 0);
+
+  release(&p->lock);
+}
+
+// Start a kernel thread that runs fn() in a process slot of its own.
+// It has no user memory, never returns to user space, and
+// must never return from fn().
+void
+kthread_create(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread_create");
+
+  p->kfunc = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  makerunnable(p, leastloaded(p));
 
   release(&p->lock);
 }
@@ -264,9 +535,14 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // lazy: pages are allocated by vmfault() on first touch.
+    if(sz + n > RING)
       return -1;
-    }
+    // mmap() regions sit above the heap.
+    for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+      if(v->flags && v->start < sz + n)
+        return -1;
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -295,6 +571,13 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  np->rsslimit = np->rss = p->rsslimit;
+  np->affinity = p->affinity;
+  if(vmacopy(p->pagetable, np->pagetable, np->vma, p->vma) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -319,7 +602,52 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  makerunnable(np, leastloaded(np));
+  release(&np->lock);
+
+  return pid;
+}
+
+// pa4: create a child running path with arguments argv (kernel
+// strings), like fork() followed by exec() in the child but
+// without copying the parent's memory first. the child gets the
+// parent's open files, working directory and limits, as after
+// fork(). returns the child's pid, or -1.
+int
+spawn(char *path, char **argv)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->rsslimit = np->rss = p->rsslimit;
+  np->affinity = p->affinity;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  pid = np->pid;
+  // np is USED, so nothing runs it while exec sleeps.
+  release(&np->lock);
+
+  if((argc = execinto(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  makerunnable(np, leastloaded(np));
   release(&np->lock);
 
   return pid;
@@ -360,11 +688,19 @@ exit(int status)
     }
   }
 
+  vmaunmapall(p);
   begin_op();
   iput(p->cwd);
+  vmafree(p->vma);
   end_op();
   p->cwd = 0;
 
+  // give back user memory and swap slots now, not when the
+  // parent waits: an OOM victim must free them promptly.
+  if(p->pagetable)
+    uvmunmap(p->pagetable, 0, PGROUNDUP(p->sz)/PGSIZE, 1);
+  p->sz = 0;
+
   acquire(&wait_lock);
 
   // Give any children to init.
@@ -451,37 +787,60 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
 
   c->proc = 0;
+  __sync_fetch_and_or(&cpuonline, 1L << id);
   for(;;){
     // The most recent process to run may have had interrupts
     // turned off; enable them to avoid a deadlock if all
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
+    // take the next process from this CPU's queue, or
+    // steal one if it is empty.
+    p = runq_take(id, id);
+    if(p == 0 && (p = runq_steal(id)) != 0)
+      c->steals++;
+    if(p == 0) {
+      // nothing to run; stop running on this core until an
+      // interrupt. runq_add() sends one if it sees idle set
+      // after queueing; otherwise we see the queued process.
+      c->idle = 1;
+      __sync_synchronize();
+      if(runq[id].n == 0){
+        c->idles++;
+        idletimer();
+        asm volatile("wfi");
+        busytimer();
       }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      intr_on();
-      asm volatile("wfi");
+      c->idle = 0;
+      continue;
     }
+
+    // the CPU that queued p may still be switching away from
+    // it; p->lock is held until it is done.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    if(p->lastcpu >= 0 && p->lastcpu != id)
+      c->migrations++;
+    p->lastcpu = id;
+    c->switches++;
+    c->proc = p;
+    trace(TR_SWITCH, p->pid, 0);
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -518,11 +877,48 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  makerunnable(p, ALLOWED(p, cpuid()) ? cpuid() : leastloaded(p));
   sched();
   release(&p->lock);
 }
 
+// pa4: called on every timer interrupt taken while a process
+// runs. charge the tick to it, move it down a level once it
+// has used up its time slice there, and give up the CPU if it
+// did or if a higher priority process is waiting here.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq = &runq[cpuid()];
+  int waiting = 0;
+
+  acquire(&p->lock);
+  if(p->epoch != EPOCH()){
+    p->epoch = EPOCH();
+    p->prio = 0;
+    p->slice = 0;
+  }
+  if(++p->slice >= TIMESLICE(p->prio)){
+    if(p->prio < NPRIO - 1)
+      p->prio++;
+    p->slice = 0;
+    release(&p->lock);
+    yield();
+    return;
+  }
+  release(&p->lock);
+
+  if(rq->n > 0){
+    acquire(&rq->lock);
+    for(int i = 0; i < p->prio; i++)
+      waiting |= rq->head[i] != 0;
+    release(&rq->lock);
+  }
+  if(waiting)
+    yield();
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -547,32 +943,56 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfunc();
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq = &sleepq[SQHASH(chan)];
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Must acquire the sleep queue lock and p->lock in order
+  // to join the queue, change p->state and then call sched.
+  // Once we hold the queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the queue),
   // so it's okay to release lk.
 
-  acquire(&p->lock);  //DOC: sleeplock1
+  acquire(&sq->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sqnext = sq->head;
+  sq->head = p;
+  p->sleepstart = ticks;
+  release(&sq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
 
+  // pa4: its working set may have been evicted meanwhile.
+  if(ticks - p->sleepstart >= WS_SLEEP && p->wshead)
+    p->wsrestore = 1;
+
   // Reacquire original lock.
   release(&p->lock);
   acquire(lk);
@@ -583,16 +1003,52 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct proc *p, **pp;
+  struct sleepq *sq = &sleepq[SQHASH(chan)];
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+  acquire(&sq->lock);
+  for(pp = &sq->head; (p = *pp) != 0; ){
+    if(p->chan != chan){
+      pp = &p->sqnext;
+      continue;
+    }
+    *pp = p->sqnext;
+    p->sqnext = 0;
+    acquire(&p->lock);
+    makerunnable(p, wakecpu(p));
+    release(&p->lock);
+  }
+  release(&sq->lock);
+}
+
+// wake p, if it is process pid and sleeping, wherever it
+// sleeps. its sleep queue lock must be taken before p->lock,
+// so look at p->chan first and check that it didn't change.
+static void
+unsleep(struct proc *p, int pid)
+{
+  for(;;){
+    acquire(&p->lock);
+    if(p->pid != pid || p->state != SLEEPING){
       release(&p->lock);
+      return;
     }
+    void *chan = p->chan;
+    release(&p->lock);
+
+    struct sleepq *sq = &sleepq[SQHASH(chan)];
+    acquire(&sq->lock);
+    acquire(&p->lock);
+    if(p->pid == pid && p->state == SLEEPING && p->chan == chan){
+      // Wake process from sleep().
+      sleepq_unlink(sq, p);
+      makerunnable(p, wakecpu(p));
+      release(&p->lock);
+      release(&sq->lock);
+      return;
+    }
+    release(&p->lock);
+    release(&sq->lock);
   }
 }
 
@@ -608,11 +1064,8 @@ kill(int pid)
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
       release(&p->lock);
+      unsleep(p, pid);
       return 0;
     }
     release(&p->lock);
@@ -694,7 +1147,164 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %s prio %d", p->pid, state, p->name, p->prio);
     printf("\n");
   }
+  print_swap_stats();
+}
+
+// pa4: let process pid (the caller if 0) run only on the CPUs
+// in mask. if it is queued or running elsewhere, it moves the
+// next time it is queued; the caller moves right away. returns
+// -1 if there is no such process or mask has no started CPU.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p, *me = myproc();
+
+  if((mask & cpuonline) == 0)
+    return -1;
+  if(pid == 0)
+    pid = me->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED && p->state != ZOMBIE){
+      p->affinity = mask;
+      release(&p->lock);
+      if(p == me){
+        push_off();
+        int moved = !((mask >> cpuid()) & 1);
+        pop_off();
+        if(moved)
+          yield();
+      }
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// pa4: copy the scheduler counters of CPUs 0..n-1 to user
+// address addr. returns the number of CPUs.
+int
+cpustats(uint64 addr, int n)
+{
+  struct cpustat st;
+
+  if(n > NCPU)
+    n = NCPU;
+  for(int i = 0; i < n; i++){
+    st.switches = cpus[i].switches;
+    st.migrations = cpus[i].migrations;
+    st.steals = cpus[i].steals;
+    st.idles = cpus[i].idles;
+    st.timers = cpus[i].timers;
+    if(copyout(myproc()->pagetable, addr + i * sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NCPU;
+}
+
+// pa4: give the current process a batch syscall ring, mapped
+// at RING, the first time it asks. returns RING, or -1.
+uint64
+ringsetup(void)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+
+  if(sizeof(struct ring) > PGSIZE)
+    panic("ringsetup: ring too big");
+  if(p->ring == 0){
+    if((r = (struct ring*)kalloc()) == 0)
+      return -1;
+    memset(r, 0, PGSIZE);
+    if(mappages(p->pagetable, RING, PGSIZE, (uint64)r, PTE_R | PTE_W | PTE_U) < 0){
+      kfree((void*)r);
+      return -1;
+    }
+    p->ring = r;
+  }
+  return RING;
+}
+
+// pa4: memory ran out even after eviction. kill the process
+// using the most memory, resident and swapped pages counted, so
+// that the others can go on; while that victim is still dying,
+// wait for it instead of killing another. returns 1 if the
+// caller should retry, 0 if it is the victim itself.
+static int oompid;
+
+int
+oomkill(void)
+{
+  struct proc *me = myproc(), *p, *victim = 0;
+  uint64 worst = 0;
+  int dying = 0;
+  struct vmstat st;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED || p->state == ZOMBIE || p->pagetable == 0 ||
+       p->kfunc || p == initproc){
+      release(&p->lock);
+      continue;
+    }
+    if(p->killed && p->pid == oompid)
+      dying = 1;
+    memset(&st, 0, sizeof(st));
+    uvmstat(p->pagetable, &st);
+    if(!p->killed && st.rss + st.swapped > worst){
+      worst = st.rss + st.swapped;
+      victim = p;
+    }
+    release(&p->lock);
+  }
+
+  if(me->killed)
+    return 0;
+  if(!dying){
+    if(victim == 0 || victim == me){
+      printf("oom: killing pid %d (%s)\n", me->pid, me->name);
+      oompid = me->pid;
+      return 0;
+    }
+    printf("oom: killing pid %d (%s), %ld pages\n", victim->pid, victim->name, worst);
+    oompid = victim->pid;
+    kill(victim->pid);
+  }
+
+  // let the victim run and exit.
+  acquire(&tickslock);
+  tickwait(ticks + 1);
+  release(&tickslock);
+  return 1;
+}
+
+// pa4: fill in st for vmstat(): the system-wide counters, plus
+// those of process pid (the caller if pid is 0). holding p->lock
+// keeps p's page-table pages from being freed during the walk;
+// see ptfree() and exec(). returns -1 if there is no such process.
+int
+procvmstat(int pid, struct vmstat *st)
+{
+  struct proc *p;
+
+  vmstats(st);
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED && p->state != ZOMBIE && p->pagetable){
+      uvmstat(p->pagetable, st);
+      st->pminflt = p->minflt;
+      st->pmajflt = p->majflt;
+      st->prsslimit = p->rsslimit;
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
 }
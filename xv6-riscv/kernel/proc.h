@@ -24,6 +24,14 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  pagetable_t volatile upt;   // pa4: page table while in user mode, or 0
+  volatile uint tlbgen;       // pa4: traps from user mode, for tlb_flush()
+  volatile int idle;          // pa4: in scheduler() with nothing to run
+  uint64 switches;            // pa4: cpustat() counters, written by this CPU
+  uint64 migrations;
+  uint64 steals;
+  uint64 idles;
+  uint64 timers;              // timer interrupts taken
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,6 +87,19 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// pa4: a range of user memory whose pages are filled in on
+// first touch (see vmfault()): bytes [start, start+filesz)
+// from ip at off, and zeros up to end.
+struct vma {
+  uint64 start;        // page-aligned; unused if end is 0
+  uint64 end;
+  struct inode *ip;    // 0 for zero-filled memory
+  uint off;
+  uint filesz;
+  int perm;            // PTE_R, PTE_W, PTE_X, PTE_U
+  int flags;           // MAP_SHARED or MAP_PRIVATE if from mmap(), else 0
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -104,4 +125,37 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfunc)(void);         // Kernel thread body, if a kernel thread
+  struct vma vma[NVMA];        // Lazily filled memory
+  int ra_win;                  // Swap-in readahead window (pages)
+  uint64 ra_next;              // va where a sequential swap fault would land
+
+  // pa4: scheduling; p->lock must be held when using these.
+  int prio;                    // MLFQ level, 0 is highest
+  int slice;                   // ticks used at this level
+  uint epoch;                  // boost period prio was set in
+  int cpu;                     // run queue it was last put on
+  int lastcpu;                 // CPU it last ran on, -1 if none yet
+  uint64 affinity;             // bit c: may run on CPU c
+  struct proc *rqnext;         // run queue link
+
+  // pa4: the sleep queue lock of p->chan must be held when using this.
+  struct proc *sqnext;         // sleep queue link
+
+  // pa4: updated only by the process itself.
+  uint64 minflt;               // faults served without disk I/O
+  uint64 majflt;               // faults that read swap or a file
+  int rsslimit;                // resident pages allowed, 0 for no limit
+  int rss;                     // resident pages, recounted when over rsslimit
+  uint64 rsshand;              // va where local reclaim looks next
+  int wsrestore;               // slept long: prefetch wsva[] before user mode
+  uint sleepstart;             // ticks when it last went to sleep
+  int oom;                     // a kalloc() for it failed since usertrap() cleared this
+  int logres;                  // log blocks its FS call reserved in begin_opn()
+  int nofault;                 // copyin()/copyout() fail rather than fault (inode locked)
+  struct ring *ring;           // batch syscall ring mapped at RING, or 0
+
+  // pa4: written by evict() on any CPU, read by the process itself.
+  uint64 wsva[WS_PAGES];       // most recently evicted pages, a ring
+  uint wshead;                 // evictions recorded so far
 };
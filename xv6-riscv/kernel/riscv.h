@@ -97,6 +97,7 @@ w_sie(uint64 x)
 
 // Machine-mode Interrupt Enable
 #define MIE_STIE (1L << 5)  // supervisor timer
+#define MIE_MSIE (1L << 3)  // machine software (IPI)
 static inline uint64
 r_mie()
 {
@@ -111,6 +112,19 @@ w_mie(uint64 x)
   asm volatile("csrw mie, %0" : : "r" (x));
 }
 
+// Machine-mode interrupt vector
+static inline void 
+w_mtvec(uint64 x)
+{
+  asm volatile("csrw mtvec, %0" : : "r" (x));
+}
+
+static inline void 
+w_mscratch(uint64 x)
+{
+  asm volatile("csrw mscratch, %0" : : "r" (x));
+}
+
 // supervisor exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -346,17 +360,40 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries for one virtual address.
+static inline void
+sfence_vma_va(uint64 va)
+{
+  asm volatile("sfence.vma %0, zero" : : "r" (va));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
-// pa4: page control variables
+// pa4: page control variables.
+// clock 스캔이 보는 필드(링크, 플래그, PTE)를 앞에 모음. 플래그는
+// 서로 다른 락 아래에서 따로 쓰이므로 bitfield가 아니라 byte 하나씩
+struct rmap;
 struct page{
-	struct page *next;
-	struct page *prev;
+	uint next;  // LRU 리스트 링크: pages[]의 index
+	uint prev;
+	uchar in_lru;  // LRU 리스트에 있는지 여부
+	uchar active;  // 1이면 active 리스트, 0이면 inactive 리스트
+	uchar referenced;  // inactive에서 한 번 참조가 확인됨 (다음이면 승격)
+	uchar is_page_table;  // 1이면 page table 용도임
+	uchar readahead;  // readahead로 들어온 뒤 아직 참조 안 됨
+	uchar refill;  // VMA에서 채워진 페이지: 쓰이지 않았으면 내보낼 때 버리고 다시 채움
+	uchar super;  // 2MB superpage의 첫 frame: LRU에는 이 struct page만 올라감
+	uchar buddy;  // buddy allocator에 있는 free block의 첫 frame
+	uchar order;  // 그 block의 크기: 2^order 페이지
+	int refcnt;  // 이 페이지를 매핑한 PTE 수 (COW fork로 공유되면 >1)
+	pte_t *pte;  // (pagetable, vaddr)의 PTE: LRU가 매번 walk()하지 않게 캐시
+	struct rmap *rmap;  // (pagetable, vaddr) 외의 추가 매핑들
 	pagetable_t  pagetable;
 	char *vaddr;
-	int in_lru;  // LRU 리스트에 있는지 여부
-	int is_page_table;  // 1이면 page table 용도임
+	int swapslot;  // swap cache: 디스크에 같은 내용이 남아 있는 슬롯, 없으면 -1
+	uint fileoff;  // ip 안에서 이 페이지의 위치
+	struct inode *ip;  // MAP_SHARED 페이지: 내보낼 때 swap 대신 이 파일에 씀
 };
 
 
@@ -369,6 +406,11 @@ struct page{
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+// pa4: 2MB superpage, mapped by a level-1 leaf PTE
+#define SUPERPGSIZE (1L << 21)
+#define SUPERPGROUNDUP(sz)  (((sz)+SUPERPGSIZE-1) & ~(SUPERPGSIZE-1))
+#define SUPERPGROUNDDOWN(a) (((a)) & ~(SUPERPGSIZE-1))
+
 #define PTE_V (1L << 0)    // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
@@ -377,6 +419,10 @@ struct page{
 #define PTE_A (1L << 6)    // accessed
 #define PTE_D (1L << 7)    // dirty
 #define PTE_SWAP (1L << 8) // 1 -> page is swapped out
+#define PTE_COW  (1L << 9) // 1 -> copy-on-write page, writable once copied
+// pa4: PTE_V가 꺼진 PTE에서만 씀 (그때 하드웨어는 예약 비트를 보지 않음).
+// evict()가 페이지를 내보내는 중이니 끝날 때까지 기다림
+#define PTE_EVICT (1L << 54)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -385,9 +431,14 @@ struct page{
 
 // PTE에서 페이지 번호 추출 (스왑 블록 번호로 사용)
 #define PTE2PPN(pte) ((pte) >> 10)
+// 스왑 블록 번호를 PTE의 PPN 자리에 넣기 (PTE2PPN의 역)
+#define PPN2PTE(blkno) (((uint64)(blkno)) << 10)
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// PTE_EVICT인 PTE가 가리키던 물리 주소
+#define EVICT2PA(pte) PTE2PA((pte) & ~PTE_EVICT)
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
@@ -0,0 +1,266 @@
+// Slab allocator for small kernel objects.
+//
+// A cache hands out objects of one size, carved out of pages
+// from kalloc(). Each page, a slab, starts with a struct slab
+// and holds as many objects as fit after it. A free object's
+// first word links it into its slab's free list, and
+// kmem_cache_free() finds the slab of an object by rounding
+// its address down to the page. A slab whose objects are all
+// free goes back to kfree(), except the last one of a cache.
+//
+// In front of the slabs every CPU keeps a magazine, a small
+// stack of free objects that it pushes and pops with
+// interrupts off and no lock. Only an empty magazine on alloc,
+// or a full one on free, takes the cache lock, and then moves
+// half a magazine at a time.
+//
+// kmem_cache_alloc() may call kalloc(), which may evict and
+// so sleep; do not call it holding a spinlock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "stat.h"
+
+#define NCACHE  16   // caches in the system
+#define MAGSIZE 16   // objects per CPU magazine
+
+struct slab {
+  struct slab *next;        // partial list
+  struct slab *prev;
+  struct kmem_cache *cache;
+  void *free;               // free objects in this slab
+  int inuse;                // objects out of it, magazines included
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;                // object size, a multiple of 8
+  int perslab;              // objects per slab
+  struct slab *partial;     // slabs with free objects
+  int nslab;                // slabs allocated
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache cache[NCACHE];
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// make a cache of size-byte objects. caches are never destroyed.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 7) & ~7;
+  if(size == 0 || size > PGSIZE - SLABHDR)
+    panic("kmem_cache_create: size");
+  acquire(&slabs.lock);
+  if(slabs.n == NCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, "slab");
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  return c;
+}
+
+// caller holds c->lock.
+static void
+slab_link(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+slab_unlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// take an object from the partial slabs, or return 0.
+// caller holds c->lock.
+static void*
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s = c->partial;
+  void *o;
+
+  if(s == 0)
+    return 0;
+  o = s->free;
+  s->free = *(void**)o;
+  s->inuse++;
+  if(s->free == 0)
+    slab_unlink(c, s);
+  return o;
+}
+
+// give object o back to its slab. caller holds c->lock.
+static void
+slab_put(struct kmem_cache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+
+  if(s->cache != c || s->inuse <= 0)
+    panic("kmem_cache_free");
+  if(s->free == 0)
+    slab_link(c, s);
+  *(void**)o = s->free;
+  s->free = o;
+  if(--s->inuse == 0 && (s->prev || s->next)){
+    slab_unlink(c, s);
+    c->nslab--;
+    kfree((void*)s);
+  }
+}
+
+// a new slab, all objects free, not yet on c's lists.
+static struct slab*
+slab_new(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  o = (char*)s + SLABHDR;
+  for(int i = c->perslab - 1; i >= 0; i--){
+    *(void**)(o + i * c->size) = s->free;
+    s->free = o + i * c->size;
+  }
+  return s;
+}
+
+// return n objects in batch to the slabs.
+static void
+slab_putn(struct kmem_cache *c, void **batch, int n)
+{
+  acquire(&c->lock);
+  for(int i = 0; i < n; i++)
+    slab_put(c, batch[i]);
+  release(&c->lock);
+}
+
+// allocate an object from cache c, or return 0 if out of
+// memory. its contents are undefined.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  struct slab *s;
+  void *o, *batch[MAGSIZE/2];
+  int n = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n > 0){
+    o = m->obj[--m->n];
+    pop_off();
+    return o;
+  }
+  pop_off();
+
+  // the magazine is empty: take one object, growing the cache
+  // if need be, and refill with what the slabs have to spare.
+  acquire(&c->lock);
+  while((o = slab_get(c)) == 0){
+    release(&c->lock);
+    if((s = slab_new(c)) == 0)
+      return 0;
+    acquire(&c->lock);
+    slab_link(c, s);
+    c->nslab++;
+  }
+  while(n < MAGSIZE/2 && (batch[n] = slab_get(c)) != 0)
+    n++;
+  release(&c->lock);
+
+  // we may be on another CPU by now, whose magazine may be full.
+  push_off();
+  m = &c->mag[cpuid()];
+  while(n > 0 && m->n < MAGSIZE)
+    m->obj[m->n++] = batch[--n];
+  pop_off();
+  if(n > 0)
+    slab_putn(c, batch, n);
+  return o;
+}
+
+// free object o, which came from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  struct magazine *m;
+  void *batch[MAGSIZE/2];
+  int n = 0;
+
+  if(((uint64)o % PGSIZE) < SLABHDR || (uint64)o < KERNBASE || (uint64)o >= PHYSTOP)
+    panic("kmem_cache_free");
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    // full: hand the older half back to the slabs.
+    for(; n < MAGSIZE/2; n++)
+      batch[n] = m->obj[n];
+    for(int i = n; i < MAGSIZE; i++)
+      m->obj[i - n] = m->obj[i];
+    m->n -= n;
+  }
+  m->obj[m->n++] = o;
+  pop_off();
+  if(n > 0)
+    slab_putn(c, batch, n);
+}
+
+// fill the slab counter of vmstat().
+void
+slabstats(struct vmstat *st)
+{
+  int n;
+
+  st->slabpages = 0;
+  acquire(&slabs.lock);
+  n = slabs.n;
+  release(&slabs.lock);
+  for(int i = 0; i < n; i++){
+    acquire(&slabs.cache[i].lock);
+    st->slabpages += slabs.cache[i].nslab;
+    release(&slabs.cache[i].lock);
+  }
+}
@@ -7,12 +7,52 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "stat.h"
+
+// pa4: contention statistics, per lock name ("class"): all the
+// proc locks count as one "proc" row, and so on. each CPU has its
+// own row for every class, written only by that CPU, so the
+// accounting adds no shared cache-line traffic. class 0 collects
+// locks that were never initlock()ed and names past NLOCKCLASS.
+static char *classname[NLOCKCLASS] = { "other" };
+static int nclass = 1;
+static uint classlock;   // a raw spin: initlock() can't acquire()
+
+static struct {
+  uint64 acquires;
+  uint64 contended;
+  uint64 spins;
+} lstats[NCPU][NLOCKCLASS];
+
+static int
+lockclass(char *name)
+{
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  for(i = 1; i < nclass; i++)
+    if(strncmp(classname[i], name, LOCKNAME) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS)
+      classname[nclass++] = name;
+    else
+      i = 0;
+  }
+  __sync_lock_release(&classlock);
+  pop_off();
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->class = lockclass(name);
   lk->cpu = 0;
 }
 
@@ -25,12 +65,18 @@ acquire(struct spinlock *lk)
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // pa4: take a ticket (amoadd.w) and wait for our turn. the
+  // waiting is only loads of owner, which stay in this CPU's
+  // cache until the holder's release() writes it.
+  uint t = __sync_fetch_and_add(&lk->next, 1);
+  uint64 spin = 0;
+  int waited = lk->owner != t;
+  if(waited){
+    uint64 t0 = r_time();
+    while(lk->owner != t)
+      ;
+    spin = r_time() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +86,14 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  // interrupts are off: this CPU's row is ours.
+  int c = cpuid();
+  lstats[c][lk->class].acquires++;
+  if(waited){
+    lstats[c][lk->class].contended++;
+    lstats[c][lk->class].spins += spin;
+  }
 }
 
 // Release the lock.
@@ -59,14 +113,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Let the next ticket in. Only the holder writes owner, so
+  // this need not be atomic, but it must be a single store:
+  // owner is a volatile aligned word, which RISC-V writes with
+  // one sw instruction.
+  lk->owner = lk->owner + 1;
 
   pop_off();
 }
@@ -77,7 +128,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
   return r;
 }
 
@@ -108,3 +159,26 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// pa4: copy the statistics of lock classes 0..n-1, summed over
+// CPUs, to user address addr. returns the number of classes.
+int
+lockstats(uint64 addr, int n)
+{
+  struct lockstat st;
+
+  if(n > nclass)
+    n = nclass;
+  for(int i = 0; i < n; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, classname[i], sizeof(st.name));
+    for(int c = 0; c < NCPU; c++){
+      st.acquires += lstats[c][i].acquires;
+      st.contended += lstats[c][i].contended;
+      st.spins += lstats[c][i].spins;
+    }
+    if(copyout(myproc()->pagetable, addr + i * sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return nclass;
+}
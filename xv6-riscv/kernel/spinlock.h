@@ -1,9 +1,13 @@
 // Mutual exclusion lock.
+// pa4: a ticket lock. acquire() takes the next ticket and waits
+// until owner reaches it, so waiters get the lock in FIFO order
+// and spin on a read instead of each doing atomic swaps.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;           // next ticket to hand out
+  volatile uint owner; // ticket allowed in; held if next != owner
+  ushort class;        // index of its name in the lock statistics
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
 };
-
@@ -6,10 +6,14 @@
 
 void main();
 void timerinit();
+void ipiinit();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
+// scratch area for ipivec in kernelvec.S, one per CPU.
+uint64 ipi_scratch[NCPU][2];
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -40,6 +44,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // take TLB shootdown IPIs from other harts.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -64,3 +71,16 @@ timerinit()
   // ask for the very first timer interrupt.
   w_stimecmp(r_time() + 1000000);
 }
+
+// pa4: let other harts interrupt this one through its CLINT
+// msip. ipivec forwards the interrupt to supervisor mode.
+void
+ipiinit()
+{
+  extern void ipivec();
+  int id = r_mhartid();
+
+  w_mscratch((uint64)&ipi_scratch[id][0]);
+  w_mtvec((uint64)ipivec);
+  w_mie(r_mie() | MIE_MSIE);
+}
@@ -9,3 +9,141 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// pa4: logging layer counters, filled in by fsstat().
+struct fsstat {
+  uint64 commits;     // log commits
+  uint64 trans;       // FS system calls (begin_op/end_op) committed
+  uint64 logblocks;   // blocks written to the log
+  uint64 datablocks;  // file blocks written in place, bypassing it
+  uint64 maxtrans;    // most system calls folded into one commit
+  uint64 grouped;     // commits that waited for others to join
+  uint64 rablocks;    // blocks read ahead by readi()
+  uint64 rahits;      // read-ahead blocks later found by bread()
+  uint64 bmisses;     // bread()s that had to wait for the disk
+  uint64 breads;      // bread()s in all
+};
+
+// pa4: paging counters, filled in by vmstat(). the first part
+// is system-wide, the last part is about one process.
+struct vmstat {
+  uint64 freepages;   // free physical pages
+  uint64 lrupages;    // user pages on the LRU lists
+  uint64 activepages; // of which on the active list
+  uint64 swapused;    // swap slots in use
+  uint64 swapslots;   // swap slots in all swap areas
+  uint64 minflt;      // faults served without disk I/O
+  uint64 majflt;      // faults that read swap or a file
+  uint64 swapins;     // pages read from swap, readahead included
+  uint64 swapouts;    // pages evicted to swap
+  uint64 swapra;      // pages read ahead from swap
+  uint64 swaprahits;  // of which used before eviction
+  uint64 cleanevicts; // evictions that reused a swap cache slot
+  uint64 refilldrops; // unwritten VMA pages dropped
+  uint64 zerodrops;   // all-zero victims replaced by the zero page
+  uint64 mmapwrites;  // MAP_SHARED pages written back on eviction
+  uint64 scans;       // victim searches
+  uint64 scanned;     // LRU pages looked at by them
+  uint64 superpages;  // 2MB superpages mapped
+  uint64 ptreclaims;  // empty page-table pages freed
+  uint64 zswapped;    // swap slots held compressed in memory
+  uint64 zpoolpages;  // pages holding them
+  uint64 zloads;      // swap-ins served from them
+  uint64 wsprefetch;  // pages read back for processes waking up
+  uint64 slabpages;   // pages held by kernel object caches
+
+  uint64 rss;         // resident pages of the process
+  uint64 swapped;     // its pages in swap
+  uint64 pminflt;     // its minor faults
+  uint64 pmajflt;     // its major faults
+  uint64 prsslimit;   // its resident page limit, 0 for none
+};
+
+// pa4: memory pressure levels, returned by mempressure().
+#define MP_NONE     0   // plenty of free pages
+#define MP_LOW      1   // below kswapd's high watermark
+#define MP_MEDIUM   2   // below its low watermark: kswapd is evicting
+#define MP_CRITICAL 3   // kalloc() had to evict in the last MP_HOLD ticks
+
+// pa4: one event of the kernel trace ring, read by ktrace().
+#define TR_FAULT   1   // page fault: a0 = va, a1 = scause
+#define TR_EVICT   2   // page evicted: a0 = va, a1 = swap slot
+#define TR_SWAPIN  3   // swap-in: a0 = va, a1 = pages read
+#define TR_BMISS   4   // buffer cache miss: a0 = dev, a1 = blockno
+#define TR_DSUBMIT 5   // virtio request: a0 = dev, a1 = sector
+#define TR_DDONE   6   // virtio completion: a0 = dev, a1 = sector
+#define TR_SWITCH  7   // scheduler switched to pid
+
+struct traceent {
+  uint64 time;        // r_time() when it happened
+  uint64 a0, a1;
+  ushort event;       // TR_*
+  ushort cpu;
+  int pid;            // running process, 0 if none
+};
+
+// pa4: one system call's counters, filled in by scstat().
+// hist[b] counts calls that took [2^b, 2^(b+1)) time ticks.
+#define NSCHIST 24
+struct scstat {
+  uint64 count;       // calls
+  uint64 time;        // time ticks spent in them
+  uint64 hist[NSCHIST];
+};
+
+// pa4: one lock class's counters, filled in by lockstat().
+// locks with the same name are one class.
+struct lockstat {
+  char name[16];
+  uint64 acquires;    // acquire() calls
+  uint64 contended;   // of which had to wait
+  uint64 spins;       // time ticks spent waiting
+};
+
+// pa4: one CPU's scheduler counters, filled in by cpustat().
+struct cpustat {
+  uint64 switches;    // processes switched to
+  uint64 migrations;  // of which had last run on another CPU
+  uint64 steals;      // taken from another CPU's queue
+  uint64 idles;       // waits in wfi with nothing to run
+  uint64 timers;      // timer interrupts taken
+};
+
+// pa4: one buffer of readv()/writev().
+struct iovec {
+  void *base;
+  uint len;
+};
+
+// pa4: batch system calls. ringsetup() maps a struct ring into
+// the process. it puts calls in sq[], advances sqtail, and one
+// ringenter() runs them in order, posting each result in cq[]
+// and advancing cqtail. the process reaps results by advancing
+// cqhead. indices run freely and are taken mod NRING.
+#define NRING 32
+
+struct ringsqe {
+  int num;            // system call number
+  int pad;
+  uint64 arg[6];
+  uint64 tag;         // handed back in the completion
+};
+
+struct ringcqe {
+  uint64 tag;
+  uint64 res;         // what the call returned
+};
+
+struct ring {
+  uint sqhead;        // next call to run, moved by the kernel
+  uint sqtail;        // end of queued calls, moved by the process
+  uint cqhead;        // next result to reap, moved by the process
+  uint cqtail;        // end of results, moved by the kernel
+  struct ringsqe sq[NRING];
+  struct ringcqe cq[NRING];
+};
+
+// ktrace() commands
+#define KTRACE_OFF  0   // stop recording
+#define KTRACE_ON   1   // discard what is recorded and start
+#define KTRACE_READ 2   // copy out and consume recorded events
@@ -1,13 +1,39 @@
 #include "types.h"
 
+// pa4: memset, memcmp and memmove go a word at a time once the
+// pointers are 8-byte aligned (for two pointers, only if they
+// are aligned alike: misaligned loads and stores may trap and
+// be emulated, which is far slower than bytes). whole pages,
+// as in kalloc(), kfree() and uvmcopy(), take the word path.
+
+#define WORD     sizeof(uint64)
+#define ALIGNED(p) (((uint64)(p) & (WORD - 1)) == 0)
+
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint i = 0;
+
+  if(n >= 2*WORD){
+    uint64 w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    for(; !ALIGNED(cdst + i); i++)
+      cdst[i] = c;
+    for(; i + 4*WORD <= n; i += 4*WORD){
+      uint64 *p = (uint64*)(cdst + i);
+      p[0] = w;
+      p[1] = w;
+      p[2] = w;
+      p[3] = w;
+    }
+    for(; i + WORD <= n; i += WORD)
+      *(uint64*)(cdst + i) = w;
   }
+  for(; i < n; i++)
+    cdst[i] = c;
   return dst;
 }
 
@@ -18,6 +44,14 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if(n >= 2*WORD && ALIGNED((uint64)s1 ^ (uint64)s2)){
+    for(; !ALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the bytes below find the difference.
+    for(; n >= WORD && *(uint64*)s1 == *(uint64*)s2; n -= WORD)
+      s1 += WORD, s2 += WORD;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -38,14 +72,44 @@ memmove(void *dst, const void *src, uint n)
   
   s = src;
   d = dst;
+  int words = n >= 2*WORD && ALIGNED((uint64)s ^ (uint64)d);
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(words){
+      for(; !ALIGNED(d); n--)
+        *--d = *--s;
+      for(; n >= WORD; n -= WORD){
+        d -= WORD;
+        s -= WORD;
+        *(uint64*)d = *(uint64*)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(words){
+      for(; !ALIGNED(d); n--)
+        *d++ = *s++;
+      for(; n >= 4*WORD; n -= 4*WORD){
+        uint64 *dw = (uint64*)d;
+        const uint64 *sw = (const uint64*)s;
+        dw[0] = sw[0];
+        dw[1] = sw[1];
+        dw[2] = sw[2];
+        dw[3] = sw[3];
+        d += 4*WORD;
+        s += 4*WORD;
+      }
+      for(; n >= WORD; n -= WORD){
+        *(uint64*)d = *(const uint64*)s;
+        d += WORD;
+        s += WORD;
+      }
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
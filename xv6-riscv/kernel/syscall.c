@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "stat.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -105,6 +106,25 @@ extern uint64 sys_close(void);
 extern uint64 sys_swapread(void);
 extern uint64 sys_swapwrite(void);
 extern uint64 sys_swapstat(void);
+extern uint64 sys_fsstat(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_vmstat(void);
+extern uint64 sys_rsslimit(void);
+extern uint64 sys_ktrace(void);
+extern uint64 sys_scstat(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_ringsetup(void);
+extern uint64 sys_ringenter(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_mempressure(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -133,8 +153,133 @@ static uint64 (*syscalls[])(void) = {
 [SYS_swapread]	sys_swapread,
 [SYS_swapwrite] sys_swapwrite,
 [SYS_swapstat] sys_swapstat,
+[SYS_fsstat]   sys_fsstat,
+[SYS_mmap]     sys_mmap,
+[SYS_munmap]   sys_munmap,
+[SYS_vmstat]   sys_vmstat,
+[SYS_rsslimit] sys_rsslimit,
+[SYS_ktrace]   sys_ktrace,
+[SYS_scstat]   sys_scstat,
+[SYS_lockstat] sys_lockstat,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_cpustat] sys_cpustat,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_spawn]   sys_spawn,
+[SYS_madvise] sys_madvise,
+[SYS_mempressure] sys_mempressure,
 };
 
+// pa4: per-CPU call counts and latency histograms, so that
+// accounting a call never touches another CPU's cache lines.
+// only the owning CPU writes its row, with interrupts off.
+static struct scstat scstats[NCPU][NELEM(syscalls)];
+
+// account a call to num that took dt time CSR ticks.
+static void
+scaccount(int num, uint64 dt)
+{
+  int b = 0;
+
+  while(b < NSCHIST - 1 && (dt >> (b + 1)))
+    b++;
+  push_off();
+  struct scstat *s = &scstats[cpuid()][num];
+  s->count++;
+  s->time += dt;
+  s->hist[b]++;
+  pop_off();
+}
+
+// copy the counters of syscalls 0..n-1, summed over CPUs, to
+// user address addr. returns the number of syscall slots.
+int
+syscallstats(uint64 addr, int n)
+{
+  struct scstat s;
+
+  if(n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for(int num = 0; num < n; num++){
+    memset(&s, 0, sizeof(s));
+    for(int c = 0; c < NCPU; c++){
+      s.count += scstats[c][num].count;
+      s.time += scstats[c][num].time;
+      for(int b = 0; b < NSCHIST; b++)
+        s.hist[b] += scstats[c][num].hist[b];
+    }
+    if(copyout(myproc()->pagetable, addr + num * sizeof(s), (char*)&s, sizeof(s)) < 0)
+      return -1;
+  }
+  return NELEM(syscalls);
+}
+
+// pa4: the calls a ring may hold. they neither leave nor
+// replace the process, nor change its address space.
+static char ringok[NELEM(syscalls)] = {
+[SYS_pipe] 1, [SYS_read] 1, [SYS_fstat] 1, [SYS_chdir] 1,
+[SYS_dup] 1, [SYS_getpid] 1, [SYS_uptime] 1, [SYS_open] 1,
+[SYS_write] 1, [SYS_mknod] 1, [SYS_unlink] 1, [SYS_link] 1,
+[SYS_mkdir] 1, [SYS_close] 1, [SYS_swapstat] 1, [SYS_fsstat] 1,
+[SYS_vmstat] 1, [SYS_scstat] 1, [SYS_lockstat] 1, [SYS_cpustat] 1,
+[SYS_readv] 1, [SYS_writev] 1, [SYS_pread] 1, [SYS_pwrite] 1,
+[SYS_madvise] 1, [SYS_mempressure] 1,
+};
+
+// pa4: run up to n calls queued in the process's ring, as if
+// it had trapped for each with its arguments in a0-a5. stops
+// early when the queue is empty, the completion queue is full,
+// or the process is killed. returns how many ran, or -1 if
+// there is no ring or its indices are garbage.
+int
+ringrun(int n)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct trapframe *tf = p->trapframe;
+  struct ringsqe sqe;
+  uint64 save[7];
+  int done = 0;
+
+  if(r == 0)
+    return -1;
+  uint head = r->sqhead, tail = r->sqtail;
+  if(tail - head > NRING)
+    return -1;
+
+  save[0] = tf->a0; save[1] = tf->a1; save[2] = tf->a2;
+  save[3] = tf->a3; save[4] = tf->a4; save[5] = tf->a5;
+  save[6] = tf->a7;
+  while(done < n && head != tail && r->cqtail - r->cqhead < NRING && !killed(p)){
+    // the process can write the ring at any time; use a copy.
+    sqe = r->sq[head % NRING];
+    uint64 res = -1;
+    if(sqe.num > 0 && sqe.num < NELEM(syscalls) && ringok[sqe.num]){
+      tf->a0 = sqe.arg[0]; tf->a1 = sqe.arg[1]; tf->a2 = sqe.arg[2];
+      tf->a3 = sqe.arg[3]; tf->a4 = sqe.arg[4]; tf->a5 = sqe.arg[5];
+      tf->a7 = sqe.num;
+      uint64 t0 = r_time();
+      res = syscalls[sqe.num]();
+      scaccount(sqe.num, r_time() - t0);
+    }
+    struct ringcqe *c = &r->cq[r->cqtail % NRING];
+    c->tag = sqe.tag;
+    c->res = res;
+    __sync_synchronize();
+    r->cqtail++;
+    r->sqhead = ++head;
+    done++;
+  }
+  tf->a0 = save[0]; tf->a1 = save[1]; tf->a2 = save[2];
+  tf->a3 = save[3]; tf->a4 = save[4]; tf->a5 = save[5];
+  tf->a7 = save[6];
+  return done;
+}
+
 void
 syscall(void)
 {
@@ -145,7 +290,9 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    uint64 t0 = r_time();
     p->trapframe->a0 = syscalls[num]();
+    scaccount(num, r_time() - t0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -23,3 +23,22 @@
 #define SYS_swapread	22
 #define SYS_swapwrite	23
 #define SYS_swapstat	24
+#define SYS_fsstat	25
+#define SYS_mmap	26
+#define SYS_munmap	27
+#define SYS_vmstat	28
+#define SYS_rsslimit	29
+#define SYS_ktrace	30
+#define SYS_scstat	31
+#define SYS_lockstat	32
+#define SYS_setaffinity	33
+#define SYS_cpustat	34
+#define SYS_readv	35
+#define SYS_writev	36
+#define SYS_pread	37
+#define SYS_pwrite	38
+#define SYS_ringsetup	39
+#define SYS_ringenter	40
+#define SYS_spawn	41
+#define SYS_madvise	42
+#define SYS_mempressure	43
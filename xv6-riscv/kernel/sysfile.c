@@ -94,6 +94,95 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// pa4: move the iovcnt buffers of the iovec array at user
+// address uiov, in order, through fileread() or filewrite().
+// stops at the first short transfer; returns the bytes moved.
+static int
+filerw(struct file *f, uint64 uiov, int iovcnt, int write)
+{
+  struct iovec iov[NIOV];
+  int tot = 0, r;
+
+  if(iovcnt < 0 || iovcnt > NIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, iovcnt * sizeof(iov[0])) < 0)
+    return -1;
+  for(int i = 0; i < iovcnt; i++){
+    if((int)iov[i].len < 0)
+      return -1;
+    if(write)
+      r = filewrite(f, (uint64)iov[i].base, iov[i].len);
+    else
+      r = fileread(f, (uint64)iov[i].base, iov[i].len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  return tot;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  int n;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filerw(f, p, n, 0);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  int n;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filerw(f, p, n, 1);
+}
+
+// pa4: read or write at an offset, without using or moving
+// the file's own offset.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
 uint64
 sys_close(void)
 {
@@ -176,10 +265,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  // pa4: in a hashed directory "." and ".." can be anywhere.
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -222,6 +312,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_remove(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -431,24 +522,26 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// fetch the path and argv[] of exec() or spawn() into path and
+// argv, copying the argument strings into pages from kalloc().
+// the caller frees them with freeargv(), also on failure.
+static int
+fetchargv(char *path, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
   uint64 uargv, uarg;
 
   argaddr(1, &uargv);
+  memset(argv, 0, MAXARG * sizeof(char*));
   if(argstr(0, path, MAXPATH) < 0) {
     return -1;
   }
-  memset(argv, 0, sizeof(argv));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
@@ -456,22 +549,43 @@ sys_exec(void)
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+  return 0;
+}
 
-  int ret = exec(path, argv);
-
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int ret = -1;
 
+  if(fetchargv(path, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// pa4: start a child running path, without fork()ing first.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int ret = -1;
+
+  if(fetchargv(path, argv) == 0)
+    ret = spawn(path, argv);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -505,17 +619,30 @@ sys_pipe(void)
 }
 
 // pa4: swap functions sysfile
+// swapread()/swapwrite() move whole physical pages, so the
+// system calls bounce the user buffer through a kernel page.
 uint64 
 sys_swapread(void)
 {
     uint64 ptr;
     int blkno;
+    char *mem;
+    int dev;
 
     argaddr(0, &ptr);
     argint(1, &blkno);
 
-    swapread(ptr, blkno);
-    return 0;  // swapread는 void이므로 성공 시 0 반환
+    if (swapblock(blkno, &dev) < 0)
+      return -1;
+    if ((mem = kalloc()) == 0)
+      return -1;
+    swapread((uint64)mem, blkno);
+    if (copyout(myproc()->pagetable, ptr, mem, PGSIZE) < 0) {
+      kfree(mem);
+      return -1;
+    }
+    kfree(mem);
+    return 0;
 }
 
 uint64 
@@ -523,12 +650,23 @@ sys_swapwrite(void)
 {
     uint64 ptr;
     int blkno;
+    char *mem;
+    int dev;
 
     argaddr(0, &ptr);
     argint(1, &blkno);
 
-    swapwrite(ptr, blkno);
-    return 0;  // swapwrite도 마찬가지로 0 반환
+    if (swapblock(blkno, &dev) < 0)
+      return -1;
+    if ((mem = kalloc()) == 0)
+      return -1;
+    if (copyin(myproc()->pagetable, mem, ptr, PGSIZE) < 0) {
+      kfree(mem);
+      return -1;
+    }
+    swapwrite((uint64)mem, blkno);
+    kfree(mem);
+    return 0;
 }
 
 uint64
@@ -546,4 +684,97 @@ sys_swapstat(void)
     return -1;
 
   return 0;
-}
\ No newline at end of file
+}
+
+// pa4: copy the logging layer's and buffer cache's counters
+// to the user struct fsstat.
+uint64
+sys_fsstat(void)
+{
+  uint64 addr;
+  struct fsstat st;
+
+  argaddr(0, &addr);
+  logstat(&st);
+  bstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// pa4: map len bytes of the file open on fd, starting at the
+// page-aligned offset off. pages are read in on first touch.
+// stores to a MAP_SHARED mapping go back to the file on munmap(),
+// exit(), or when the page is evicted; MAP_PRIVATE ones never do.
+// there is no page cache, so read() and write() only see what has
+// been written back.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags, off;
+  struct file *f;
+  struct vma v;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  if(argfd(4, 0, &f) < 0)
+    return -1;
+  argint(5, &off);
+
+  if(f->type != FD_INODE || !f->readable || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(len == 0 || (prot & (PROT_READ|PROT_WRITE|PROT_EXEC)) == 0)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+
+  memset(&v, 0, sizeof(v));
+  v.ip = f->ip;
+  v.off = off;
+  v.flags = flags;
+  v.perm = PTE_U;
+  if(prot & (PROT_READ|PROT_WRITE))
+    v.perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    v.perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    v.perm |= PTE_X;
+  ilock(f->ip);
+  if(f->ip->type != T_FILE){
+    iunlock(f->ip);
+    return -1;
+  }
+  if(off < f->ip->size)
+    v.filesz = f->ip->size - off < len ? f->ip->size - off : len;
+  iunlock(f->ip);
+  return vmamap(myproc(), addr, len, &v);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return vmaunmap(myproc(), addr, len);
+}
+
+// pa4: madvise(addr, len, advice): a hint about how the pages
+// of a heap or mmap() range will be used. see vmadvise().
+uint64
+sys_madvise(void)
+{
+  uint64 addr, len;
+  int advice;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &advice);
+  return vmadvise(myproc(), addr, len, advice);
+}
@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "stat.h"
 
 uint64
 sys_exit(void)
@@ -64,7 +65,7 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    tickwait(ticks0 + n);
   }
   release(&tickslock);
   return 0;
@@ -91,3 +92,147 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// pa4: copy the paging counters, and those of process pid
+// (0 for the caller), to the user struct vmstat.
+uint64
+sys_vmstat(void)
+{
+  int pid;
+  uint64 addr;
+  struct vmstat st;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  memset(&st, 0, sizeof(st));
+  if(procvmstat(pid, &st) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// pa4: limit the caller to npages resident pages (0 for no
+// limit). children inherit the limit. returns the old one.
+uint64
+sys_rsslimit(void)
+{
+  int n;
+  struct proc *p = myproc();
+
+  argint(0, &n);
+  if(n < 0)
+    return -1;
+  int old = p->rsslimit;
+  p->rsslimit = n;
+  p->rss = n;   // recounted at the next fault
+  return old;
+}
+
+// pa4: mempressure(level): wait until memory pressure is at
+// least level (MP_*), and return the current pressure.
+// level 0 returns at once, as a poll.
+uint64
+sys_mempressure(void)
+{
+  int level, cur;
+
+  argint(0, &level);
+  if(level < MP_NONE || level > MP_CRITICAL)
+    return -1;
+  acquire(&tickslock);
+  while((cur = mempressure()) < level){
+    if(killed(myproc())){
+      release(&tickslock);
+      return -1;
+    }
+    // kalloc() cannot wake us, so look again every tick.
+    tickwait(ticks + 1);
+  }
+  release(&tickslock);
+  return cur;
+}
+
+// pa4: control and read the kernel event trace.
+uint64
+sys_ktrace(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  argint(0, &cmd);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return ktrace(cmd, addr, n);
+}
+
+// pa4: copy out per-syscall counts and latency histograms.
+uint64
+sys_scstat(void)
+{
+  int n;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return syscallstats(addr, n);
+}
+
+// pa4: copy out per-lock-class contention counters.
+uint64
+sys_lockstat(void)
+{
+  int n;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return lockstats(addr, n);
+}
+
+// pa4: run process pid (the caller if 0) only on the CPUs
+// whose bits are set in mask.
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, (uint)mask);
+}
+
+// pa4: map the batch syscall ring; returns its address.
+uint64
+sys_ringsetup(void)
+{
+  return ringsetup();
+}
+
+// pa4: run up to n calls queued in the ring.
+uint64
+sys_ringenter(void)
+{
+  int n;
+
+  argint(0, &n);
+  return ringrun(n);
+}
+
+// pa4: copy out per-CPU scheduler counters.
+uint64
+sys_cpustat(void)
+{
+  int n;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return cpustats(addr, n);
+}
@@ -0,0 +1,111 @@
+// pa4: kernel event trace.
+//
+// trace() appends a fixed-size binary record to a ring owned
+// by the current CPU. it takes no lock and prints nothing, so it
+// is cheap enough for the paging, buffer cache, disk and
+// scheduler hot paths: only the owning CPU writes a ring, with
+// interrupts off, and it publishes an entry by advancing head
+// after filling it in. a reader copies [tail, head) and then
+// drops whatever the writer may have overwritten meanwhile.
+// each ring keeps the last NTRACE events.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "stat.h"
+
+struct tracering {
+  volatile uint head;   // events written
+  uint tail;            // events consumed by ktrace()
+  struct traceent ent[NTRACE];
+};
+
+static struct tracering rings[NCPU];
+static volatile int tracing;
+static struct spinlock tracelock;   // serializes readers
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+void
+trace(int event, uint64 a0, uint64 a1)
+{
+  if(!tracing)
+    return;
+  push_off();
+  int id = cpuid();
+  struct tracering *r = &rings[id];
+  struct traceent *e = &r->ent[r->head % NTRACE];
+  struct proc *p = mycpu()->proc;
+
+  e->time = r_time();
+  e->a0 = a0;
+  e->a1 = a1;
+  e->event = event;
+  e->cpu = id;
+  e->pid = p ? p->pid : 0;
+  __sync_synchronize();
+  r->head++;
+  pop_off();
+}
+
+// copy at most n events to user address addr and consume them,
+// one CPU's ring after the other. returns the number copied.
+static int
+traceread(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct traceent e;
+  int got = 0;
+
+  acquire(&tracelock);
+  for(int c = 0; c < NCPU && got < n; c++){
+    struct tracering *r = &rings[c];
+    uint head = r->head;
+    if(head - r->tail > NTRACE)
+      r->tail = head - NTRACE;    // older ones are overwritten
+    for(; r->tail != head && got < n; r->tail++){
+      e = r->ent[r->tail % NTRACE];
+      __sync_synchronize();
+      if(r->head - r->tail > NTRACE)
+        continue;                 // overwritten while we copied it
+      release(&tracelock);
+      if(copyout(p->pagetable, addr + got * sizeof(e), (char*)&e, sizeof(e)) < 0)
+        return -1;
+      acquire(&tracelock);
+      got++;
+    }
+  }
+  release(&tracelock);
+  return got;
+}
+
+// ktrace(cmd, addr, n): see KTRACE_* in stat.h.
+int
+ktrace(int cmd, uint64 addr, int n)
+{
+  switch(cmd){
+  case KTRACE_OFF:
+    tracing = 0;
+    return 0;
+  case KTRACE_ON:
+    acquire(&tracelock);
+    for(int c = 0; c < NCPU; c++)
+      rings[c].tail = rings[c].head;
+    release(&tracelock);
+    tracing = 1;
+    return 0;
+  case KTRACE_READ:
+    if(n < 0)
+      return -1;
+    return traceread(addr, n);
+  }
+  return -1;
+}
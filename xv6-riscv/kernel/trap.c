@@ -5,19 +5,26 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "stat.h"
 
 #define LRU_LOCKED 1   // 편의 매크로
 
 struct spinlock tickslock;
 uint ticks;
 
+// pa4: ticks follow the time CSR rather than one hart's timer
+// interrupts, since an idle hart takes none (see idletimer()).
+#define TICK 1000000       // time CSR cycles per tick, about 1/10 second
+static uint nextwake = ~0; // earliest deadline of a tickwait(), if any
+static uint64 nextalarm = ~0; // earliest deadline of a timerwait(), if any
+static uint64 nexttimer(uint64);
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
 
 extern int devintr();
-extern struct { struct spinlock lock; } pte_lock;  // PTE 락 선언
 
 void
 trapinit(void)
@@ -48,6 +55,13 @@ usertrap(void)
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
 
+  // pa4: uservec이 kernel page table로 바꾸며 TLB를 비웠음.
+  // 다른 hart의 tlb_flush()가 기다리고 있으면 진행하게 함
+  struct cpu *c = mycpu();
+  c->upt = 0;
+  __sync_synchronize();
+  c->tlbgen++;
+
   struct proc *p = myproc();
   
   // save user program counter.
@@ -67,59 +81,13 @@ usertrap(void)
     intr_on();
 
     syscall();
-  } else if(r_scause() == 13 || r_scause() == 15) {
-    // 페이지 폴트 (load or store)
-    uint64 va = r_stval();  // faulting address
-    pte_t *pte = walk(p->pagetable, va, 0);
-    
-    if(pte == 0){
-      // printf("[PAGE FAULT] walk() returned null for va=0x%lx\n", va);
-    } else {
-      // printf("[PAGE FAULT] va=0x%lx pte=0x%lx PTE_P=%d PTE_SWAP=%d\n",
-      //        va, *pte, (*pte & PTE_V) != 0, (*pte & PTE_SWAP) != 0);
-    }    
-
-    if(pte && (*pte & PTE_SWAP)) {
-      // 스왑된 페이지인 경우
-      // printf("[PAGE FAULT] Swapped page at va=0x%lx\n", va);
-      
-      // 1. 새 물리 페이지 할당
-      char *mem = kalloc();
-      if(!mem) {
-        // printf("[PAGE FAULT] Failed to allocate physical page, attempting to evict\n");
-        if(!evictpage()) {
-          // printf("[PAGE FAULT] Failed to evict page\n");
-          p->killed = 1;
-          goto end;
-        }
-        mem = kalloc();
-        if(!mem) {
-          // printf("[PAGE FAULT] Still failed to allocate after eviction\n");
-          p->killed = 1;
-          goto end;
-        }
-      }
-      
-      // 2. 스왑에서 읽어오기
-      int blkno = PTE2PPN(*pte);
-      swapread((uint64)mem, blkno);
-      freeswap(blkno);
-      
-      // 3. PTE 업데이트
-      uint64 flags = PTE_FLAGS(*pte) & (PTE_R|PTE_W|PTE_X|PTE_U);
-      acquire(&pte_lock.lock);
-      *pte = PA2PTE(mem) | (flags & ~PTE_SWAP) | PTE_V;
-      sfence_vma();
-      release(&pte_lock.lock);
-      
-      // 4. LRU 리스트에 추가
-      struct page *pg = &pages[(uint64)mem / PGSIZE];
-      if(!pg->in_lru && !pg->is_page_table && va < MAXVA) {
-        lru_add(pg, p->pagetable, va, LRU_LOCKED);
-      }
-      
-      // printf("[PAGE FAULT] Successfully swapped in page at va=0x%lx\n", va);
-    } else {
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15) {
+    // 페이지 폴트 (instruction, load or store): COW, swap-in,
+    // 아직 채워지지 않은 VMA 페이지는 vmfault()가 처리
+    trace(TR_FAULT, r_stval(), r_scause());
+    p->oom = 0;
+    if(vmfault(p->pagetable, r_stval(), r_scause() == 15) < 0 &&
+       !(p->oom && oomkill())) {
       printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
       printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
       p->killed = 1;
@@ -132,13 +100,16 @@ usertrap(void)
     p->killed = 1;
   }
 
-end:
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
+
+  // pa4: 오래 잤으면 그동안 내보내진 working set을 미리 읽어 들임
+  if(p->wsrestore)
+    ws_restore(p);
 
   usertrapret();
 }
@@ -182,6 +153,11 @@ usertrapret(void)
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
 
+  // pa4: 여기부터 이 page table의 PTE 변경은 이 hart의 TLB에도
+  // 닿아야 함 (vm.c의 tlb_flush())
+  mycpu()->upt = p->pagetable;
+  __sync_synchronize();
+
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
@@ -210,9 +186,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0)
-    yield();
+    preempt();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -223,17 +199,98 @@ kerneltrap()
 void
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
-  }
+  mycpu()->timers++;
+  tickupdate();
 
   // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // the interrupt request.
+  w_stimecmp(nexttimer(r_time() + TICK));
+}
+
+// pa4: a timer interrupt due at when, or earlier if a
+// timerwait() deadline comes first.
+static uint64
+nexttimer(uint64 when)
+{
+  uint64 a = nextalarm;
+
+  return a < when ? a : when;
+}
+
+// pa4: bring ticks up to date with the time CSR, and wake up
+// processes sleeping on it if it moved or a timerwait()
+// deadline passed. whichever hart sees it first does it.
+void
+tickupdate(void)
+{
+  uint t = r_time() / TICK;
+  int wake = 0;
+
+  // no lock: most calls find nothing to do
+  if(t == ticks && r_time() < nextalarm)
+    return;
+  acquire(&tickslock);
+  if((int)(t - ticks) > 0){
+    ticks = t;
+    if((int)(ticks - nextwake) >= 0)
+      nextwake = ~0;
+    wake = 1;
+  }
+  if(r_time() >= nextalarm){
+    nextalarm = ~0;
+    wake = 1;
+  }
+  if(wake)
+    wakeup(&ticks);
+  release(&tickslock);
+}
+
+// pa4: sleep on ticks until about tick deadline; the caller
+// holds tickslock and checks again when woken. unlike a plain
+// sleep(&ticks), this wakes up on time even while every hart
+// is idle.
+void
+tickwait(uint deadline)
+{
+  if(nextwake == ~0 || (int)(deadline - nextwake) < 0)
+    nextwake = deadline;
+  sleep(&ticks, &tickslock);
+}
+
+// pa4: like tickwait(), for a deadline in time CSR cycles that
+// may be much less than a tick away.
+void
+timerwait(uint64 when)
+{
+  if(when < nextalarm)
+    nextalarm = when;
+  // tickslock is held, so no timer interrupt comes in between.
+  if(when < r_stimecmp())
+    w_stimecmp(when);
+  sleep(&ticks, &tickslock);
+}
+
+// pa4: this hart is about to wait in wfi with nothing to run.
+// take no timer interrupt before the earliest tickwait()
+// deadline, or for IDLETICKS ticks if there is none sooner.
+void
+idletimer(void)
+{
+  uint64 when = r_time() + IDLETICKS * TICK;
+  uint w = nextwake;
+
+  if(w != ~0 && (uint64)w * TICK < when)
+    when = (uint64)w * TICK;
+  w_stimecmp(nexttimer(when));
+}
+
+// pa4: back from idle, maybe woken by another interrupt:
+// catch up on ticks and tick again for the process to run.
+void
+busytimer(void)
+{
+  tickupdate();
+  w_stimecmp(nexttimer(r_time() + TICK));
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -255,7 +312,9 @@ devintr()
     if(irq == UART0_IRQ){
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
-      virtio_disk_intr();
+      virtio_disk_intr(0);
+    } else if(irq == VIRTIO1_IRQ){
+      virtio_disk_intr(1);
     } else if(irq){
       printf("unexpected interrupt irq=%d\n", irq);
     }
@@ -266,6 +325,12 @@ devintr()
     if(irq)
       plic_complete(irq);
 
+    return 1;
+  } else if(scause == 0x8000000000000001L){
+    // pa4: ipivec이 넘겨준 software interrupt (TLB shootdown, 또는
+    // idle hart에 일을 넣었다는 알림). user mode에서 trap했으면
+    // uservec이 이미 TLB를 비웠음
+    w_sip(r_sip() & ~SIE_SSIE);
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
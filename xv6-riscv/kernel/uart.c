@@ -39,13 +39,19 @@
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
 // the transmit output buffer.
+// pa4: write() and kernel printf() both append to it, and the
+// transmit interrupt drains it, so kernel output costs a copy
+// rather than a spin per character, and stays in order with
+// user output.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 4096
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+int uart_tx_waiting; // write()s sleeping for space
 
 extern volatile int panicked; // from printf.c
+extern volatile int panicking;
 
 void uartstart();
 
@@ -77,14 +83,44 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
+// add n characters to the output buffer and tell the
 // UART to start sending if it isn't already.
-// blocks if the output buffer is full.
+// blocks while the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
 // by write().
 void
-uartputc(int c)
+uartwrite(char *buf, int n)
+{
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+  for(int i = 0; i < n; i++){
+    while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      // buffer is full.
+      // wait for uartintr() to open up space in the buffer.
+      uartstart();
+      uart_tx_waiting++;
+      sleep(&uart_tx_r, &uart_tx_lock);
+      uart_tx_waiting--;
+    }
+    uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = buf[i];
+    uart_tx_w += 1;
+  }
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// pa4: add a character to the output buffer for kernel
+// printf() and to echo characters. it does not sleep or wake
+// anyone, so it can be called from interrupts and with any
+// lock held; only if the buffer is full does it spin, sending
+// characters by polling the UART.
+void
+uartputc_kernel(int c)
 {
   acquire(&uart_tx_lock);
 
@@ -93,9 +129,9 @@ uartputc(int c)
       ;
   }
   while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
-    // buffer is full.
-    // wait for uartstart() to open up space in the buffer.
-    sleep(&uart_tx_r, &uart_tx_lock);
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    uartstart();
   }
   uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
   uart_tx_w += 1;
@@ -103,11 +139,10 @@ uartputc(int c)
   release(&uart_tx_lock);
 }
 
-
-// alternate version of uartputc() that doesn't 
-// use interrupts, for use by kernel printf() and
-// to echo characters. it spins waiting for the uart's
-// output register to be empty.
+// alternate version of uartputc_kernel() that doesn't
+// use interrupts or locks, for use by panic(). it
+// sends what is buffered, then c, spinning for the
+// uart's output register to be empty.
 void
 uartputc_sync(int c)
 {
@@ -119,6 +154,12 @@ uartputc_sync(int c)
   }
 
   // wait for Transmit Holding Empty to be set in LSR.
+  while(uart_tx_r != uart_tx_w){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
   while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
     ;
   WriteReg(THR, c);
@@ -150,9 +191,8 @@ uartstart()
     int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
     uart_tx_r += 1;
     
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
+    // uartintr() wakes up write()s waiting for space, since
+    // kernel printf() gets here with locks wakeup() may need.
     WriteReg(THR, c);
   }
 }
@@ -187,5 +227,7 @@ uartintr(void)
   // send buffered characters.
   acquire(&uart_tx_lock);
   uartstart();
+  if(uart_tx_waiting && uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE)
+    wakeup(&uart_tx_r);
   release(&uart_tx_lock);
 }
@@ -3,6 +3,7 @@
 // uses qemu's mmio interface to virtio.
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
+//          -drive file=swap.img,if=none,format=raw,id=x1 -device virtio-blk-device,drive=x1,bus=virtio-mmio-bus.1
 //
 
 #include "types.h"
@@ -15,11 +16,17 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "stat.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)((d)->base + (r)))
 
+// pa4: disk 0 holds the file system; disk 1, if present, is a
+// swap device (see swapinit()).
 static struct disk {
+  uint64 base;     // mmio registers
+  int present;
+
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
   // disk operations. there are NUM descriptors.
@@ -45,8 +52,14 @@ static struct disk {
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
+  // the descriptors of a request are freed by virtio_disk_intr()
+  // as soon as it completes, so info[] of a finished request may
+  // be reused before the submitter gets to look at it; raw
+  // requests therefore keep their completion count on the
+  // waiter's stack.
   struct {
-    struct buf *b;
+    struct buf *b; // buffer cache request, or 0 for a raw request.
+    int *pending;  // raw request: decremented when the device has finished.
     char status;
   } info[NUM];
 
@@ -56,35 +69,38 @@ static struct disk {
   
   struct spinlock vdisk_lock;
   
-} disk;
+} disks[NDISK];
 
-void
-virtio_disk_init(void)
+// set up disk d at mmio address base. returns -1 if there is
+// no virtio disk there.
+static int
+disk_init(struct disk *d, uint64 base)
 {
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
+  d->base = base;
+  initlock(&d->vdisk_lock, "virtio_disk");
 
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 2 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  if(*R(d, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(d, VIRTIO_MMIO_VERSION) != 2 ||
+     *R(d, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(d, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    return -1;
   }
   
   // reset device
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // set ACKNOWLEDGE status bit
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // set DRIVER status bit
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
@@ -92,73 +108,98 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // re-read status to ensure FEATURES_OK is set.
-  status = *R(VIRTIO_MMIO_STATUS);
+  status = *R(d, VIRTIO_MMIO_STATUS);
   if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
     panic("virtio disk FEATURES_OK unset");
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
+  *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
 
   // ensure queue 0 is not in use.
-  if(*R(VIRTIO_MMIO_QUEUE_READY))
+  if(*R(d, VIRTIO_MMIO_QUEUE_READY))
     panic("virtio disk should not be ready");
 
   // check maximum queue size.
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
 
   // allocate and zero queue memory.
-  disk.desc = kalloc();
-  disk.avail = kalloc();
-  disk.used = kalloc();
-  if(!disk.desc || !disk.avail || !disk.used)
+  d->desc = kalloc();
+  d->avail = kalloc();
+  d->used = kalloc();
+  if(!d->desc || !d->avail || !d->used)
     panic("virtio disk kalloc");
-  memset(disk.desc, 0, PGSIZE);
-  memset(disk.avail, 0, PGSIZE);
-  memset(disk.used, 0, PGSIZE);
+  memset(d->desc, 0, PGSIZE);
+  memset(d->avail, 0, PGSIZE);
+  memset(d->used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(d, VIRTIO_MMIO_QUEUE_NUM) = NUM;
 
   // write physical addresses.
-  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
-  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
-  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
-  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
-  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
-  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
+  *R(d, VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)d->desc;
+  *R(d, VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)d->desc >> 32;
+  *R(d, VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)d->avail;
+  *R(d, VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)d->avail >> 32;
+  *R(d, VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)d->used;
+  *R(d, VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)d->used >> 32;
 
   // queue is ready.
-  *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+  *R(d, VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+    d->free[i] = 1;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
+
+  d->present = 1;
+  return 0;
+}
+
+void
+virtio_disk_init(void)
+{
+  if(disk_init(&disks[0], VIRTIO0) < 0)
+    panic("could not find virtio disk");
+  disk_init(&disks[1], VIRTIO1);   // optional swap disk
 
-  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ
+  // and VIRTIO1_IRQ.
+}
+
+// pa4: size of disk dev in BSIZE blocks, 0 if it is missing.
+uint64
+virtio_disk_capacity(int dev)
+{
+  struct disk *d = &disks[dev];
+
+  if(dev < 0 || dev >= NDISK || !d->present)
+    return 0;
+  // the config space starts with the capacity in 512-byte sectors.
+  uint64 sectors = *R(d, VIRTIO_MMIO_CONFIG) | (uint64)*R(d, VIRTIO_MMIO_CONFIG + 4) << 32;
+  return sectors / (BSIZE / 512);
 }
 
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
   for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
+    if(d->free[i]){
+      d->free[i] = 0;
       return i;
     }
   }
@@ -167,28 +208,27 @@ alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
   if(i >= NUM)
     panic("free_desc 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("free_desc 2");
-  disk.desc[i].addr = 0;
-  disk.desc[i].len = 0;
-  disk.desc[i].flags = 0;
-  disk.desc[i].next = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->desc[i].len = 0;
+  d->desc[i].flags = 0;
+  d->desc[i].next = 0;
+  d->free[i] = 1;
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
+    int flag = d->desc[i].flags;
+    int nxt = d->desc[i].next;
+    free_desc(d, i);
     if(flag & VRING_DESC_F_NEXT)
       i = nxt;
     else
@@ -196,46 +236,36 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+allocn_desc(struct disk *d, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
+  for(int i = 0; i < n; i++){
+    idx[i] = alloc_desc(d);
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+        free_desc(d, idx[j]);
       return -1;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format a request with ndata data descriptors of len bytes each,
+// reading or writing consecutive disk sectors starting at sector,
+// and tell the device about it.
+// caller holds vdisk_lock and has allocated idx[0..ndata+1].
+static void
+submitn(struct disk *d, int *idx, int ndata, uint64 sector, void **addrs, uint len, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // one descriptor for type/reserved/sector, one or more for the
+  // data, and one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &d->ops[idx[0]];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
@@ -244,57 +274,199 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  d->desc[idx[0]].addr = (uint64) buf0;
+  d->desc[idx[0]].len = sizeof(struct virtio_blk_req);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  for(int i = 1; i <= ndata; i++){
+    d->desc[idx[i]].addr = (uint64) addrs[i-1];
+    d->desc[idx[i]].len = len;
+    if(write)
+      d->desc[idx[i]].flags = 0; // device reads addr
+    else
+      d->desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes addr
+    d->desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    d->desc[idx[i]].next = idx[i+1];
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  int st = idx[ndata+1];
+  d->info[idx[0]].status = 0xff; // device writes 0 on success
+  d->desc[st].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[st].len = 1;
+  d->desc[st].flags = VRING_DESC_F_WRITE; // device writes the status
+  d->desc[st].next = 0;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  d->avail->ring[d->avail->idx % NUM] = idx[0];
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  d->avail->idx += 1; // not % NUM ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  trace(TR_DSUBMIT, d - disks, sector);
+}
+
+// format a three-descriptor request for nbytes at addr,
+// starting at disk sector, and tell the device about it.
+// caller holds vdisk_lock and has allocated idx[].
+static void
+submit3(struct disk *d, int *idx, uint64 sector, void *addr, uint nbytes, int write)
+{
+  submitn(d, idx, 1, sector, &addr, nbytes, write);
+}
+
+// allocate n descriptors, sleeping until enough are free.
+// caller holds vdisk_lock.
+static void
+waitn_desc(struct disk *d, int *idx, int n)
+{
+  while(1){
+    if(allocn_desc(d, idx, n) == 0) {
+      break;
+    }
+    sleep(&d->free[0], &d->vdisk_lock);
+  }
+}
+
+// start a read or write of b and return without waiting for
+// the disk. b must be locked; the caller later waits with
+// virtio_disk_wait() and must not touch b->data until then.
+// if b->iodone is set, virtio_disk_intr() calls it (holding
+// the disk lock, so it must not sleep) when the request is done.
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  struct disk *d = &disks[0];
+  uint64 sector = b->blockno * (BSIZE / 512);
+
+  acquire(&d->vdisk_lock);
+
+  // allocate the three descriptors.
+  int idx[3];
+  waitn_desc(d, idx, 3);
+
+  // record struct buf for virtio_disk_intr().
+  b->disk = 1;
+  d->info[idx[0]].b = b;
+
+  submit3(d, idx, sector, b->data, BSIZE, write);
+
+  release(&d->vdisk_lock);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// wait for a request started by virtio_disk_submit() to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  struct disk *d = &disks[0];
+
+  acquire(&d->vdisk_lock);
   while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+    sleep(b, &d->vdisk_lock);
   }
+  release(&d->vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write);
+  virtio_disk_wait(b);
+}
+
+// read or write n chunks of len bytes each, at addrs[0..n-1],
+// to consecutive disk blocks starting at blockno, and wait for
+// all of them. the chunks go out as requests of up to NUM-2 data
+// descriptors each, all in flight together.
+// caller holds vdisk_lock.
+static void
+rawrw(struct disk *d, void **addrs, int n, uint len, uint blockno, int write)
+{
+  int idx[NUM];
+  int pending = 0;
+  int maxdata = NUM - 2;
+
+  for(int i = 0; i < n; i += maxdata){
+    int ndata = n - i < maxdata ? n - i : maxdata;
+    uint64 sector = ((uint64)blockno * BSIZE + (uint64)i * len) / 512;
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+    waitn_desc(d, idx, ndata + 2);
 
-  release(&disk.vdisk_lock);
+    d->info[idx[0]].b = 0;
+    d->info[idx[0]].pending = &pending;
+    pending++;
+
+    submitn(d, idx, ndata, sector, addrs + i, len, write);
+  }
+
+  while(pending > 0) {
+    sleep(&pending, &d->vdisk_lock);
+  }
 }
 
+// pa4: read or write nbytes (a multiple of BSIZE) of physically
+// contiguous kernel memory at addr, starting at block blockno of
+// disk dev, as one request. bypasses the buffer cache; used for
+// swap pages.
 void
-virtio_disk_intr()
+virtio_disk_rwraw(int dev, void *addr, uint blockno, uint nbytes, int write)
 {
-  acquire(&disk.vdisk_lock);
+  struct disk *d = &disks[dev];
+
+  if(nbytes == 0 || nbytes % BSIZE || dev < 0 || dev >= NDISK || !d->present)
+    panic("virtio_disk_rwraw");
+
+  acquire(&d->vdisk_lock);
+  rawrw(d, &addr, 1, nbytes, blockno, write);
+  release(&d->vdisk_lock);
+}
+
+// pa4: read or write npages physical pages, which need not be
+// contiguous in memory, to npages*PGSIZE bytes of consecutive
+// blocks of disk dev starting at blockno, as scatter-gather
+// requests. used for swap-in readahead.
+void
+virtio_disk_rwpages(int dev, void **pages, int npages, uint blockno, int write)
+{
+  struct disk *d = &disks[dev];
+
+  if(npages < 1 || dev < 0 || dev >= NDISK || !d->present)
+    panic("virtio_disk_rwpages");
+
+  acquire(&d->vdisk_lock);
+  rawrw(d, pages, npages, PGSIZE, blockno, write);
+  release(&d->vdisk_lock);
+}
+
+// read or write the n BSIZE-byte blocks at datas[0..n-1], which
+// need not be contiguous in memory, to consecutive disk blocks
+// starting at blockno. used by the log to write a run of buffers
+// without copying them. the caller holds the buffers' locks.
+void
+virtio_disk_rwblocks(void **datas, int n, uint blockno, int write)
+{
+  struct disk *d = &disks[0];
+
+  if(n < 1)
+    panic("virtio_disk_rwblocks");
+
+  acquire(&d->vdisk_lock);
+  rawrw(d, datas, n, BSIZE, blockno, write);
+  release(&d->vdisk_lock);
+}
+
+void
+virtio_disk_intr(int dev)
+{
+  struct disk *d = &disks[dev];
+  int nfreed = 0;
+
+  acquire(&d->vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -302,26 +474,44 @@ virtio_disk_intr()
   // the "used" ring, in which case we may process the new
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  *R(d, VIRTIO_MMIO_INTERRUPT_ACK) = *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  // the device increments d->used->idx when it
+  // adds an entry to the used ring. with many requests in
+  // flight, one interrupt usually reports several of them.
 
-  while(disk.used_idx != disk.used->idx){
+  while(d->used_idx != d->used->idx){
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+    int id = d->used->ring[d->used_idx % NUM].id;
 
-    if(disk.info[id].status != 0)
+    if(d->info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    trace(TR_DDONE, d - disks, d->ops[id].sector);
+    struct buf *b = d->info[id].b;
+    int *pending = d->info[id].pending;
+    d->info[id].b = 0;
+    d->info[id].pending = 0;
+    free_chain(d, id);
+    nfreed++;
+
+    if(b){
+      b->disk = 0;   // disk is done with buf
+      if(b->iodone)
+        b->iodone(b);
+      wakeup(b);
+    } else if(--*pending == 0) {
+      wakeup(pending);
+    }
 
-    disk.used_idx += 1;
+    d->used_idx += 1;
   }
 
-  release(&disk.vdisk_lock);
+  // wake anyone waiting for descriptors once per batch.
+  if(nfreed)
+    wakeup(&d->free[0]);
+
+  release(&d->vdisk_lock);
 }
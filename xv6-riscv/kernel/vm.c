@@ -6,86 +6,441 @@
 #include "defs.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
 
 // 스왑 관련 전역 변수
-#define MAX_SWAP_PAGES (SWAPMAX / PGSIZE)
+// 슬롯 하나는 한 페이지(PGSIZE/BSIZE 블록). 슬롯 번호는 모든 swap
+// area에 걸친 번호. 슬롯 수는 swapinit()이 swap disk 크기로 정함
 #define LRU_LOCKED 1   // 편의 매크로
 
-static char swap_bitmap[MAX_SWAP_PAGES]; // 0: free, 1: used
+static int swap_nslots;                 // 슬롯 수 (swap_bitmap/swap_count 크기)
+// 슬롯 사용 여부 비트맵 (bit 1: 사용 중). 64개 슬롯 = word 하나.
+// 전부 비어 있는 word 하나를 클러스터로 잡아 연속된 eviction이
+// 디스크에서 붙은 슬롯에 가도록 함.
+static uint64 *swap_bitmap;
+// 슬롯마다 그 슬롯을 가리키는 PTE 수 (0: free).
+// COW로 공유된 페이지를 한 번만 내보내면 여러 PTE가 같은 슬롯을 가리킴.
+static uchar *swap_count;
+static int swap_used;                   // 사용 중인 슬롯 수
+
+// pa4: swap area: 디스크 dev의 start 블록부터 nslots 페이지.
+// area마다 bitmap word 경계에서 시작하는 [base, base + nslots) 슬롯을
+// 가짐. 부팅 때 swapinit()이 정한 뒤로 바뀌지 않음.
+// allocswap()은 prio가 높은 area부터 채움
+struct swaparea {
+  int dev;
+  uint start;
+  int base, nslots;
+  int prio;
+  int hint;                       // next-fit: 다음 검색을 시작할 word
+  int cluster_next, cluster_end;  // 현재 클러스터의 [next, end) 슬롯
+};
+static struct swaparea swapareas[NSWAPAREA];  // prio 내림차순
+static int nswaparea;
+static int swap_end;                          // 마지막 area 다음 슬롯
 struct { struct spinlock lock; } swap_bitmap_lock;  // 스왑 비트맵 보호를 위한 락
-struct { struct spinlock lock; } pte_lock;  // PTE 업데이트 보호를 위한 락
+// pa4: PTE 업데이트 락. 전역 락 하나 대신 page table page마다
+// NPTLOCK개 중 하나를 씀 (ptlock()). 서로 다른 프로세스의 fault와
+// eviction이 같은 락을 두고 다투지 않음. 락 순서에서 맨 아래
+// (swap 락들 위): 둘을 잡을 때는 ptlock2()로 주소 순서대로
+static struct spinlock ptlocks[NPTLOCK];
+// pa4: evict()가 page_hold()해 둔 PTE(PTE_EVICT)에서 fault 난 프로세스가
+// 이 락을 채널로 잠들고, page_release()가 깨움
+static struct spinlock evict_lock;
 
 // 스왑 통계를 위한 전역 변수
 int swap_out_count = 0;  // 스왑 아웃 횟수
 int swap_in_count = 0;   // 스왑 인 횟수
+int swap_ra_pages = 0;   // readahead로 함께 읽어 온 페이지 수
+int swap_ra_hits = 0;    // 그중 실제로 참조된 페이지 수
+int swap_clean_evicts = 0;  // swap cache 덕분에 쓰기 없이 내보낸 페이지 수
+int ws_prefetched = 0;   // ws_restore()가 미리 읽어 들인 페이지 수
+int refill_drops = 0;    // 쓰이지 않은 VMA 페이지를 swap 없이 버린 수
+int zero_drops = 0;      // 0으로 차 있어 zero page로 바꾼 victim 수
+int mmap_writebacks = 0; // swap 대신 파일에 쓴 MAP_SHARED 페이지 수
+int super_maps = 0;      // 매핑한 2MB superpage 수
+int super_splits = 0;    // 그중 4KB로 쪼갠 수
+int pt_reclaims = 0;     // 비어서 free한 page table page 수
+int minor_faults = 0;    // 디스크 I/O 없이 처리한 fault 수
+int major_faults = 0;    // swap이나 파일을 읽은 fault 수
+int victim_scans = 0;    // select_victim() 호출 수 (lru_lock으로 보호)
+int victim_scanned = 0;  // 그동안 살펴본 LRU 페이지 수 (lru_lock으로 보호)
 struct { struct spinlock lock; } swap_stats_lock;  // 통계 보호를 위한 락
 
-// LRU 리스트 전역 변수
-struct page *lru_head = NULL;   // 가장 오래된(victim 후보)
-struct page *lru_tail = NULL;   // 가장 최근에 접근된 페이지
+// LRU: active/inactive 두 리스트 (원형 이중 연결 리스트).
+// 새로 들어온 페이지는 inactive tail에 붙고, inactive에서 두 번
+// 참조가 확인되면 active로 올라감. eviction은 inactive head에서만.
+// active가 너무 커지면 active head부터 참조 안 된 페이지를 inactive로 내림.
+struct lru_list {
+  struct page *head;   // 가장 오래된 페이지
+  struct page *tail;   // 가장 최근에 들어온 페이지
+  int n;
+};
+static struct lru_list active_list, inactive_list;
 struct { struct spinlock lock; } lru_lock;  // LRU 리스트 보호를 위한 락
 struct { struct spinlock lock; } page_lock;  // pages[] 배열 보호를 위한 락
 
 // kalloc.c의 전역 변수 참조
 extern int num_lru_pages;
+extern int num_free_pages;
+extern uint reclaim_until;
+
+// per-CPU LRU 추가 배치 (pagevec). lru_add는 페이지를 이 CPU의 pagevec에
+// 모아 두고, 가득 차면 page_lock/lru_lock을 한 번만 잡고 한꺼번에
+// inactive 리스트에 붙임. 아직 붙지 않은 페이지는 in_lru == LRU_PENDING.
+#define LRU_PENDING 2
+struct pagevec {
+  struct spinlock lock;
+  int n;
+  struct page *pages[PAGEVEC_SIZE];
+};
+static struct pagevec lru_pvec[NCPU];
 
-// LRU 리스트 일관성 검사 함수
-void check_lru_consistency() {
+/*
+ * the kernel's page table.
+ */
+pagetable_t kernel_pagetable;
+
+// pa4: 지연 TLB 무효화. PTE를 바꿀 때마다 sfence_vma()로 TLB 전체를
+// 비우는 대신 (page table, va)를 batch에 모았다가 tlb_flush()에서 한
+// 번에 처리함. 커널에 있는 hart는 kernel page table로만 돌고, user
+// 매핑은 uservec/userret이 satp를 바꾸며 TLB째 비우므로 이 hart에서
+// 비울 것은 kernel page table의 va뿐 (sfence.vma va). user page table은
+// 지금 그것으로 user mode에서 도는 다른 hart에만 IPI를 보내고, 그
+// hart가 trap해서 uservec을 지날 때까지 기다림
+struct tlbbatch {
+  int n;
+  pagetable_t pt[TLB_BATCH];
+  uint64 va[TLB_BATCH];         // kernel page table일 때만 씀
+};
+
+static void tlb_flush(struct tlbbatch*);
+
+static void
+tlb_add(struct tlbbatch *b, pagetable_t pt, uint64 va)
+{
+  // user page table은 hart 단위로만 비우므로 한 번만 적음
+  if (pt != kernel_pagetable)
+    for (int i = 0; i < b->n; i++)
+      if (b->pt[i] == pt)
+        return;
+  if (b->n == TLB_BATCH)
+    tlb_flush(b);
+  b->pt[b->n] = pt;
+  b->va[b->n] = va;
+  b->n++;
+}
+
+static void
+tlb_flush(struct tlbbatch *b)
+{
+  uint gen[NCPU];
+  pagetable_t want[NCPU];
+
+  push_off();
+  int me = cpuid();
+  for (int i = 0; i < b->n; i++)
+    if (b->pt[i] == kernel_pagetable)
+      sfence_vma_va(b->va[i]);
+
+  // PTE 쓰기를 먼저 보이게 한 뒤 upt를 봄. 그 뒤에 user mode로 가는
+  // hart는 userret의 sfence.vma 뒤에 새 PTE를 읽음
+  __sync_synchronize();
+  for (int c = 0; c < NCPU; c++) {
+    want[c] = 0;
+    if (c == me)
+      continue;
+    gen[c] = cpus[c].tlbgen;
+    pagetable_t upt = cpus[c].upt;
+    for (int i = 0; upt && i < b->n; i++) {
+      if (b->pt[i] == upt) {
+        want[c] = upt;
+        *(uint32*)CLINT_MSIP(c) = 1;
+        break;
+      }
+    }
+  }
+  // trap하면 usertrap()이 tlbgen을 올림. 락을 잡은 채 기다려도 되는
+  // 것은 user mode의 hart는 락과 상관없이 바로 IPI를 받기 때문
+  for (int c = 0; c < NCPU; c++)
+    while (want[c] && cpus[c].upt == want[c] && cpus[c].tlbgen == gen[c])
+      ;
+  pop_off();
+  b->n = 0;
+}
+
+// page 하나의 PTE를 바꾼 뒤
+static void
+tlb_flush_page(pagetable_t pt, uint64 va)
+{
+  struct tlbbatch b;
+
+  b.n = 0;
+  tlb_add(&b, pt, va);
+  tlb_flush(&b);
+}
+
+static int uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+static struct vma *vma_busy(struct proc*, uint64, uint64);
+static int superpage_split(pagetable_t, uint64, pte_t*, char*, pte_t);
+static void ptreclaim(pagetable_t, uint64, uint64);
+static int vmfill(struct proc*, pagetable_t, uint64, int, int*);
+static void fault_account(struct proc*, pagetable_t, int);
+static void rss_enforce(struct proc*);
+static int evict(struct page*);
+static int swapin_pages(pagetable_t, uint64, pte_t*, int, int);
+static int page_dirty(struct page*);
+static int evictwait(pte_t*);
+static int evict_unmap(pagetable_t, uint64, pte_t*);
+
+extern struct proc proc[NPROC];
+static struct proc *kswapdp;  // 쓰인 MAP_SHARED 페이지를 내보낼 수 있는 유일한 문맥
+
+// pa4: 한 번도 쓰이지 않은 익명 페이지를 읽기만 하면 모두 이 페이지를
+// 읽기 전용(PTE_COW)으로 공유함. LRU/rmap/refcnt 관리 대상이 아니며
+// free되지 않음. 쓰기 fault가 나면 cowfault()가 새 페이지를 줌.
+static char zeropage[PGSIZE] __attribute__((aligned(PGSIZE)));
+#define ZEROPAGE ((uint64)zeropage)
+
+// old PTE와 같은 권한으로 zero page를 가리키는 PTE.
+// 쓰기 가능했으면 PTE_COW로 바꿔 첫 쓰기 때 복사되게 함
+static pte_t
+zeropte(pte_t old)
+{
+  pte_t pte = PA2PTE(ZEROPAGE) | PTE_V | (old & (PTE_R|PTE_X|PTE_U));
+  if (old & (PTE_W|PTE_COW))
+    pte |= PTE_COW;
+  return pte;
+}
+
+// pte의 PTE_A를 지우고, 켜져 있었으면 1. 하드웨어가 그사이 같은 PTE에
+// 켜는 PTE_D를 덮어쓰지 않도록 한 번의 atomic AND로 지움
+static int
+pte_clear_a(pte_t *pte)
+{
+  return (__atomic_fetch_and(pte, ~PTE_A, __ATOMIC_SEQ_CST) & PTE_A) != 0;
+}
+
+void
+pagevec_init(void)
+{
+  for (int i = 0; i < NCPU; i++)
+    initlock(&lru_pvec[i].lock, "pagevec");
+  for (int i = 0; i < NPTLOCK; i++)
+    initlock(&ptlocks[i], "pte");
+  initlock(&evict_lock, "evict");
+}
+
+// pte가 들어 있는 page table page의 락
+static struct spinlock*
+ptlock(pte_t *pte)
+{
+  return &ptlocks[((uint64)pte >> PGSHIFT) % NPTLOCK];
+}
+
+// 두 PTE의 락을 주소 순서로 잡음 (같은 락이면 한 번)
+static void
+ptlock2(pte_t *a, pte_t *b)
+{
+  struct spinlock *la = ptlock(a), *lb = ptlock(b);
+
+  if (la > lb) {
+    struct spinlock *t = la;
+    la = lb;
+    lb = t;
+  }
+  acquire(la);
+  if (lb != la)
+    acquire(lb);
+}
+
+static void
+ptunlock2(pte_t *a, pte_t *b)
+{
+  struct spinlock *la = ptlock(a), *lb = ptlock(b);
+
+  if (lb != la)
+    release(lb);
+  release(la);
+}
+
+#ifdef LRU_DEBUG
+// LRU 리스트 일관성 검사 함수 (make LRU_DEBUG=1 일 때만)
+static void
+check_lru_consistency(void)
+{
   // 락 획득 순서: page_lock -> lru_lock
   acquire(&page_lock.lock);
   acquire(&lru_lock.lock);
 
-  int count = 0;
-  struct page *p = lru_head;
-  if (!p) {
-    if (num_lru_pages != 0)
-      // printf("check_lru: mismatch! num_lru_pages=%d but list empty\n", num_lru_pages);
-    release(&lru_lock.lock);
-    release(&page_lock.lock);
-    return;
-  }
-  do {
-    count++;
-    if (count > 100000) {
-      // printf("check_lru: infinite loop detected\n");
-      break;
+  struct lru_list *lists[2] = { &active_list, &inactive_list };
+  int total = 0;
+  for (int i = 0; i < 2; i++) {
+    int count = 0;
+    struct page *p = lists[i]->head;
+    if (p) {
+      do {
+        count++;
+        if (count > 100000) {
+          printf("check_lru: infinite loop detected\n");
+          break;
+        }
+        if (p->in_lru != 1 || p->active != (i == 0))
+          printf("check_lru: page %p in list %d has in_lru=%d active=%d\n",
+                 p, i, p->in_lru, p->active);
+        p = &pages[p->next];
+      } while(p != lists[i]->head);
     }
-    p = p->next;
-  } while(p && p != lru_head);
-  if (count != num_lru_pages) {
-    // printf("check_lru: mismatch! counted=%d, recorded=%d\n", count, num_lru_pages);
+    if (count != lists[i]->n) {
+      printf("check_lru: mismatch! list %d counted=%d, recorded=%d\n", i, count, lists[i]->n);
+    }
+    total += count;
+  }
+  if (total != num_lru_pages) {
+    printf("check_lru: mismatch! counted=%d, recorded=%d\n", total, num_lru_pages);
   }
 
   // 락 해제 순서: lru_lock -> page_lock
   release(&lru_lock.lock);
   release(&page_lock.lock);
 }
+#endif
+
+// 리스트 링크는 pages[]의 index
+#define PGIDX(p) ((uint)((p) - pages))
+
+// 리스트 l의 tail에 p를 붙임. lru_lock을 잡고 호출
+static void
+list_append(struct lru_list *l, struct page *p)
+{
+  if (!l->head) {
+    l->head = l->tail = p;
+    p->next = p->prev = PGIDX(p);  // 자기 자신을 가리키도록
+  } else {
+    p->next = PGIDX(l->head);    // 끝->head 연결
+    p->prev = PGIDX(l->tail);    // 끝->이전 tail 연결
+    l->head->prev = PGIDX(p);    // head->새 tail 연결
+    l->tail->next = PGIDX(p);    // 이전 tail->새 tail 연결
+    l->tail = p;                 // tail 업데이트
+  }
+  l->n++;
+  p->in_lru = 1;
+  num_lru_pages++;  // page_lock과 lru_lock으로 보호됨
+}
+
+// 리스트 l의 head, 곧 다음 victim 자리에 p를 붙임. lru_lock을 잡고 호출
+static void
+list_prepend(struct lru_list *l, struct page *p)
+{
+  list_append(l, p);
+  l->head = p;
+  l->tail = &pages[p->prev];
+}
+
+// p를 자신이 속한 리스트에서 떼어냄. lru_lock을 잡고 호출
+static void
+list_unlink(struct page *p)
+{
+  struct lru_list *l = p->active ? &active_list : &inactive_list;
+
+  if (l->head == p && l->tail == p) { // 마지막 노드
+    l->head = l->tail = NULL;
+  } else {
+    pages[p->prev].next = p->next;
+    pages[p->next].prev = p->prev;
+    if (l->head == p)  l->head = &pages[p->next];
+    if (l->tail == p)  l->tail = &pages[p->prev];
+  }
+  p->prev = p->next = 0;
+  p->in_lru = 0;
+  l->n--;
+  num_lru_pages--;
+}
+
+// pagevec에 모인 페이지들을 inactive tail에 붙임.
+// 그사이 lru_remove된(또는 다른 pagevec에서 이미 붙은) 페이지는 건너뜀
+static void
+pagevec_drain(struct pagevec *pv)
+{
+  struct page *batch[PAGEVEC_SIZE];
+  int n;
+
+  acquire(&pv->lock);
+  n = pv->n;
+  for (int i = 0; i < n; i++)
+    batch[i] = pv->pages[i];
+  pv->n = 0;
+  release(&pv->lock);
+  if (n == 0)
+    return;
+
+  // 락 획득 순서: page_lock -> lru_lock
+  acquire(&page_lock.lock);
+  acquire(&lru_lock.lock);
+  for (int i = 0; i < n; i++) {
+    struct page *p = batch[i];
+    if (p->in_lru != LRU_PENDING)
+      continue;
+    p->active = 0;
+    p->referenced = 0;
+    list_append(&inactive_list, p);
+  }
+  release(&lru_lock.lock);
+  release(&page_lock.lock);
+#ifdef LRU_DEBUG
+  check_lru_consistency();
+#endif
+}
+
+// 모든 CPU의 pagevec을 비움 (victim을 고르기 전에)
+static void
+lru_drain_all(void)
+{
+  for (int i = 0; i < NCPU; i++)
+    if (lru_pvec[i].n > 0)
+      pagevec_drain(&lru_pvec[i]);
+}
 
-// LRU 노드 삽입
+// LRU 노드 삽입: 새 매핑은 inactive tail로 들어감.
+// use_lock이면 이 CPU의 pagevec에 넣고 나중에 한꺼번에 붙임.
+// use_lock == 0이면 호출자가 두 락을 잡고 있거나 부팅 중이므로 바로 붙임.
 void
 lru_add(struct page *p, pagetable_t pagetable, uint64 vaddr, int use_lock)
 {
   // 페이지 포인터 유효성 검사
-  if (p < &pages[0] || p >= &pages[PHYSTOP/PGSIZE]) {
+  if (p < &pages[0] || p >= &pages[NFRAMES]) {
     // printf("[LRU ADD] Invalid page pointer: %p\n", p);
     return;
   }
 
-  // 가상 주소 유효성 검사
-  if ((uint64)vaddr >= MAXVA) {
-    // printf("[LRU ADD] Invalid vaddr: 0x%lx\n", (uint64)vaddr);
+  // 가상 주소와 페이지 테이블 페이지 체크
+  // RING 위(ring, trapframe, trampoline)는 커널이 직접 쓰는 페이지라 스왑 대상 아님
+  if ((uint64)vaddr >= RING || p->is_page_table) {
+    // printf("[LRU ADD] Invalid page: is_page_table=%d, vaddr=0x%lx\n", p->is_page_table, vaddr);
     return;
   }
 
-  // 페이지 테이블 페이지 체크
-  if (p->is_page_table) {
-    // printf("[LRU] Warning: tried to add page table page to LRU (va=0x%lx)\n", vaddr);
-    return;
-  }
-
-  // 이중 체크: 페이지 테이블이 아니고, 가상 주소가 유효한 경우에만 진행
-  if (p->is_page_table || vaddr >= MAXVA) {
-    // printf("[LRU] Double check failed: is_page_table=%d, vaddr=0x%lx\n", p->is_page_table, vaddr);
+  if (use_lock && p->in_lru != 1) {
+    // 메타데이터를 먼저 쓰고 나서 pending 표시 (drain이 다른 CPU에서 볼 수 있음)
+    p->pagetable = pagetable;
+    p->vaddr = (char*)vaddr;
+    p->pte = walk(pagetable, vaddr, 0);
+    __sync_synchronize();
+    p->in_lru = LRU_PENDING;
+
+    push_off();
+    struct pagevec *pv = &lru_pvec[cpuid()];
+    acquire(&pv->lock);
+    pv->pages[pv->n++] = p;
+    int full = (pv->n == PAGEVEC_SIZE);
+    release(&pv->lock);
+    pop_off();
+    if (full)
+      pagevec_drain(pv);
     return;
   }
 
@@ -98,56 +453,20 @@ lru_add(struct page *p, pagetable_t pagetable, uint64 vaddr, int use_lock)
   // 메타데이터 설정
   p->pagetable = pagetable;
   p->vaddr = (char*)vaddr;
+  p->pte = walk(pagetable, vaddr, 0);
 
-  // 원래 리스트에 있었는지 여부를 먼저 판단
-  int was_in_list = p->in_lru;
-
-  // 이미 리스트에 있었으면 제거
-  if (was_in_list) {
-    // p가 head이면서 next NULL인 경우 빈 리스트일 때 예외 처리
-    if (lru_head == p && p->next == NULL && p->prev == NULL) {
-      ; // 빈 리스트 그대로
-    } else {
-      // 리스트 중간/끝에 있으면 제거
-      if (p->prev) p->prev->next = p->next;
-      if (p->next) p->next->prev = p->prev;
-      if (lru_head == p)    lru_head = p->next;
-      if (lru_tail == p)    lru_tail = p->prev;
-      p->prev = p->next = NULL;  // 리스트에서 완전히 분리
-      p->in_lru = 0;  // 리스트에서 제거됨을 표시
-      num_lru_pages--;  // 기존에 있던 노드 제거
-    }
-  }
-
-  // 빈 리스트일 때
-  if (!lru_head) {
-    lru_head = lru_tail = p;
-    p->next = p->prev = p;  // 자기 자신을 가리키도록
-    p->in_lru = 1;  // 리스트에 추가됨을 표시
-    num_lru_pages = 1;  // 첫 페이지 추가
-  } else {
-    // 리스트 끝에 붙이기 (원형 리스트)
-    p->next = lru_head;     // 끝->head 연결
-    p->prev = lru_tail;     // 끝->이전 tail 연결
-    lru_head->prev = p;     // head->새 tail 연결
-    lru_tail->next = p;     // 이전 tail->새 tail 연결
-    lru_tail = p;           // tail 업데이트
-    p->in_lru = 1;  // 리스트에 추가됨을 표시
-    if (!was_in_list) {  // 새로 추가되는 경우에만 카운트 증가
-      num_lru_pages++;  // page_lock과 lru_lock으로 보호됨
-    }
-  }
+  // 이미 리스트에 있었으면 제거 후 다시 붙임
+  if (p->in_lru == 1)
+    list_unlink(p);
+  p->active = 0;
+  p->referenced = 0;
+  list_append(&inactive_list, p);
 
   // 락 해제 순서: lru_lock -> page_lock
   if (use_lock) {
     release(&lru_lock.lock);
     release(&page_lock.lock);
   }
-  
-  // 일관성 검사 (락을 다시 획득)
-  if (use_lock) {
-    check_lru_consistency();
-  }
 }
 
 // LRU 노드 제거
@@ -160,75 +479,352 @@ lru_remove(struct page *p, int use_lock)
     acquire(&lru_lock.lock);
   }
 
-  // 실제 리스트에서 제거되는 경우만 카운트 감소
-  if (p->in_lru) {
-    if (lru_head == p && lru_head == lru_tail) { // 마지막 노드
-      lru_head = lru_tail = NULL;
-    } else {
-      if (lru_head == p)  lru_head = p->next;
-      if (lru_tail == p)  lru_tail = p->prev;
-      if (lru_head)  lru_head->prev = lru_tail;
-      if (lru_tail)  lru_tail->next = lru_head;
-    }
-    p->prev = p->next = NULL;  // 리스트에서 완전히 분리
-    p->in_lru = 0;  // 리스트에서 제거됨을 표시
-    p->vaddr = 0;   // vaddr도 초기화
-    num_lru_pages--;  // page_lock과 lru_lock으로 보호됨
-  }
+  // 리스트에 있으면 떼어내고, pagevec에서 대기 중이면 drain이 건너뛰게 함
+  if (p->in_lru == 1)
+    list_unlink(p);
+  p->in_lru = 0;
+  p->active = 0;
+  p->referenced = 0;
+  p->vaddr = 0;   // vaddr도 초기화
+  p->pte = 0;
 
   // 락 해제 순서: lru_lock -> page_lock
   if (use_lock) {
     release(&lru_lock.lock);
     release(&page_lock.lock);
   }
-  
-  // 일관성 검사 (락을 다시 획득)
-  if (use_lock) {
+#ifdef LRU_DEBUG
+  if (use_lock)
     check_lru_consistency();
+#endif
+}
+
+// pa4: madvise(MADV_COLD): p를 inactive head로 옮겨 다음 victim으로.
+// pagevec에서 기다리는 페이지는 어차피 inactive tail로 들어가므로 둠
+static void
+lru_cold(struct page *p)
+{
+  // 락 획득 순서: page_lock -> lru_lock
+  acquire(&page_lock.lock);
+  acquire(&lru_lock.lock);
+  if (p->in_lru == 1) {
+    list_unlink(p);
+    p->active = 0;
+    p->referenced = 0;
+    list_prepend(&inactive_list, p);
+  }
+  release(&lru_lock.lock);
+  release(&page_lock.lock);
+}
+
+// pa4: reverse mapping for shared (COW) pages.
+// struct page의 (pagetable, vaddr)는 LRU가 쓰는 대표 매핑이고,
+// 그 외의 매핑은 page->rmap 리스트에 달림. page_lock으로 보호.
+// 둘 다 PTE 위치를 캐시해 두므로 LRU 스캔과 eviction은 walk()하지
+// 않음: 매핑이 풀리기 전에는 그 page table page가 free되지 않음
+// (ptreclaim()은 빈 table만 free함)
+struct rmap {
+  pagetable_t pagetable;
+  uint64 va;
+  pte_t *pte;
+  struct rmap *next;
+};
+
+static struct rmap rmap_pool[NRMAP];
+static struct rmap *rmap_free;
+
+void
+rmap_init(void)
+{
+  for (int i = 0; i < NRMAP; i++) {
+    rmap_pool[i].next = rmap_free;
+    rmap_free = &rmap_pool[i];
+  }
+}
+
+// pg에 pte에 있는 (pagetable, va) 매핑 추가. page_lock을 잡고 호출.
+// pool이 바닥나면 -1.
+static int
+rmap_add(struct page *pg, pagetable_t pagetable, uint64 va, pte_t *pte)
+{
+  struct rmap *r = rmap_free;
+  if (!r)
+    return -1;
+  rmap_free = r->next;
+  r->pagetable = pagetable;
+  r->va = va;
+  r->pte = pte;
+  r->next = pg->rmap;
+  pg->rmap = r;
+  return 0;
+}
+
+// 떼어내는 매핑 pte가 pg에 썼으면(PTE_D) 그 사실을 struct page에 남김:
+// 남은 매핑들의 PTE_D만 보는 page_dirty()는 이를 모름. page_lock을 잡고 호출.
+// freeswap()은 swap 락만 잡으므로 page_lock 아래에서 불러도 됨
+static void
+page_dirtied(struct page *pg, pte_t *pte)
+{
+  if (!pte || !(*pte & PTE_V) || !(*pte & PTE_D) || PA2PG(PTE2PA(*pte)) != pg)
+    return;
+  pg->refill = 0;   // evict()가 버리지 않고 swap에 씀
+  // swap cache 슬롯의 내용은 이제 낡았으므로 evict()가 다시 쓰지 않게 반환
+  if (pg->swapslot >= 0) {
+    freeswap(pg->swapslot);
+    pg->swapslot = -1;
+  }
+}
+
+// pg에서 (pagetable, va) 매핑 제거. page_lock을 잡고 호출.
+// 대표 매핑이 제거되면 rmap의 첫 매핑이 대표가 됨 (LRU 위치는 그대로).
+static void
+rmap_remove(struct page *pg, pagetable_t pagetable, uint64 va)
+{
+  struct rmap **rp, *r;
+
+  if (pg->pagetable == pagetable && (uint64)pg->vaddr == va) {
+    if ((r = pg->rmap) == 0)
+      return;
+    page_dirtied(pg, pg->pte);
+    pg->rmap = r->next;
+    pg->pagetable = r->pagetable;
+    pg->vaddr = (char*)r->va;
+    pg->pte = r->pte;
+  } else {
+    for (rp = &pg->rmap; (r = *rp) != 0; rp = &r->next)
+      if (r->pagetable == pagetable && r->va == va)
+        break;
+    if (r == 0)
+      panic("rmap_remove");
+    page_dirtied(pg, r->pte);
+    *rp = r->next;
+  }
+  r->next = rmap_free;
+  rmap_free = r;
+}
+
+// 공유 페이지에서 (pagetable, va) 매핑 하나를 떼어냄.
+// 다른 매핑이 남아 있으면 1 (페이지를 free하면 안 됨), 마지막 매핑이면 0.
+static int
+page_unshare(struct page *pg, pagetable_t pagetable, uint64 va)
+{
+  int shared;
+
+  acquire(&page_lock.lock);
+  shared = pg->refcnt > 1;
+  if (shared) {
+    rmap_remove(pg, pagetable, va);
+    pg->refcnt--;
   }
+  release(&page_lock.lock);
+  return shared;
 }
 
-// 스왑 비트맵 초기화
+// 스왑 비트맵 초기화: swapinit()이 비트맵을 만들고 swapon()이 area를
+// 붙이기 전에는 슬롯이 없음
 void
 init_swapbitmap(void)
 {
-  for (int i = 0; i < MAX_SWAP_PAGES; i++)
-    swap_bitmap[i] = 0;
+  swap_nslots = 0;
+  swap_bitmap = 0;
+  swap_count = 0;
+  swap_used = 0;
+  nswaparea = 0;
+  swap_end = 0;
+}
+
+// pa4: 디스크 dev의 start 블록부터 nslots 페이지를 prio의 swap area로 붙임
+static void
+swapon(int dev, uint start, int nslots, int prio)
+{
+  int base = (swap_end + 63) / 64 * 64;
+  int i;
+
+  if (base + nslots > swap_nslots)
+    nslots = swap_nslots - base;
+  if (nswaparea == NSWAPAREA || nslots <= 0)
+    return;
+
+  acquire(&swap_bitmap_lock.lock);
+  for (i = nswaparea; i > 0 && swapareas[i-1].prio < prio; i--)
+    swapareas[i] = swapareas[i-1];
+  struct swaparea *a = &swapareas[i];
+  a->dev = dev;
+  a->start = start;
+  a->base = base;
+  a->nslots = nslots;
+  a->prio = prio;
+  a->hint = base / 64;
+  a->cluster_next = a->cluster_end = 0;
+  for (int s = base; s < base + nslots; s++)
+    swap_bitmap[s / 64] &= ~(1L << (s % 64));
+  nswaparea++;
+  swap_end = base + nslots;
+  release(&swap_bitmap_lock.lock);
+  printf("swap: %d pages on disk %d, priority %d\n", nslots, dev, prio);
+}
+
+// pa4: 부팅 때 swap area를 정함. 두 번째 virtio disk가 있으면 그 전체를
+// 씀 (file system buffer와 디스크를 다투지 않음). 없을 때만 fs.img 안의
+// 예전 자리 [SWAPBASE, SWAPBASE+SWAPMAX)를 씀: file system과 같은
+// 디스크라 swap disk와 함께 두지 않음. 슬롯 비트맵과 참조 수는 그 크기로
+// buddy에서 연속으로 받음 (많아야 superpage 하나). virtio_disk_init() 뒤,
+// 첫 프로세스 전에 호출
+void
+swapinit(void)
+{
+  const int BLKS_PER_PG = PGSIZE / BSIZE;
+  uint64 cap = virtio_disk_capacity(1) / BLKS_PER_PG;
+  uint64 n = cap > 0 ? cap : SWAPMAX / BLKS_PER_PG;
+  uint64 max = SUPERPGSIZE * 8 / 9;  // 슬롯당 1 + 1/8 byte
+  int order = 0;
+  char *mem;
+
+  if (n > max)
+    n = max / 64 * 64;
+  uint64 bytes = (n + 63) / 64 * (64 + sizeof(uint64));
+  while (((uint64)PGSIZE << order) < bytes)
+    order++;
+  if ((mem = kalloc_order(order)) == 0)
+    panic("swapinit");
+  memset(mem, 0, PGSIZE << order);
+  swap_count = (uchar*)mem;
+  swap_bitmap = (uint64*)(mem + (n + 63) / 64 * 64);
+  for (int i = 0; i < (n + 63) / 64; i++)
+    swap_bitmap[i] = ~0UL;        // area 밖의 슬롯은 계속 사용 중
+  swap_nslots = n;
+
+  if (cap > 0)
+    swapon(1, 0, n, 1);
+  else
+    swapon(0, SWAPBASE, n, 0);
+}
+
+// pa4: 슬롯 slot이 있는 disk와 첫 블록. area 밖이면 -1
+int
+swapblock(int slot, int *dev)
+{
+  for (int i = 0; i < nswaparea; i++) {
+    struct swaparea *a = &swapareas[i];
+    if (slot >= a->base && slot < a->base + a->nslots) {
+      *dev = a->dev;
+      return a->start + (slot - a->base) * (PGSIZE / BSIZE);
+    }
+  }
+  return -1;
+}
+
+// w에서 처음으로 0인 비트 번호 (w != ~0 이어야 함)
+static int
+ffz(uint64 w)
+{
+  int n = 0;
+
+  w = ~w;
+  if ((w & 0xffffffffL) == 0) { n += 32; w >>= 32; }
+  if ((w & 0xffff) == 0) { n += 16; w >>= 16; }
+  if ((w & 0xff) == 0) { n += 8; w >>= 8; }
+  if ((w & 0xf) == 0) { n += 4; w >>= 4; }
+  if ((w & 0x3) == 0) { n += 2; w >>= 2; }
+  if ((w & 0x1) == 0) { n += 1; }
+  return n;
+}
+
+// area a의 word 중 a->hint부터 한 바퀴 돌며 비어 있는(want_empty)
+// 또는 빈 슬롯이 하나라도 있는 첫 word 번호, 없으면 -1
+static int
+findword(struct swaparea *a, int want_empty)
+{
+  int first = a->base / 64;
+  int nwords = (a->nslots + 63) / 64;
+
+  for (int n = 0; n < nwords; n++) {
+    int w = first + (a->hint - first + n) % nwords;
+    if (want_empty ? swap_bitmap[w] == 0 : swap_bitmap[w] != ~0UL)
+      return w;
+  }
+  return -1;
+}
+
+// area a에서 스왑 공간 할당. 공간이 없으면 -1.
+// swap_bitmap_lock을 잡고 호출
+static int
+allocslot(struct swaparea *a)
+{
+  int w, slot;
+
+  // 1. 현재 클러스터에서 다음 슬롯
+  while (a->cluster_next < a->cluster_end) {
+    slot = a->cluster_next++;
+    if ((swap_bitmap[slot / 64] & (1L << (slot % 64))) == 0)
+      return slot;
+  }
+
+  // 2. 비어 있는 word를 새 클러스터로
+  if ((w = findword(a, 1)) >= 0) {
+    a->cluster_next = w * 64 + 1;
+    a->cluster_end = w * 64 + 64;
+    a->hint = w + 1;
+    return w * 64;
+  }
+
+  // 3. 조각난 상태: 아무 빈 슬롯 (next-fit)
+  if ((w = findword(a, 0)) >= 0) {
+    a->hint = w;
+    return w * 64 + ffz(swap_bitmap[w]);
+  }
+  return -1;
 }
 
-// 스왑 공간 할당
 int
 allocswap(void)
 {
+  int slot;
+
   acquire(&swap_bitmap_lock.lock);
-  for (int i = 0; i < MAX_SWAP_PAGES; i++) {
-    if (swap_bitmap[i] == 0) {
-      swap_bitmap[i] = 1;
-      release(&swap_bitmap_lock.lock);
-      return i; // 페이지 단위 blkno 반환
-    }
+  slot = -1;
+  for (int i = 0; i < nswaparea && slot < 0; i++)
+    slot = allocslot(&swapareas[i]);
+  if (slot >= 0) {
+    swap_bitmap[slot / 64] |= 1L << (slot % 64);
+    swap_count[slot] = 1;
+    swap_used++;
   }
   release(&swap_bitmap_lock.lock);
-  panic("allocswap: out of swap space");  // 스왑 공간 부족 시 panic
-  return -1; // unreachable
+  return slot; // 페이지 단위 blkno, 스왑 공간 부족 시 -1
 }
 
-// 스왑 공간 해제
+// 스왑 슬롯 참조 해제 (마지막 참조면 슬롯이 free가 됨)
 void
 freeswap(int blkno)
 {
-  if (blkno < 0 || blkno >= MAX_SWAP_PAGES)
+  if (blkno < 0 || blkno >= swap_nslots)
     panic("freeswap: invalid blkno");
 
   acquire(&swap_bitmap_lock.lock);
-  swap_bitmap[blkno] = 0;
+  if (swap_count[blkno] == 0)
+    panic("freeswap: free slot");
+  if (--swap_count[blkno] == 0) {
+    swap_bitmap[blkno / 64] &= ~(1L << (blkno % 64));
+    swap_used--;
+    zswap_free(blkno);              // 다시 할당되기 전에 압축 사본을 버림
+  }
   release(&swap_bitmap_lock.lock);
 }
 
-/*
- * the kernel's page table.
- */
-pagetable_t kernel_pagetable;
+// 스왑 슬롯에 참조 하나 추가 (슬롯을 가리키는 PTE가 하나 늘어남)
+void
+dupswap(int blkno)
+{
+  if (blkno < 0 || blkno >= swap_nslots)
+    panic("dupswap: invalid blkno");
+
+  acquire(&swap_bitmap_lock.lock);
+  if (swap_count[blkno] == 0 || swap_count[blkno] == 255)
+    panic("dupswap");
+  swap_count[blkno]++;
+  release(&swap_bitmap_lock.lock);
+}
 
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
@@ -246,8 +842,12 @@ kvmmake(void)
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
-  // virtio mmio disk interface
+  // virtio mmio disk interfaces
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+  kvmmap(kpgtbl, VIRTIO1, VIRTIO1, PGSIZE, PTE_R | PTE_W);
+
+  // CLINT msip registers, for TLB shootdown IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
 
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
@@ -301,9 +901,16 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// pa4: a level-1 leaf is a 2MB superpage. without alloc, its
+// PTE is returned, so callers that only look at the flags work
+// unchanged; use pte2pa() for the address. with alloc, the
+// superpage is split into 4KB PTEs first.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
+  pagetable_t root = pagetable;
+
   //printf("[DEBUG] walk: va = 0x%lx, alloc = %d\n", va, alloc);
   
   if(va >= MAXVA) {
@@ -315,6 +922,17 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     pte_t *pte = &pagetable[PX(level, va)];
     //printf("[DEBUG] walk: level %d, pte = 0x%lx\n", level, *pte);
     
+    // evict()가 내보내는 중인 superpage: leaf처럼 돌려주되 새로 만들지는 않음
+    if(!(*pte & PTE_V) && (*pte & PTE_EVICT))
+      return alloc ? 0 : pte;
+    if((*pte & PTE_V) && (*pte & (PTE_R|PTE_W|PTE_X))) {
+      char *pt;
+      if(!alloc)
+        return pte;
+      if((pt = kalloc()) == 0)
+        return 0;
+      superpage_split(root, va, pte, pt, 0);
+    }
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
@@ -323,8 +941,7 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
       memset(pagetable, 0, PGSIZE);
       
       // 새로 할당된 페이지는 page table 용도이므로 플래그 설정
-      uint64 phys = (uint64)pagetable - KERNBASE;  // 커널 가상 주소를 물리 주소로 변환
-      struct page *pg = &pages[phys / PGSIZE];
+      struct page *pg = PA2PG(pagetable);
       pg->is_page_table = 1;
       pg->vaddr = 0;  // 페이지 테이블 페이지는 가상 주소가 없음
       // printf("[WALK] Allocated page table page: pa=0x%lx\n", phys);
@@ -335,95 +952,893 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
-// Look up a virtual address, return the physical address,
-// or 0 if not mapped.
-// Can only be used to look up user pages.
-uint64
-walkaddr(pagetable_t pagetable, uint64 va)
+// readahead로 들어온 페이지가 그 뒤 참조됐는지(PTE_A) 한 번만 집계
+static void
+ra_account(struct page *pg, int referenced)
 {
-  pte_t *pte = walk(pagetable, va, 0);
-  if (!pte) return 0;
-  // swap-in case
-  if (!(*pte & PTE_V) && (*pte & PTE_SWAP)) {
-    // printf("[SWAPIN] va: 0x%lx, pte: 0x%lx\n", va, *pte);
-    int blkno = PTE2PPN(*pte);
-    char *mem = kalloc(); // 새 물리 페이지 할당
-    if (!mem) return 0;
-    swapread((uint64)mem, blkno); // swap에서 읽어오기
-    freeswap(blkno);  // 사용이 끝난 swap 공간 반환
-    
-    // 스왑 인 통계 업데이트
+  if (!pg->readahead)
+    return;
+  pg->readahead = 0;
+  if (referenced) {
     acquire(&swap_stats_lock.lock);
-    swap_in_count++;
-    // printf("[SWAP IN] va: 0x%lx, blk: %d, mem: 0x%lx (total: %d)\n", va, blkno, (uint64)mem, swap_in_count);
+    swap_ra_hits++;
     release(&swap_stats_lock.lock);
-    
-    *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_V; // PPN 갱신 + SWAP 제거
-    // printf("[SWAPIN] Updated PTE: 0x%lx\n", *pte);
-    sfence_vma();
-    // add to LRU
-    struct page *pg = &pages[(uint64)mem / PGSIZE];
-    if (!pg->in_lru && !pg->is_page_table && va != 0 && va < MAXVA) {
-      lru_add(pg, pagetable, va, 1);
-    }
-    return (uint64)mem;
   }
-  if (!(*pte & PTE_V) || !(*pte & PTE_U)) return 0;
-  return PTE2PA(*pte);
 }
 
-// add a mapping to the kernel page table.
-// only used when booting.
-// does not flush TLB or enable paging.
-void
-kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
+// pa4: swap in the page at va, whose PTE must be PTE_SWAP.
+// if the current process has been faulting sequentially, also
+// bring in the following pages that are swapped out to the
+// following slots, up to its readahead window, with a single
+// disk request. the window doubles on each sequential fault
+// and halves otherwise. pte is va's PTE, as vmfault() found it.
+// returns 0 on success, -1 if out of memory.
+int
+swapin(pagetable_t pagetable, uint64 va, pte_t *pte)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  struct proc *p = myproc();
+  int n, win = 0;
+
+  va = PGROUNDDOWN(va);
+  if ((*pte & PTE_V) || !(*pte & PTE_SWAP))
+    return -1;
+
+  // 바로 앞 readahead 구간 끝에서 다시 fault가 나면 순차 접근으로 봄
+  if (p && p->pagetable == pagetable) {
+    if (va == p->ra_next)
+      p->ra_win = p->ra_win ? p->ra_win * 2 : 1;
+    else
+      p->ra_win /= 2;
+    if (p->ra_win > SWAP_RA_MAX)
+      p->ra_win = SWAP_RA_MAX;
+    win = p->ra_win;
+  }
+  // 메모리가 부족할 때는 readahead로 다른 페이지를 밀어내지 않음
+  if (num_free_pages < KSWAPD_LOW)
+    win = 0;
+
+  if ((n = swapin_pages(pagetable, va, pte, win, 1)) < 0)
+    return -1;
+  if (p && p->pagetable == pagetable)
+    p->ra_next = va + n * PGSIZE;
+
+  acquire(&swap_stats_lock.lock);
+  swap_ra_pages += n - 1;
+  release(&swap_stats_lock.lock);
+  return 0;
 }
 
-// Create PTEs for virtual addresses starting at va that refer to
-// physical addresses starting at pa.
-// va and size MUST be page-aligned.
-// Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
-int
-mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+// pa4: PTE_SWAP인 pte(va)와, 그 뒤로 다음 슬롯에 스왑된 페이지를
+// 많아야 win개 더 한 번의 디스크 요청으로 읽어 들임. ra번째부터는
+// readahead 페이지로 셈. 읽은 페이지 수, 메모리가 없으면 -1
+// fault 난 페이지만 kalloc()이 evict해서라도 얻고, readahead
+// 페이지는 free list에 있을 때만 씀. invalid였던 PTE를 채우는
+// 것이라 TLB shootdown은 필요 없음: 다른 hart는 spurious fault를
+// 내고 vmfault()가 그냥 돌려보내며, userret의 sfence.vma를 지남
+static int
+swapin_pages(pagetable_t pagetable, uint64 va, pte_t *pte, int win, int ra)
 {
-  uint64 a, last;
-  pte_t *pte;
+  char *mem[SWAP_RA_MAX + 1];
+  pte_t *ptes[SWAP_RA_MAX + 1];
+  int blkno = PTE2PPN(*pte);
+  int i, n;
 
-  if((va % PGSIZE) != 0)
-    panic("mappages: va not aligned");
+  // kalloc()이 이미 evict하고 다시 시도함
+  if ((mem[0] = kalloc()) == 0)
+    return -1;
+  ptes[0] = pte;
 
-  if((size % PGSIZE) != 0)
-    panic("mappages: size not aligned");
+  // 다음 va들이 다음 슬롯에 스왑돼 있는 동안만 모음
+  for (n = 1; n <= win; n++) {
+    uint64 a = va + n * PGSIZE;
+    if (a >= MAXVA)
+      break;
+    pte_t *q = walk(pagetable, a, 0);
+    if (!q || (*q & PTE_V) || !(*q & PTE_SWAP) || PTE2PPN(*q) != blkno + n)
+      break;
+    if ((mem[n] = kalloc_noevict()) == 0)
+      break;
+    ptes[n] = q;
+  }
 
-  if(size == 0)
-    panic("mappages: size");
-  
-  a = va;
-  last = va + size - PGSIZE;
-  for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
-      return -1;
-    if(*pte & PTE_V)
-      panic("mappages: remap");
-    
-    // printf("[MAPPAGES] va=0x%lx pa=0x%lx perm=0x%x (R=%d W=%d X=%d U=%d)\n", 
-    //        a, pa, perm,
-    //        (perm & PTE_R) != 0,
-    //        (perm & PTE_W) != 0,
-    //        (perm & PTE_X) != 0,
+  if (n == 1)
+    swapread((uint64)mem[0], blkno);
+  else
+    swapreadv(mem, n, blkno);
+
+  for (i = 0; i < n; i++) {
+    // PTE_COW는 유지: 쓰기 시 refcnt 1이므로 복사 없이 W 복구
+    uint64 flags = PTE_FLAGS(*ptes[i]) & (PTE_R|PTE_W|PTE_X|PTE_U|PTE_COW);
+    acquire(ptlock(ptes[i]));
+    *ptes[i] = PA2PTE(mem[i]) | flags | PTE_V; // PPN 갱신 + SWAP 제거
+    release(ptlock(ptes[i]));
+
+    // swap cache: PTE의 슬롯 참조를 페이지가 넘겨받음. 다시 내보낼 때
+    // 그동안 쓰이지 않았으면(PTE_D == 0) 이 슬롯을 그대로 씀
+    struct page *pg = PA2PG(mem[i]);
+    pg->swapslot = blkno + i;
+    pg->readahead = (i >= ra);
+    if (!pg->in_lru && !pg->is_page_table)
+      lru_add(pg, pagetable, va + i * PGSIZE, LRU_LOCKED);
+  }
+
+  // 스왑 인 통계 업데이트
+  acquire(&swap_stats_lock.lock);
+  swap_in_count += n;
+  release(&swap_stats_lock.lock);
+  trace(TR_SWAPIN, va, n);
+  return n;
+}
+
+// pa4: working-set restore. evict()는 내보낸 페이지의 va를 주인
+// 프로세스의 p->wsva[] ring에 적어 둠: 나중에 내보낸 것일수록 최근에
+// 쓰인 페이지. WS_SLEEP tick 넘게 잔 프로세스는 user mode로 돌아가기
+// 전에 ws_restore()가 그 페이지들을 다시 읽어 들여, 깨어나서 한
+// 장씩 major fault를 내지 않게 함
+static void
+ws_record(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p;
+
+  // p->pagetable은 락 없이 봄: 틀려도 ws_restore()가 PTE를 다시 확인
+  for (p = proc; p < &proc[NPROC]; p++) {
+    if (p->pagetable == pagetable) {
+      uint i = __sync_fetch_and_add(&p->wshead, 1);
+      p->wsva[i % WS_PAGES] = va;
+      return;
+    }
+  }
+}
+
+// p가 자기 문맥에서, user mode로 돌아가기 직전에 부름
+void
+ws_restore(struct proc *p)
+{
+  int n = 0, r;
+
+  p->wsrestore = 0;
+  // rsslimit이 걸려 있으면 읽어 들이는 만큼 다시 내보내게 됨
+  if (p->rsslimit)
+    return;
+  int cnt = p->wshead < WS_PAGES ? p->wshead : WS_PAGES;
+  for (int k = 1; k <= cnt; k++) {
+    uint64 va = p->wsva[(p->wshead - k) % WS_PAGES];
+    // 다른 페이지를 밀어내면서까지 읽지는 않음
+    if (num_free_pages < KSWAPD_HIGH)
+      break;
+    if (va >= MAXVA)
+      continue;
+    pte_t *pte = walk(p->pagetable, va, 0);
+    if (!pte || (*pte & PTE_V) || !(*pte & PTE_SWAP))
+      continue;
+    if ((r = swapin_pages(p->pagetable, va, pte, SWAP_RA_MAX, 0)) < 0)
+      break;
+    n += r;
+  }
+  acquire(&swap_stats_lock.lock);
+  ws_prefetched += n;
+  release(&swap_stats_lock.lock);
+}
+
+// pa4: pte가 매핑하는 va 페이지의 물리 주소.
+// superpage면 그 안에서 va에 해당하는 4KB frame
+static uint64
+pte2pa(pte_t pte, uint64 va)
+{
+  uint64 pa = PTE2PA(pte);
+  if (PA2PG(pa)->super)
+    pa += PGROUNDDOWN(va) & (SUPERPGSIZE - 1);
+  return pa;
+}
+
+// pa4: pte가 superpage를 매핑하는지
+static int
+pte_super(pte_t pte)
+{
+  return (pte & PTE_V) && PA2PG(PTE2PA(pte))->super;
+}
+
+// pa4: va의 level-1 PTE. alloc이면 level-1 page table을 만듦
+static pte_t*
+walk1(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if (!(*pte & PTE_V)) {
+    pagetable_t pt;
+    if (!alloc || (pt = (pagetable_t)kalloc()) == 0)
+      return 0;
+    memset(pt, 0, PGSIZE);
+    PA2PG(pt)->is_page_table = 1;
+    PA2PG(pt)->vaddr = 0;
+    *pte = PA2PTE(pt) | PTE_V;
+  }
+  return &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+}
+
+// pa4: 2MB 정렬된 va부터를 0으로 채운 superpage 하나로 매핑.
+// pool이 비었거나 그 2MB에 이미 L0 page table이 있으면 -1
+static int
+superfill(pagetable_t pagetable, uint64 va, int perm)
+{
+  pte_t *pte;
+  char *mem;
+
+  if ((pte = walk1(pagetable, va, 1)) == 0 || *pte != 0)
+    return -1;
+  if ((mem = superalloc()) == 0)
+    return -1;
+  memset(mem, 0, SUPERPGSIZE);
+  acquire(ptlock(pte));
+  *pte = PA2PTE(mem) | perm | PTE_V;
+  release(ptlock(pte));
+  lru_add(PA2PG(mem), pagetable, va, LRU_LOCKED);
+
+  acquire(&swap_stats_lock.lock);
+  super_maps++;
+  release(&swap_stats_lock.lock);
+  return 0;
+}
+
+// pa4: level-1 PTE pte1이 매핑한 (va를 포함하는) superpage를 4KB PTE
+// 512개로 쪼갬. pt는 새 L0 page table이 될 페이지: superpage 안의
+// frame이면 (그 내용은 호출자가 이미 챙김) 그 자리의 PTE는 keep이 됨.
+// 나머지 frame들은 각자 LRU에 올라감. pte1은 superpage_evict()가 잡아 둔
+// PTE_EVICT여도 됨. 그사이 uvmunmap()이 떼어 갔으면 -1
+static int
+superpage_split(pagetable_t pagetable, uint64 va, pte_t *pte1, char *pt, pte_t keep)
+{
+  uint64 base = EVICT2PA(*pte1);
+  uint64 blk = SUPERPGROUNDDOWN(va);
+  uint64 flags = PTE_FLAGS(*pte1) | PTE_V;
+  pagetable_t l0 = (pagetable_t)pt;
+  struct page *pg = PA2PG(base);
+
+  if (pg->in_lru)
+    lru_remove(pg, LRU_LOCKED);
+  for (int i = 0; i < 512; i++) {
+    uint64 pa = base + i * PGSIZE;
+    l0[i] = pa == (uint64)pt ? keep : PA2PTE(pa) | flags;
+  }
+  acquire(ptlock(pte1));
+  if (!(*pte1 & (PTE_V|PTE_EVICT))) {
+    release(ptlock(pte1));
+    return -1;
+  }
+  pg->super = 0;
+  PA2PG(pt)->is_page_table = 1;
+  PA2PG(pt)->vaddr = 0;
+  PA2PG(pt)->refcnt = 1;
+  *pte1 = PA2PTE(pt) | PTE_V;
+  tlb_flush_page(pagetable, blk);
+  release(ptlock(pte1));
+
+  for (int i = 0; i < 512; i++) {
+    uint64 pa = base + i * PGSIZE;
+    if (pa == (uint64)pt)
+      continue;
+    pg = PA2PG(pa);
+    pg->refcnt = 1;
+    pg->rmap = 0;
+    pg->readahead = 0;
+    pg->refill = 0;
+    pg->ip = 0;
+    pg->swapslot = -1;
+    pg->is_page_table = 0;
+    lru_add(pg, pagetable, blk + i * PGSIZE, LRU_LOCKED);
+  }
+
+  acquire(&swap_stats_lock.lock);
+  super_splits++;
+  release(&swap_stats_lock.lock);
+  return 0;
+}
+
+// Look up a virtual address, return the physical address,
+// or 0 if not mapped.
+// Can only be used to look up user pages.
+uint64
+walkaddr(pagetable_t pagetable, uint64 va)
+{
+  if (va >= MAXVA)
+    return 0;
+  pte_t *pte = walk(pagetable, va, 0);
+  // 스왑됐거나 아직 채워지지 않은 페이지면 fault처럼 처리
+  if (!pte || !(*pte & PTE_V)) {
+    if (vmfault(pagetable, va, 0) < 0)
+      return 0;
+    pte = walk(pagetable, va, 0);
+  }
+  if (!pte || !(*pte & PTE_V) || !(*pte & PTE_U)) return 0;
+  return pte2pa(*pte, va);
+}
+
+// pa4: VMA 중 va를 포함하는 것, 없으면 0
+static struct vma*
+vma_find(struct proc *p, uint64 va)
+{
+  for (struct vma *v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (v->end && va >= v->start && va < PGROUNDUP(v->end))
+      return v;
+  }
+  return 0;
+}
+
+// pa4: VMA v의 va 페이지를 처음 채움: 파일 부분은 읽고 나머지는 0.
+// 파일 내용이 없는 페이지를 읽기만 하면 zero page를 매핑함.
+// 쓰이지 않은 동안은 evictpage()가 swap 대신 버리도록 refill 표시.
+// 0, 메모리가 없거나 파일을 못 읽으면 -1
+static int
+vma_fill(pagetable_t pagetable, struct vma *v, uint64 va, int write)
+{
+  char *mem;
+  pte_t *pte;
+
+  if (!write && (v->ip == 0 || va - v->start >= v->filesz)) {
+    if ((pte = walk(pagetable, va, 1)) == 0)
+      return -1;
+    acquire(ptlock(pte));
+    *pte = zeropte(v->perm);
+    release(ptlock(pte));
+    return 0;
+  }
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  uint64 off = va - v->start;
+  if (v->ip && off < v->filesz) {
+    uint n = v->filesz - off < PGSIZE ? v->filesz - off : PGSIZE;
+    ilock(v->ip);
+    int r = readi(v->ip, 0, (uint64)mem, v->off + off, n);
+    iunlock(v->ip);
+    if (r != n) {
+      kfree(mem);
+      return -1;
+    }
+  }
+  PA2PG(mem)->refill = 1;
+  if (v->flags & MAP_SHARED) {
+    PA2PG(mem)->ip = v->ip;
+    PA2PG(mem)->fileoff = v->off + off;
+  }
+  if (mappages(pagetable, va, PGSIZE, (uint64)mem, v->perm) != 0) {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// pa4: handle a fault at va in pagetable: copy a COW page on a
+// store, swap in a swapped-out page, or fill in a page of one
+// of the current process's VMAs or of its lazily grown heap
+// that hasn't been touched yet.
+// shared by usertrap() and by copyin()/copyout(), which touch
+// user pages on the process's behalf.
+// returns 0 if the access can be retried, -1 if va is bad or
+// memory ran out.
+// the fault is counted as major or minor for vmstat() unless
+// the page was already there.
+int
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  int major = 0;
+  int r;
+
+  if (va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte_t *pte = walk(pagetable, va, 0);
+  if (pte && (*pte & PTE_V)) {
+    if (!(write && (*pte & PTE_COW))) {
+      if (!(*pte & PTE_U) || (write && !(*pte & PTE_W)))
+        return -1;
+      return 0;  // 이미 처리됨
+    }
+    r = cowfault(pagetable, va);
+  } else if (pte && (*pte & PTE_EVICT)) {
+    return evictwait(pte);
+  } else if (pte && (*pte & PTE_SWAP)) {
+    major = 1;
+    r = swapin(pagetable, va, pte);
+  } else if (pte && *pte) {
+    return -1;
+  } else {
+    r = vmfill(p, pagetable, va, write, &major);
+  }
+  if (r == 0) {
+    fault_account(p, pagetable, major);
+    if (p && p->pagetable == pagetable && p->rsslimit)
+      rss_enforce(p);
+  }
+  return r;
+}
+
+// pa4: vmfault() 중 PTE가 비어 있는 경우: 처음 건드렸거나
+// evictpage()가 버린 페이지를 VMA나 heap에서 채움.
+// 파일을 읽어야 하면 *major를 1로
+static int
+vmfill(struct proc *p, pagetable_t pagetable, uint64 va, int write, int *major)
+{
+  struct vma *v;
+
+  // 한 번도 채워지지 않았거나 evictpage()가 버린 페이지
+  if (p == 0 || p->pagetable != pagetable)
+    return -1;
+  if ((v = vma_find(p, va)) == 0) {
+    // sbrk()로 늘린 heap: 파일 없는 VMA처럼 0으로 채움
+    struct vma anon = { .perm = PTE_R | PTE_W | PTE_U };
+    if (va >= p->sz)
+      return -1;
+    // 2MB 전체가 heap이면 superpage로 한 번에 채워 봄
+    uint64 blk = SUPERPGROUNDDOWN(va);
+    if (write && blk + SUPERPGSIZE <= p->sz && !vma_busy(p, blk, blk + SUPERPGSIZE) &&
+        superfill(pagetable, blk, anon.perm) == 0)
+      return 0;
+    return vma_fill(pagetable, &anon, va, write);
+  }
+  if (write && !(v->perm & PTE_W))
+    return -1;
+  *major = v->ip && va - v->start < v->filesz;
+  return vma_fill(pagetable, v, va, write);
+}
+
+// pa4: vmstat()용 fault 수 (전체와 프로세스별)
+static void
+fault_account(struct proc *p, pagetable_t pagetable, int major)
+{
+  acquire(&swap_stats_lock.lock);
+  if (major)
+    major_faults++;
+  else
+    minor_faults++;
+  release(&swap_stats_lock.lock);
+  if (p && p->pagetable == pagetable) {
+    if (major)
+      p->majflt++;
+    else
+      p->minflt++;
+  }
+}
+
+// pa4: rsslimit(): p의 page table을 p->rsshand부터 clock으로 돌며
+// 자기 페이지 하나를 내보냄. PTE_A가 켜져 있으면 지우고 넘어가고,
+// 쓰인 MAP_SHARED 페이지는 kswapd 몫이니 건너뜀. 주소 공간을 두 번
+// 돌아도 없으면 0
+static int
+local_evict(struct proc *p)
+{
+  pagetable_t pagetable = p->pagetable;
+  uint64 va = p->rsshand, next;
+  int wraps = 0;
+
+  while (wraps < 2) {
+    if (va >= MAXVA) {
+      va = 0;
+      wraps++;
+      continue;
+    }
+    pte_t *pte = &pagetable[PX(2, va)];
+    if (!(*pte & PTE_V)) {
+      va = (va | ((1L << PXSHIFT(2)) - 1)) + 1;   // 1GB 건너뜀
+      continue;
+    }
+    pte = &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+    next = SUPERPGROUNDDOWN(va) + SUPERPGSIZE;
+    if ((*pte & PTE_V) && !(*pte & (PTE_R|PTE_W|PTE_X))) {
+      pte = &((pagetable_t)PTE2PA(*pte))[PX(0, va)];
+      next = va + PGSIZE;
+    }
+    va = next;
+    if (!(*pte & PTE_V) || !(*pte & PTE_U) || PTE2PA(*pte) == ZEROPAGE)
+      continue;
+    if ((*pte & PTE_A) && pte_clear_a(pte))
+      continue;                     // second chance
+    struct page *pg = PA2PG(PTE2PA(*pte));
+    acquire(&page_lock.lock);
+    int ok = pg->in_lru == 1 && (!pg->ip || !page_dirty(pg));
+    release(&page_lock.lock);
+    if (ok && evict(pg)) {
+      p->rsshand = va;
+      return 1;
+    }
+  }
+  p->rsshand = va;
+  return 0;
+}
+
+// pa4: fault로 페이지를 얻은 뒤 p->rss가 p->rsslimit을 넘으면 다시
+// 정확히 세고, 그래도 넘으면 전역 LRU 대신 p 자신의 페이지부터 내보냄.
+// 한 프로세스가 새는 메모리로 다른 프로세스의 hot 페이지를 밀어내지
+// 않게 함. p->rss는 다른 CPU의 eviction을 모르므로 넘을 때만 다시 셈
+static void
+rss_enforce(struct proc *p)
+{
+  struct vmstat st;
+
+  if (++p->rss <= p->rsslimit)
+    return;
+  memset(&st, 0, sizeof(st));
+  uvmstat(p->pagetable, &st);       // 자기 page table이라 lock 필요 없음
+  p->rss = st.rss;
+  while (p->rss > p->rsslimit && local_evict(p))
+    p->rss--;
+}
+
+// pa4: vmstat(): 시스템 전체 카운터를 st에 채움
+void
+vmstats(struct vmstat *st)
+{
+  st->freepages = num_free_pages;
+  acquire(&page_lock.lock);
+  acquire(&lru_lock.lock);
+  st->lrupages = num_lru_pages;
+  st->activepages = active_list.n;
+  st->scans = victim_scans;
+  st->scanned = victim_scanned;
+  release(&lru_lock.lock);
+  release(&page_lock.lock);
+
+  acquire(&swap_bitmap_lock.lock);
+  st->swapused = swap_used;
+  for (int i = 0; i < nswaparea; i++)
+    st->swapslots += swapareas[i].nslots;
+  release(&swap_bitmap_lock.lock);
+
+  acquire(&swap_stats_lock.lock);
+  st->minflt = minor_faults;
+  st->majflt = major_faults;
+  st->swapins = swap_in_count;
+  st->swapouts = swap_out_count;
+  st->swapra = swap_ra_pages;
+  st->swaprahits = swap_ra_hits;
+  st->cleanevicts = swap_clean_evicts;
+  st->refilldrops = refill_drops;
+  st->zerodrops = zero_drops;
+  st->mmapwrites = mmap_writebacks;
+  st->superpages = super_maps;
+  st->ptreclaims = pt_reclaims;
+  st->wsprefetch = ws_prefetched;
+  release(&swap_stats_lock.lock);
+  zswapstats(st);
+  slabstats(st);
+}
+
+// pa4: pt 아래의 user 페이지 중 resident(zero page 제외)와
+// swap된 것을 셈. level은 pt의 level
+static void
+uvmstat1(pagetable_t pt, int level, struct vmstat *st)
+{
+  for (int i = 0; i < 512; i++) {
+    pte_t pte = pt[i];
+    if ((pte & PTE_V) && !(pte & (PTE_R|PTE_W|PTE_X))) {
+      if (level > 0)
+        uvmstat1((pagetable_t)PTE2PA(pte), level - 1, st);
+    } else if (pte & PTE_V) {
+      if ((pte & PTE_U) && PTE2PA(pte) != ZEROPAGE)
+        st->rss += level ? SUPERPGSIZE / PGSIZE : 1;
+    } else if (pte & PTE_SWAP) {
+      st->swapped++;
+    }
+  }
+}
+
+// pa4: vmstat(): pagetable의 resident/swap된 페이지 수를 st에 채움.
+// 다른 프로세스의 것이면 그 p->lock을 잡고 호출
+void
+uvmstat(pagetable_t pagetable, struct vmstat *st)
+{
+  uvmstat1(pagetable, 2, st);
+}
+
+// pa4: fork: 자식이 부모의 VMA를 물려받음 (inode 참조 증가).
+// mmap 영역은 uvmcopy()가 다루는 [0, sz) 밖이므로 페이지도 여기서
+// 넘겨줌: MAP_SHARED는 같은 페이지를 쓰기 가능한 채로 공유하고
+// MAP_PRIVATE는 COW. 0, 메모리가 없으면 복사한 것을 되돌리고 -1
+int
+vmacopy(pagetable_t old, pagetable_t new, struct vma *dst, struct vma *src)
+{
+  int i;
+
+  for (i = 0; i < NVMA; i++) {
+    struct vma *v = &src[i];
+    if (v->flags && uvmcopyrange(old, new, v->start, v->end, v->flags & MAP_SHARED) < 0)
+      goto err;
+  }
+  for (i = 0; i < NVMA; i++) {
+    dst[i] = src[i];
+    if (dst[i].ip)
+      idup(dst[i].ip);
+  }
+  return 0;
+
+ err:
+  while (--i >= 0)
+    if (src[i].flags)
+      uvmunmap(new, src[i].start, (src[i].end - src[i].start) / PGSIZE, 1);
+  return -1;
+}
+
+// pa4: VMA를 모두 비우고 inode 참조를 놓음. iput() 때문에
+// transaction 안에서 호출. mmap 영역은 먼저 vmaunmapall()로 떼어 둠
+void
+vmafree(struct vma *vma)
+{
+  for (int i = 0; i < NVMA; i++) {
+    if (vma[i].ip)
+      iput(vma[i].ip);
+    memset(&vma[i], 0, sizeof(vma[i]));
+  }
+}
+
+// pa4: MAP_SHARED 페이지 pa를 파일의 off 위치에 씀. 파일 크기는 늘리지
+// 않음. transaction과 ip의 락을 잡고 호출
+static void
+pagewritei(struct inode *ip, uint off, uint64 pa)
+{
+  if (off < ip->size) {
+    uint n = ip->size - off < PGSIZE ? ip->size - off : PGSIZE;
+    writei(ip, 0, pa, off, n);
+  }
+}
+
+// pagewritei()와 같지만 transaction과 inode 락을 스스로 잡음
+static void
+pagewrite(struct inode *ip, uint off, uint64 pa)
+{
+  begin_op();
+  ilock(ip);
+  pagewritei(ip, off, pa);
+  iunlock(ip);
+  end_op();
+}
+
+// pa4: mmap 영역 v의 [start, end)를 떼어냄. MAP_SHARED면 이 매핑으로
+// 쓰인(PTE_D) 페이지를 먼저 파일에 씀
+static void
+vma_unmap(pagetable_t pagetable, struct vma *v, uint64 start, uint64 end)
+{
+  if (v->flags & MAP_SHARED) {
+    for (uint64 a = start; a < end; a += PGSIZE) {
+      pte_t *pte = walk(pagetable, a, 0);
+      if (pte && (*pte & PTE_V) && (*pte & PTE_D) && PTE2PA(*pte) != ZEROPAGE)
+        pagewrite(v->ip, v->off + (a - v->start), PTE2PA(*pte));
+    }
+  }
+  uvmunmap(pagetable, start, (end - start) / PGSIZE, 1);
+}
+
+// pa4: [start, end)와 겹치는 VMA, 없으면 0
+static struct vma*
+vma_busy(struct proc *p, uint64 start, uint64 end)
+{
+  for (struct vma *v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (v->end && v->start < end && PGROUNDUP(v->end) > start)
+      return v;
+  }
+  return 0;
+}
+
+// pa4: mmap(): nv(ip, off, filesz, perm, flags가 채워진)를 len 바이트
+// 크기로 p의 주소 공간에 넣음. addr가 비어 있으면 거기에, 아니면
+// RING 아래에서부터 heap(sz) 쪽으로 빈 곳을 찾음.
+// 페이지는 처음 건드릴 때 vma_fill()이 읽어 옴. 주소, 실패하면 -1
+uint64
+vmamap(struct proc *p, uint64 addr, uint64 len, struct vma *nv)
+{
+  struct vma *v, *slot = 0;
+  uint64 base = PGROUNDUP(p->sz);
+
+  len = PGROUNDUP(len);
+  if (len == 0 || len > RING - base)
+    return -1;
+  for (v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (v->end == 0) {
+      slot = v;
+      break;
+    }
+  }
+  if (slot == 0)
+    return -1;
+
+  if (addr % PGSIZE || addr < base || addr > RING - len || vma_busy(p, addr, addr + len)) {
+    addr = RING - len;
+    while ((v = vma_busy(p, addr, addr + len)) != 0) {
+      if (v->start < base + len)
+        return -1;
+      addr = v->start - len;
+    }
+  }
+  *slot = *nv;
+  slot->start = addr;
+  slot->end = addr + len;
+  idup(slot->ip);
+  return addr;
+}
+
+// pa4: munmap(): [addr, addr+len)에 걸친 mmap 영역을 떼어냄.
+// 영역의 앞이나 뒤, 또는 전체만 뗄 수 있고 가운데에 구멍을 내면 -1
+int
+vmaunmap(struct proc *p, uint64 addr, uint64 len)
+{
+  uint64 end = PGROUNDUP(addr + len);
+  struct vma *v;
+
+  if (addr % PGSIZE || end < addr || end > RING)
+    return -1;
+  for (v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (v->flags && v->start < end && v->end > addr &&
+        v->start < addr && v->end > end)
+      return -1;
+  }
+  for (v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (!v->flags || v->start >= end || v->end <= addr)
+      continue;
+    uint64 s = addr > v->start ? addr : v->start;
+    uint64 e = end < v->end ? end : v->end;
+    vma_unmap(p->pagetable, v, s, e);
+    if (s == v->start) {
+      v->filesz = v->filesz > e - s ? v->filesz - (e - s) : 0;
+      v->off += e - s;
+      v->start = e;
+    } else {
+      if (v->filesz > s - v->start)
+        v->filesz = s - v->start;
+      v->end = s;
+    }
+    if (v->start == v->end) {
+      begin_op();
+      iput(v->ip);
+      end_op();
+      memset(v, 0, sizeof(*v));
+    }
+  }
+  return 0;
+}
+
+// pa4: exit()/exec(): mmap 영역을 모두 떼어냄. inode 참조는 뒤이은
+// vmafree()가 놓음. transaction 밖에서 호출
+void
+vmaunmapall(struct proc *p)
+{
+  for (struct vma *v = p->vma; v < &p->vma[NVMA]; v++) {
+    if (v->flags)
+      vma_unmap(p->pagetable, v, v->start, v->end);
+  }
+}
+
+// pa4: madvise(): p의 [addr, addr+len)에 대한 힌트 advice.
+// DONTNEED: 페이지를 버림. 다음에 건드리면 heap은 0으로, 파일 VMA는
+//   파일에서 다시 채워짐. 스왑된 페이지는 슬롯만 반환하고, 쓰인
+//   MAP_SHARED 페이지는 먼저 파일에 씀.
+// WILLNEED: 스왑된 페이지와 아직 안 읽은 파일 페이지를 지금 읽어 둠.
+//   다른 페이지를 밀어내면서까지 읽지는 않음.
+// COLD: 있는 페이지의 PTE_A를 지우고 inactive head로 옮겨 먼저 내보냄.
+// 범위는 heap이나 VMA 안이어야 함. 0, 잘못된 인자면 -1
+int
+vmadvise(struct proc *p, uint64 addr, uint64 len, int advice)
+{
+  uint64 end = addr + len, hend = PGROUNDUP(p->sz), a;
+  struct vma *v;
+  pte_t *pte;
+  int n;
+
+  if (addr % PGSIZE || len == 0 || end < addr || end > MAXVA)
+    return -1;
+  if (advice != MADV_DONTNEED && advice != MADV_WILLNEED && advice != MADV_COLD)
+    return -1;
+  end = PGROUNDUP(end);
+  for (a = addr; a < end; a += PGSIZE)
+    if (a >= hend && vma_find(p, a) == 0)
+      return -1;
+
+  if (advice == MADV_DONTNEED) {
+    if (addr < hend)
+      uvmunmap(p->pagetable, addr, ((end < hend ? end : hend) - addr) / PGSIZE, 1);
+    for (v = p->vma; v < &p->vma[NVMA]; v++) {
+      uint64 s = v->start > addr ? v->start : addr;
+      uint64 e = PGROUNDUP(v->end) < end ? PGROUNDUP(v->end) : end;
+      if (v->end && s < e)
+        vma_unmap(p->pagetable, v, s, e);
+    }
+    return 0;
+  }
+
+  for (a = addr; a < end; a += PGSIZE) {
+    pte = walk(p->pagetable, a, 0);
+    if (advice == MADV_COLD) {
+      // L0 page table이 없으면 그 2MB에는 있는 페이지가 없음
+      if (pte == 0) {
+        a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      acquire(ptlock(pte));
+      uint64 pa = PTE2PA(*pte);
+      int cold = (*pte & PTE_V) && !pte_super(*pte) && pa != ZEROPAGE;
+      if (cold)
+        pte_clear_a(pte);
+      release(ptlock(pte));
+      if (cold)
+        lru_cold(PA2PG(pa));
+      continue;
+    }
+
+    // WILLNEED
+    if (num_free_pages < KSWAPD_LOW)
+      break;
+    if (pte && !(*pte & PTE_V) && (*pte & PTE_SWAP)) {
+      int win = (end - a) / PGSIZE - 1;
+      if ((n = swapin_pages(p->pagetable, a, pte, win < SWAP_RA_MAX ? win : SWAP_RA_MAX, 0)) < 0)
+        break;
+      acquire(&swap_stats_lock.lock);
+      swap_ra_pages += n;
+      release(&swap_stats_lock.lock);
+      a += (n - 1) * PGSIZE;
+    } else if ((pte == 0 || *pte == 0) && (v = vma_find(p, a)) != 0 &&
+               v->ip && a - v->start < v->filesz) {
+      if (vma_fill(p->pagetable, v, a, 0) < 0)
+        break;
+    }
+  }
+  return 0;
+}
+
+// add a mapping to the kernel page table.
+// only used when booting.
+// does not flush TLB or enable paging.
+void
+kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
+{
+  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
+    panic("kvmmap");
+}
+
+// Create PTEs for virtual addresses starting at va that refer to
+// physical addresses starting at pa.
+// va and size MUST be page-aligned.
+// Returns 0 on success, -1 if walk() couldn't
+// allocate a needed page-table page.
+int
+mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a, last;
+  pte_t *pte;
+  struct tlbbatch tb;
+
+  if((va % PGSIZE) != 0)
+    panic("mappages: va not aligned");
+
+  if((size % PGSIZE) != 0)
+    panic("mappages: size not aligned");
+
+  if(size == 0)
+    panic("mappages: size");
+  
+  a = va;
+  last = va + size - PGSIZE;
+  tb.n = 0;
+  for(;;){
+    if((pte = walk(pagetable, a, 1)) == 0){
+      tlb_flush(&tb);
+      return -1;
+    }
+    if(*pte & PTE_V)
+      panic("mappages: remap");
+    
+    // printf("[MAPPAGES] va=0x%lx pa=0x%lx perm=0x%x (R=%d W=%d X=%d U=%d)\n", 
+    //        a, pa, perm,
+    //        (perm & PTE_R) != 0,
+    //        (perm & PTE_W) != 0,
+    //        (perm & PTE_X) != 0,
     //        (perm & PTE_U) != 0);
     
-    acquire(&pte_lock.lock);
+    acquire(ptlock(pte));
     *pte = PA2PTE(pa) | perm | PTE_V;
-    sfence_vma();
-    release(&pte_lock.lock);
+    tlb_add(&tb, pagetable, a);
+    release(ptlock(pte));
     
     if (perm & PTE_U) { // 사용자 페이지만 스왑 대상
-      struct page *pg = &pages[pa/PGSIZE];
+      struct page *pg = PA2PG(pa);
       if (!pg->in_lru && !pg->is_page_table && a < MAXVA) {
         // printf("[MAP] Adding page to LRU: pa=0x%lx, va=0x%lx\n", pa, a);
         lru_add(pg, pagetable, a, LRU_LOCKED);
@@ -434,31 +1849,87 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     a += PGSIZE;
     pa += PGSIZE;
   }
+  tlb_flush(&tb);
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. Pages that were never filled in are skipped,
+// a missing page-table page's 2MB at a time, so the cost is
+// in the entries that are there rather than the size of the
+// range. Swapped-out pages give back their swap slots without
+// any disk I/O. Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
+  struct tlbbatch tb;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
+  tb.n = 0;
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    // 아직 채워지지 않은 VMA 페이지는 PTE가 없음.
+    // L0 page table이 없으면 그 2MB는 통째로 건너뜀
+    if((pte = walk(pagetable, a, 0)) == 0){
+      a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if(*pte == 0)
+      continue;
+    // evict()가 내보내는 중: 이 매핑만 떼고 페이지는 evict()가 free.
+    // superpage를 일부만 떼려면 다 내보낼 때까지 기다림 (sbrk()로 줄일 때뿐)
+    if(*pte & PTE_EVICT){
+      int super = PA2PG(EVICT2PA(*pte))->super;
+      if(super && (a % SUPERPGSIZE || a + SUPERPGSIZE > va + npages*PGSIZE))
+        evictwait(pte);
+      else if(evict_unmap(pagetable, a, pte) && super)
+        a += SUPERPGSIZE;
+      a -= PGSIZE;             // 바뀐 PTE를 다시 봄
+      continue;
+    }
+    if(pte_super(*pte)){
+      uint64 base = PTE2PA(*pte);
+      if(a % SUPERPGSIZE == 0 && a + SUPERPGSIZE <= va + npages*PGSIZE){
+        // superpage 전체를 뗌
+        if(do_free){
+          if(PA2PG(base)->in_lru)
+            lru_remove(PA2PG(base), LRU_LOCKED);
+          superfree((void*)base);
+        }
+        acquire(ptlock(pte));
+        *pte = 0;
+        tlb_add(&tb, pagetable, a);
+        release(ptlock(pte));
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      // 일부만 뗌: 떼어낼 a의 frame을 새 L0 page table로 씀
+      if(!do_free)
+        panic("uvmunmap: part of superpage");
+      superpage_split(pagetable, a, pte, (char*)(base + (a & (SUPERPGSIZE - 1))), 0);
+      continue;
+    }
+    if((*pte & PTE_V) == 0){
+      // 스왑된 페이지: PTE가 가진 슬롯 참조만 반환
+      if(!(*pte & PTE_SWAP))
+        panic("uvmunmap: not mapped");
+      freeswap(PTE2PPN(*pte));
+      goto clear;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      struct page *pg = &pages[pa / PGSIZE];
+      struct page *pg = PA2PG(pa);
+      if (pa == ZEROPAGE)
+        goto clear;
+      // COW로 공유 중이면 이 매핑만 떼어내고 페이지는 남김
+      if (page_unshare(pg, pagetable, a))
+        goto clear;
+      ra_account(pg, (*pte & PTE_A) != 0);
       if (pg->vaddr == 0) {
         // printf("[UNMAP] Warning: page at pa=0x%lx has null vaddr\n", pa);
       } else if ((uint64)pg->vaddr >= MAXVA) {
@@ -470,15 +1941,79 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
         pg->vaddr = 0;    // 깔끔하게 vaddr도 초기화
       }
       kfree((void*)pa);
-    } else if (*pte & PTE_SWAP) {
-      // free swap block
-      int blkno = PTE2PPN(*pte);
-      freeswap(blkno); // 스왑 페이지 비트맵 클리어
     }
-    acquire(&pte_lock.lock);
+  clear:
+    acquire(ptlock(pte));
     *pte = 0;
-    sfence_vma();
-    release(&pte_lock.lock);
+    tlb_add(&tb, pagetable, a);
+    release(ptlock(pte));
+  }
+  tlb_flush(&tb);
+  ptreclaim(pagetable, va, va + npages*PGSIZE);
+}
+
+// pa4: page table page pt가 비었는지
+static int
+ptempty(pagetable_t pt)
+{
+  for (int i = 0; i < 512; i++)
+    if (pt[i])
+      return 0;
+  return 1;
+}
+
+// pa4: pte가 가리키는 빈 page table page를 떼어내 free.
+// 자기 page table이면 vmstat()이 걷는 중일 수 있으므로 p->lock을 잡음
+static void
+ptfree(pagetable_t pagetable, pte_t *pte)
+{
+  pagetable_t pt = (pagetable_t)PTE2PA(*pte);
+  struct proc *p = myproc();
+  int locked = p && p->pagetable == pagetable;
+
+  if (locked)
+    acquire(&p->lock);
+  acquire(ptlock(pte));
+  *pte = 0;
+  tlb_flush_page(pagetable, 0);   // user page table: va는 쓰지 않음
+  release(ptlock(pte));
+  if (locked)
+    release(&p->lock);
+  PA2PG(pt)->is_page_table = 0;
+  PA2PG(pt)->vaddr = 0;
+  kfree((void*)pt);
+
+  acquire(&swap_stats_lock.lock);
+  pt_reclaims++;
+  release(&swap_stats_lock.lock);
+}
+
+// pa4: uvmunmap() 뒤 [start, end)에 걸친 L0 page table 중 비어 버린
+// 것을 free하고, 그래서 빈 L1 page table도 free. PTE_SWAP이 남은
+// table은 비지 않았으므로 그대로 둠. 이렇게 하지 않으면 sbrk()로
+// 줄이거나 munmap()한 영역의 page table이 exit까지 남음
+static void
+ptreclaim(pagetable_t pagetable, uint64 start, uint64 end)
+{
+  uint64 a = SUPERPGROUNDDOWN(start);
+
+  while (a < end) {
+    pte_t *pte2 = &pagetable[PX(2, a)];
+    uint64 next1g = (PX(2, a) + 1L) << PXSHIFT(2);
+    if (!(*pte2 & PTE_V)) {
+      a = next1g;
+      continue;
+    }
+    pagetable_t l1 = (pagetable_t)PTE2PA(*pte2);
+    for (; a < end && a < next1g; a += SUPERPGSIZE) {
+      pte_t *pte1 = &l1[PX(1, a)];
+      if ((*pte1 & PTE_V) && !(*pte1 & (PTE_R|PTE_W|PTE_X)) &&
+          ptempty((pagetable_t)PTE2PA(*pte1)))
+        ptfree(pagetable, pte1);
+    }
+    if (ptempty(l1))
+      ptfree(pagetable, pte2);
+    a = next1g;
   }
 }
 
@@ -508,7 +2043,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
   mem = kalloc();
   memset(mem, 0, PGSIZE);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
-  struct page *pg = &pages[(uint64)mem/PGSIZE];
+  struct page *pg = PA2PG(mem);
   // user 코드 페이지(va=0)는 예외적으로 허용
   if (!pg->is_page_table) {
     // printf("[FIRST] Adding first page to LRU: pa=0x%lx, va=0x0\n", (uint64)mem);
@@ -530,6 +2065,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
+    if(a % SUPERPGSIZE == 0 && newsz - a >= SUPERPGSIZE &&
+       superfill(pagetable, a, PTE_R|PTE_W|PTE_U|xperm) == 0){
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
     mem = kalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
@@ -582,7 +2122,7 @@ freewalk(pagetable_t pagetable)
     }
   }
   // 페이지 테이블 페이지 해제 시 플래그 초기화
-  struct page *pg = &pages[((uint64)pagetable - KERNBASE) / PGSIZE];
+  struct page *pg = PA2PG(pagetable);
   pg->is_page_table = 0;
   pg->vaddr = 0;
   kfree((void*)pagetable);
@@ -600,57 +2140,120 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// pa4: resident pages are shared copy-on-write: both PTEs
+// lose PTE_W and get PTE_COW, and the page's refcnt and rmap
+// record the child's mapping. The first store through either
+// PTE copies the page (see cowfault()).
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// pa4: uvmcopy() for [start, end). with share, pages stay
+// writable in both page tables instead of becoming COW
+// (MAP_SHARED mmap regions).
+static int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int share)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    // 채워지지 않은 VMA 페이지: 자식도 자기 VMA에서 채움
+    if((pte = walk(old, i, 0)) == 0 || *pte == 0)
+      continue;
+
+    // superpage는 쪼갠 뒤 4KB씩 COW로 공유
+    if(pte_super(*pte)){
+      if((mem = kalloc()) == 0)
+        goto err;
+      superpage_split(old, i, pte, mem, 0);
+      pte = walk(old, i, 0);
+    }
     
-    // 스왑된 페이지 처리
+    // 스왑된 페이지: 읽어오지 않고 자식 PTE가 같은 슬롯을 가리키게 함.
+    // 슬롯 refcnt를 하나 올리고, 실제 읽기는 각 프로세스가 fault 낼 때
+    // 따로 일어나므로 swap-in 된 사본은 각자 private
     if((*pte & PTE_V) == 0 && (*pte & PTE_SWAP)) {
-      // printf("[COPY] Found swapped page at va: 0x%lx, pte: 0x%lx\n", i, *pte);
-      // 1. 새 물리 페이지 할당
-      if((mem = kalloc()) == 0)
+      if((npte = walk(new, i, 1)) == 0)
         goto err;
-      
-      // 2. 스왑에서 읽어오기
-      int blkno = PTE2PPN(*pte);
-      swapread((uint64)mem, blkno);
-      // printf("[COPY] Swapped page read: va: 0x%lx, blk: %d, mem: 0x%lx\n", i, blkno, (uint64)mem);
-      
-      // 3. 자식에 매핑 (부모 PTE는 그대로 둠)
-      flags = PTE_FLAGS(*pte) & (PTE_R|PTE_W|PTE_X|PTE_U);
-      if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){ 
-        kfree(mem);
+      ptlock2(pte, npte);
+      dupswap(PTE2PPN(*pte));
+      *npte = *pte;
+      ptunlock2(pte, npte);
+      continue;
+    }
+
+    // evict()가 내보내는 중인 페이지: 자식 PTE도 같은 표시로 rmap에
+    // 올려 page_release()가 함께 마무리하게 함. 그사이 끝났으면 다시 봄
+    if((*pte & PTE_V) == 0 && (*pte & PTE_EVICT)) {
+      struct page *hp = PA2PG(EVICT2PA(*pte));
+      if(hp->super || (npte = walk(new, i, 1)) == 0)
         goto err;
+      acquire(&page_lock.lock);
+      ptlock2(pte, npte);
+      int held = (*pte & PTE_EVICT) != 0;
+      ptunlock2(pte, npte);
+      if(held && rmap_add(hp, new, i, npte) != 0){
+        release(&page_lock.lock);
+        goto err;
+      }
+      if(held){
+        hp->refcnt++;
+        ptlock2(pte, npte);
+        if(!share && (*pte & PTE_W))
+          *pte = (*pte & ~PTE_W) | PTE_COW;
+        *npte = *pte & ~PTE_A;
+        ptunlock2(pte, npte);
       }
+      release(&page_lock.lock);
+      if(!held)
+        i -= PGSIZE;
       continue;
     }
     
-    // 일반 페이지 처리 (기존 로직)
     if((*pte & PTE_V) == 0)
       panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    
-    // 원본 페이지의 vaddr 검사
-    struct page *old_pg = &pages[pa/PGSIZE];
-    if (old_pg->vaddr == 0) {
-      // printf("[COPY] Warning: source page at pa=0x%lx has null vaddr\n", pa);
-    } else if ((uint64)old_pg->vaddr >= MAXVA) {
-      // printf("[COPY] Warning: source page at pa=0x%lx has invalid vaddr=0x%lx\n", pa, (uint64)old_pg->vaddr);
+    struct page *pg = PA2PG(pa);
+
+    if((npte = walk(new, i, 1)) == 0)
+      goto err;
+
+    // zero page는 이미 읽기 전용이므로 PTE만 복사
+    if(pa == ZEROPAGE){
+      *npte = *pte & ~(PTE_A|PTE_D);
+      continue;
     }
-    
+
+    // COW 공유: 부모/자식 모두 쓰기 금지 + PTE_COW
+    acquire(&page_lock.lock);
+    if(rmap_add(pg, new, i, npte) == 0){
+      pg->refcnt++;
+      ptlock2(pte, npte);
+      if(!share && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      // PTE_D는 남김: 부모가 COW로 떠나거나 exit하면 자식 PTE만 남는데,
+      // evict()의 refill drop과 swap cache 재사용은 page_hold()가 모은
+      // PTE_D로, page_referenced()는 page_dirty()로 이 페이지가 쓰였는지 봄
+      *npte = *pte & ~PTE_A;
+      ptunlock2(pte, npte);
+      release(&page_lock.lock);
+      continue;
+    }
+    release(&page_lock.lock);
+    if(share)
+      goto err;
+
+    // rmap pool이 바닥나면 예전처럼 바로 복사
+    flags = PTE_FLAGS(*pte) & ~(PTE_COW|PTE_A|PTE_D);
+    if(*pte & PTE_COW)
+      flags |= PTE_W;
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -659,13 +2262,95 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       goto err;
     }
   }
+  // 부모 PTE에서 PTE_W를 뺐으므로 부모로 도는 hart의 TLB를 비움
+  tlb_flush_page(old, start);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  tlb_flush_page(old, start);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
+// pa4: handle a store to a copy-on-write page at va.
+// if the page is still shared, give this pagetable a private
+// copy; if this is the last mapping, just make it writable.
+// returns 0 if the store can be retried, -1 if va is not a
+// COW page or memory ran out.
+int
+cowfault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem = 0;
+  struct page *pg;
+
+  va = PGROUNDDOWN(va);
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  pg = PA2PG(pa);
+
+  // zero page에 처음 쓰기: 새 0 페이지를 줌
+  if(pa == ZEROPAGE){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    acquire(ptlock(pte));
+    *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~(PTE_COW|PTE_A|PTE_D));
+    tlb_flush_page(pagetable, va);
+    release(ptlock(pte));
+    lru_add(PA2PG(mem), pagetable, va, LRU_LOCKED);
+    return 0;
+  }
+
+  // 아직 공유 중이면 락 밖에서 사본 페이지를 미리 할당
+  // (kalloc이 eviction을 하면서 page_lock을 잡을 수 있음)
+  if(pg->refcnt > 1 && (mem = kalloc()) == 0)
+    return -1;
+
+  acquire(&page_lock.lock);
+  // kalloc 도중 이 페이지가 swap out 됐으면 다시 fault 나게 둠
+  if((*pte & PTE_V) == 0 || PTE2PA(*pte) != pa){
+    release(&page_lock.lock);
+    if(mem)
+      kfree(mem);
+    return 0;
+  }
+
+  if(pg->refcnt == 1){
+    // 마지막 매핑: 복사 없이 쓰기 권한만 복구
+    acquire(ptlock(pte));
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+    tlb_flush_page(pagetable, va);
+    release(ptlock(pte));
+    release(&page_lock.lock);
+    if(mem)
+      kfree(mem);
+    return 0;
+  }
+  if(mem == 0){
+    // 락 밖에서 본 refcnt는 1이었는데 그 사이 다시 공유됨
+    release(&page_lock.lock);
+    return 0;
+  }
+
+  memmove(mem, (char*)pa, PGSIZE);
+  rmap_remove(pg, pagetable, va);
+  pg->refcnt--;
+  acquire(ptlock(pte));
+  *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~(PTE_COW|PTE_D));
+  tlb_flush_page(pagetable, va);
+  release(ptlock(pte));
+  release(&page_lock.lock);
+
+  lru_add(PA2PG(mem), pagetable, va, LRU_LOCKED);
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -679,6 +2364,35 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// pa4: copyin()/copyout()/copyinstr()이 여러 페이지를 옮길 때 va0의
+// PTE. 바로 앞 페이지의 PTE가 같은 L0 page table에 있었으면(*last)
+// 그 다음 칸이므로 walk하지 않음. superpage는 쪼개질 수 있으므로
+// 캐시하지 않음
+static pte_t*
+copypte(pagetable_t pagetable, uint64 va0, pte_t **last)
+{
+  if(*last && PX(0, va0) != 0)
+    return *last + 1;
+  return walk(pagetable, va0, 0);
+}
+
+// pa4: copypte()의 다음 호출을 위해 pte를 기억함
+static void
+copypte_keep(pte_t *pte, pte_t **last)
+{
+  *last = pte_super(*pte) ? 0 : pte;
+}
+
+// pa4: readi()/writei()가 inode 락을 잡고 사용자 페이지를 복사하는 중.
+// 그때의 fault는 vma_fill()에서 inode 락을 또 잡을 수 있으므로 copyin()과
+// copyout()은 fault를 내지 않고 실패함
+static int
+nofault(void)
+{
+  struct proc *p = myproc();
+  return p && p->nofault;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -686,21 +2400,39 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
-  pte_t *pte;
+  pte_t *pte, *last = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     if(va0 >= MAXVA)
       return -1;
-    pte = walk(pagetable, va0, 0);
+    pte = copypte(pagetable, va0, &last);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_COW)){
+      // 스왑됐거나 채워지지 않았거나 COW인 페이지.
+      // readi()/writei()는 inode 락을 놓고 fault를 냄 (userfault())
+      if(nofault() || vmfault(pagetable, va0, 1) < 0)
+        return -1;
+      pte = walk(pagetable, va0, 0);
+    }
     if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
        (*pte & PTE_W) == 0)
       return -1;
-    pa0 = PTE2PA(*pte);
+    // 커널이 쓴 것도 swap cache가 알 수 있도록 PTE_D를 켬. ptlock을 쥔 채
+    // 다시 보고 쓰므로 evict()의 page_hold()는 이 쓰기 전이나 뒤에만 옴
+    acquire(ptlock(pte));
+    if((*pte & (PTE_V|PTE_U|PTE_W|PTE_COW)) != (PTE_V|PTE_U|PTE_W)){
+      release(ptlock(pte));       // 그사이 evict()가 잡아 감: 다시 fault
+      last = 0;
+      continue;
+    }
+    __atomic_fetch_or(pte, PTE_D, __ATOMIC_SEQ_CST);
+    copypte_keep(pte, &last);
+    pa0 = pte2pa(*pte, va0);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    release(ptlock(pte));
 
     len -= n;
     src += n;
@@ -709,6 +2441,24 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
   return 0;
 }
 
+// pa4: walkaddr()와 같지만 copypte()로 PTE를 찾음
+static uint64
+copyaddr(pagetable_t pagetable, uint64 va0, pte_t **last)
+{
+  if (va0 >= MAXVA)
+    return 0;
+  pte_t *pte = copypte(pagetable, va0, last);
+  if (!pte || !(*pte & PTE_V)) {
+    if (nofault() || vmfault(pagetable, va0, 0) < 0)
+      return 0;
+    pte = walk(pagetable, va0, 0);
+  }
+  if (!pte || !(*pte & PTE_V) || !(*pte & PTE_U))
+    return 0;
+  copypte_keep(pte, last);
+  return pte2pa(*pte, va0);
+}
+
 // Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
 // Return 0 on success, -1 on error.
@@ -716,10 +2466,11 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *last = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = copyaddr(pagetable, va0, &last);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -743,10 +2494,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  pte_t *last = 0;
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = copyaddr(pagetable, va0, &last);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -755,6 +2507,18 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
     char *p = (char *) (pa0 + (srcva - va0));
     while(n > 0){
+      // pa4: 둘 다 8바이트 정렬돼 있으면 NUL이 없는 word는 통째로 복사
+      if(n >= 8 && (((uint64)p | (uint64)dst) & 7) == 0){
+        uint64 w = *(uint64*)p;
+        if(((w - 0x0101010101010101UL) & ~w & 0x8080808080808080UL) == 0){
+          *(uint64*)dst = w;
+          n -= 8;
+          max -= 8;
+          p += 8;
+          dst += 8;
+          continue;
+        }
+      }
       if(*p == '\0'){
         *dst = '\0';
         got_null = 1;
@@ -777,90 +2541,472 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
-// Clock 알고리즘을 위한 전역 변수
-static struct page *clock_hand = 0;
+// pg를 매핑한 PTE 중 하나라도 PTE_D가 켜져 있으면 1.
+// page_lock을 잡고 호출
+static int
+page_dirty(struct page *pg)
+{
+  pte_t *pte = pg->pte;
+  if (pte && (*pte & PTE_V) && (*pte & PTE_D))
+    return 1;
+  for (struct rmap *r = pg->rmap; r; r = r->next) {
+    pte = r->pte;
+    if (pte && (*pte & PTE_V) && (*pte & PTE_D))
+      return 1;
+  }
+  return 0;
+}
+
+// pg를 매핑한 모든 PTE(대표 매핑 + rmap)의 PTE_A를 검사하고 지움.
+// 하나라도 참조됐으면 1. 대표 매핑이 present가 아니면 -1.
+// page_lock을 잡고 호출
+static int
+page_referenced(struct page *pg)
+{
+  int ref = 0;
+
+  if ((uint64)pg->vaddr >= MAXVA)
+    return -1;
+  pte_t *pte = pg->pte;
+  if (!pte || !(*pte & PTE_V))
+    return -1;
+  if ((*pte & PTE_A) && pte_clear_a(pte))  // 참조 비트 클리어
+    ref = 1;
+  for (struct rmap *r = pg->rmap; r; r = r->next) {
+    pte = r->pte;
+    if (pte && (*pte & PTE_V) && (*pte & PTE_A) && pte_clear_a(pte))
+      ref = 1;
+  }
+  // 이미 쓰인 페이지의 swap cache 슬롯은 낡았으므로 미리 반환
+  if (pg->swapslot >= 0 && page_dirty(pg)) {
+    freeswap(pg->swapslot);
+    pg->swapslot = -1;
+  }
+  return ref;
+}
+
+// inactive가 전체의 1/3보다 작으면 active head부터 최대 LRU_REFILL개를
+// 살펴, 그동안 참조 안 된 페이지를 inactive tail로 내림.
+// 참조된 페이지는 active tail로 돌림. 두 락을 잡고 호출
+static void
+refill_inactive(void)
+{
+  for (int n = 0; n < LRU_REFILL && active_list.head &&
+         inactive_list.n * 2 < active_list.n; n++) {
+    struct page *p = active_list.head;
+    int ref = page_referenced(p);
+    list_unlink(p);
+    if (ref == 1) {
+      list_append(&active_list, p);
+    } else {
+      p->active = 0;
+      p->referenced = 0;
+      list_append(&inactive_list, p);
+    }
+  }
+}
 
-// Choose a victim page using Clock algorithm
+// Choose a victim page from the head of the inactive list.
+// 참조된 inactive 페이지는 처음이면 inactive tail로 한 번 더 기회를 주고,
+// 두 번째면 active로 올림. 참조 안 된 페이지가 victim.
 // Returns pointer to struct page, or NULL if none
 struct page*
 select_victim(void)
 {
+  struct page *victim = 0;
+
+  // 다른 CPU의 pagevec에 대기 중인 페이지도 후보가 되도록
+  lru_drain_all();
+
   // 락 획득 순서: page_lock -> lru_lock
   acquire(&page_lock.lock);
   acquire(&lru_lock.lock);
 
-  // LRU 리스트가 비어 있으면 실패
-  if (!lru_head) {
-    // printf("[CLOCK] LRU list is empty\n");
+  refill_inactive();
+  if (!inactive_list.head) {
+    // 전부 active: 최근 참조 여부와 관계없이 한 batch만 강제로 내림
+    int n = LRU_SCAN_BATCH;
+    while (n-- > 0 && active_list.head) {
+      struct page *p = active_list.head;
+      list_unlink(p);
+      p->active = 0;
+      p->referenced = 0;
+      list_append(&inactive_list, p);
+    }
+  }
+
+  // inactive를 많아야 한 바퀴 (최대 LRU_SCAN_MAX개) 돎.
+  // 손은 늘 inactive head: 살펴본 페이지는 tail이나 active로 옮기므로
+  // 그사이 다른 CPU가 lru_remove해도 가리키던 노드가 사라지지 않음.
+  // LRU_SCAN_BATCH개마다 두 락을 놓아 다른 hart의 인터럽트를 받게 함
+  victim_scans++;
+  int budget = inactive_list.n < LRU_SCAN_MAX ? inactive_list.n : LRU_SCAN_MAX;
+  for (int n = 0; n < budget && inactive_list.head; n++) {
+    if (n > 0 && n % LRU_SCAN_BATCH == 0) {
+      release(&lru_lock.lock);
+      release(&page_lock.lock);
+      acquire(&page_lock.lock);
+      acquire(&lru_lock.lock);
+      if (!inactive_list.head)
+        break;
+    }
+    struct page *p = inactive_list.head;
+    int ref = page_referenced(p);
+
+    victim_scanned++;
+    if (ref < 0) {
+      /* 이미 스왑됐거나 잘못된 매핑이면 건너뜀 */
+      list_unlink(p);
+      list_append(&inactive_list, p);
+      continue;
+    }
+    if (ref == 0) {
+      /* 참조 안 됨: victim 확정 */
+      ra_account(p, 0);  // 참조 안 된 readahead 페이지
+      victim = p;
+      break;
+    }
+    ra_account(p, 1);
+    list_unlink(p);
+    if (p->referenced) {
+      /* 두 번째 참조: active로 승격 */
+      p->active = 1;
+      p->referenced = 0;
+      list_append(&active_list, p);
+    } else {
+      /* 첫 참조: inactive tail로 */
+      p->referenced = 1;
+      list_append(&inactive_list, p);
+    }
+  }
+
+  /* 한 바퀴를 돌았는데도 못 찾으면 inactive head (없으면 active head) */
+  if (!victim)
+    victim = inactive_list.head ? inactive_list.head : active_list.head;
+
+  release(&lru_lock.lock);
+  release(&page_lock.lock);
+  return victim;
+}
+
+// swap 공간이 바닥났을 때 resident 페이지들이 swap cache로 붙잡고
+// 있는 슬롯을 모두 반환. 반환한 슬롯 수를 돌려줌
+static int
+swapcache_reclaim(void)
+{
+  int n = 0;
+
+  acquire(&page_lock.lock);
+  for (int i = 0; i < NFRAMES; i++) {
+    int slot = __sync_lock_test_and_set(&pages[i].swapslot, -1);
+    if (slot >= 0) {
+      freeswap(slot);
+      n++;
+    }
+  }
+  release(&page_lock.lock);
+  return n;
+}
+
+// 페이지 내용이 전부 0이면 1
+static int
+page_zero(uint64 pa)
+{
+  uint64 *w = (uint64*)pa;
+  for (int i = 0; i < PGSIZE / sizeof(uint64); i++)
+    if (w[i])
+      return 0;
+  return 1;
+}
+
+// old 대신 둘 PTE: V를 끄고 PTE_EVICT. PPN과 권한, A/D 비트는 그대로
+static pte_t
+evictpte(pte_t old)
+{
+  return (old & ~PTE_V) | PTE_EVICT;
+}
+
+// pte를 evictpte로 바꾸고 바꾸기 직전 값을 돌려줌. ptlock을 잡고 호출.
+// 하드웨어가 그사이 켠 PTE_D를 잃지 않도록 한 번에 바꿈
+static pte_t
+pte_hold(pte_t *pte)
+{
+  pte_t old = __atomic_exchange_n(pte, evictpte(*pte), __ATOMIC_SEQ_CST);
+  *pte |= old & (PTE_A|PTE_D);
+  return old;
+}
+
+// victim을 매핑한 모든 PTE(대표 매핑 + rmap)를 evictpte로 바꾸고 TLB에서
+// 지움. LRU에서도 떼지만 매핑 정보는 page_release()를 위해 남김.
+// 이 뒤로는 아무도 페이지를 쓰지 못하므로 내용과 PTE_D를 믿을 수 있음.
+// 하나라도 쓰였으면 1, 아니면 0. 그사이 victim이 LRU나 대표 매핑에서
+// 떨어졌으면 (다른 hart가 먼저 잡았거나 unmap됨) -1
+static int
+page_hold(struct page *victim, uint64 pa)
+{
+  struct tlbbatch tb;
+  pte_t *pte;
+  int dirty;
+
+  acquire(&page_lock.lock);
+  acquire(&lru_lock.lock);
+  pte = victim->pte;
+  if (victim->in_lru != 1 || !pte) {
+    release(&lru_lock.lock);
+    release(&page_lock.lock);
+    return -1;
+  }
+  acquire(ptlock(pte));
+  if (!(*pte & PTE_V) || PTE2PA(*pte) != pa) {
+    release(ptlock(pte));
     release(&lru_lock.lock);
     release(&page_lock.lock);
+    return -1;
+  }
+  list_unlink(victim);
+  victim->in_lru = 0;
+  victim->active = 0;
+  victim->referenced = 0;
+  release(&lru_lock.lock);
+  dirty = (pte_hold(pte) & PTE_D) != 0;
+  release(ptlock(pte));
+  tb.n = 0;
+  tlb_add(&tb, victim->pagetable, (uint64)victim->vaddr);
+  // page_lock이 rmap을 지키므로 각 PTE는 자기 락만 잡고 바꿈
+  for (struct rmap *r = victim->rmap; r; r = r->next) {
+    pte_t *rpte = r->pte;
+    if (!rpte)
+      continue;
+    acquire(ptlock(rpte));
+    if ((*rpte & PTE_V) && PTE2PA(*rpte) == pa) {
+      dirty |= (pte_hold(rpte) & PTE_D) != 0;
+      tlb_add(&tb, r->pagetable, r->va);
+    }
+    release(ptlock(rpte));
+  }
+  /* 한 batch로: 이 페이지를 매핑한 page table로 도는 hart만 IPI */
+  tlb_flush(&tb);
+  release(&page_lock.lock);
+  return dirty;
+}
+
+// page_release()가 evictpte를 바꿔 넣는 방법
+#define EV_KEEP 0   // 원래 매핑으로 되돌림
+#define EV_DROP 1   // PTE를 비움: 다음 fault에 vmfault()가 다시 채움
+#define EV_ZERO 2   // zero page로
+#define EV_SWAP 3   // swap 슬롯으로
+
+// page_release()의 PTE 하나: 아직 pa의 evictpte면 how대로 바꾸고 1.
+// EV_SWAP에서 allocswap()이 준 참조는 처음 PTE가 갖고, 뒤의 것(dup)은
+// 하나씩 더함
+static int
+pte_release(pte_t *pte, uint64 pa, int how, int blkno, int dup,
+            struct tlbbatch *tb, pagetable_t pagetable, uint64 va)
+{
+  acquire(ptlock(pte));
+  if (!(*pte & PTE_EVICT) || EVICT2PA(*pte) != pa) {
+    release(ptlock(pte));
     return 0;
   }
+  if (how == EV_KEEP) {
+    *pte = (*pte & ~PTE_EVICT) | PTE_V;
+    tlb_add(tb, pagetable, va);
+  } else if (how == EV_ZERO) {
+    *pte = zeropte(*pte);
+    tlb_add(tb, pagetable, va);
+  } else if (how == EV_SWAP) {
+    *pte = PPN2PTE(blkno) | (*pte & (PTE_R|PTE_W|PTE_X|PTE_U|PTE_COW)) | PTE_SWAP;
+    if (dup)
+      dupswap(blkno);
+  } else {
+    *pte = 0;
+  }
+  release(ptlock(pte));
+  return 1;
+}
 
-  if (clock_hand == 0) {
-    clock_hand = lru_head;
-    // printf("[CLOCK] Initialized clock_hand to head: 0x%lx\n", (uint64)clock_hand->vaddr);
+// evictpte를 기다리는 프로세스들을 깨움
+static void
+evict_done(void)
+{
+  acquire(&evict_lock);
+  wakeup(&evict_lock);
+  release(&evict_lock);
+}
+
+// page_hold()한 victim의 PTE들을 how대로 마무리하고 기다리던 fault를
+// 깨움. EV_KEEP면 victim은 LRU로 돌아감. 아니면 rmap을 정리하고 페이지
+// free는 호출자 몫. 그사이 uvmunmap()이 매핑을 모두 떼어 갔으면 EV_SWAP의
+// 슬롯을 반환하고, EV_KEEP도 페이지를 free함
+static void
+page_release(struct page *victim, uint64 pa, int how, int blkno)
+{
+  struct tlbbatch tb;
+  int n = 0;
+
+  tb.n = 0;
+  acquire(&page_lock.lock);
+  if (victim->pte)
+    n += pte_release(victim->pte, pa, how, blkno, n, &tb,
+                     victim->pagetable, (uint64)victim->vaddr);
+  for (struct rmap *r = victim->rmap; r; r = r->next)
+    if (r->pte)
+      n += pte_release(r->pte, pa, how, blkno, n, &tb, r->pagetable, r->va);
+  if (how != EV_KEEP || n == 0) {
+    while (victim->rmap) {
+      struct rmap *r = victim->rmap;
+      victim->rmap = r->next;
+      r->next = rmap_free;
+      rmap_free = r;
+    }
+    victim->refcnt = 1;
+    victim->pagetable = 0;
+    victim->vaddr = 0;
+    victim->pte = 0;
+    victim->is_page_table = 0;
   }
+  tlb_flush(&tb);
+  release(&page_lock.lock);
 
-  // clock_hand의 가상 주소 유효성 검사
-  if ((uint64)clock_hand->vaddr >= MAXVA) {
-    // printf("[CLOCK] clock_hand has invalid vaddr: 0x%lx\n", (uint64)clock_hand->vaddr);
-    panic("clock_hand vaddr invalid");
+  if (how == EV_SWAP && n == 0)
+    freeswap(blkno);
+  if (how == EV_KEEP && n > 0)
+    lru_add(victim, victim->pagetable, (uint64)victim->vaddr, LRU_LOCKED);
+  else if (how == EV_KEEP)
+    kfree((void*)pa);
+  evict_done();
+}
+
+// vmfault()에서: evict()가 pte의 페이지를 내보내는 중이면 page_release()가
+// 끝낼 때까지 잠듦. 0을 돌려주면 fault가 다시 나서 바뀐 PTE를 봄
+static int
+evictwait(pte_t *pte)
+{
+  acquire(&evict_lock);
+  while (*(volatile pte_t*)pte & PTE_EVICT)
+    sleep(&evict_lock, &evict_lock);
+  release(&evict_lock);
+  return 0;
+}
+
+// uvmunmap()에서: evictpte인 pte((pagetable, va)의 매핑)를 비우고 그
+// 페이지의 매핑 목록에서 뺌. 페이지는 evict()가 free. 그사이
+// page_release()가 pte를 바꿨으면 0
+static int
+evict_unmap(pagetable_t pagetable, uint64 va, pte_t *pte)
+{
+  acquire(&page_lock.lock);
+  acquire(ptlock(pte));
+  if (!(*pte & PTE_EVICT)) {
+    release(ptlock(pte));
+    release(&page_lock.lock);
+    return 0;
   }
+  struct page *pg = PA2PG(EVICT2PA(*pte));
+  if (!pg->super) {
+    if (pg->rmap == 0 && pg->pagetable == pagetable && (uint64)pg->vaddr == va)
+      pg->pte = 0;
+    else
+      rmap_remove(pg, pagetable, va);
+    if (pg->refcnt > 1)
+      pg->refcnt--;
+  }
+  *pte = 0;
+  release(ptlock(pte));
+  release(&page_lock.lock);
+  return 1;
+}
 
-  struct page *start = clock_hand;
-  // printf("[CLOCK] Starting scan from: 0x%lx\n", (uint64)start->vaddr);
-  
-  while (1) {
-    // printf("[DEBUG] victim vaddr = 0x%lx\n", (uint64)clock_hand->vaddr);
-    // printf("[DEBUG] walking va = 0x%lx\n", (uint64)clock_hand->vaddr);
-    pte_t *pte = walk(clock_hand->pagetable, (uint64)clock_hand->vaddr, 0);
-    // printf("[CLOCK] checking page vaddr: 0x%lx (pte: 0x%lx)\n", (uint64)clock_hand->vaddr, pte ? *pte : 0);
-
-    /* 1) 이미 스왑됐거나, 커널/고정 영역이면 건너뜀 */
-    if (!pte || !(*pte & PTE_V) || 
-        (uint64)clock_hand->vaddr >= KERNBASE ||
-        (uint64)clock_hand->vaddr >= TRAMPOLINE) { 
-      // printf("[CLOCK] skipping page: invalid or kernel/trampoline\n");
-      clock_hand = clock_hand->next;
-    }
-    /* 2) 아직 참조(A) 비트가 살아 있으면 지우고 tail로 보냄 */
-    else if (*pte & PTE_A) {
-      // printf("[CLOCK] page has A bit set, clearing and moving to tail\n");
-      *pte &= ~PTE_A;  // 참조 비트 클리어
-      
-      // 현재 페이지를 tail로 이동
-      struct page *p = clock_hand;
-      clock_hand = clock_hand->next;  // 다음 페이지로 이동
-      
-      // 페이지가 이미 tail이면 이동할 필요 없음
-      if (p != lru_tail) {
-        // 리스트에서 제거 (이미 락을 획득했으므로 use_lock=0)
-        lru_remove(p, 0);
-        // tail에 추가 (이미 락을 획득했으므로 use_lock=0)
-        lru_add(p, p->pagetable, (uint64)p->vaddr, 0);
-      }
-    }
-    /* 3) A == 0 이면 victim 확정 */
-    else {
-      // printf("[CLOCK] found victim: vaddr: 0x%lx\n", (uint64)clock_hand->vaddr);
-      struct page *victim = clock_hand;
-      clock_hand = clock_hand->next;
-      release(&lru_lock.lock);
-      release(&page_lock.lock);
+// select_victim()과 같지만, 쓰인 MAP_SHARED 페이지는 kswapd만 고름.
+// 파일에 쓰려면 inode 락과 transaction이 필요한데, kalloc()을 부른
+// 프로세스는 이미 그것들을 잡고 있을 수 있음. 그런 페이지는 inactive
+// tail로 돌리고 다음 victim을 봄 (많아야 EVICT_TRIES번)
+#define EVICT_TRIES 8
+static struct page*
+select_victim_file(void)
+{
+  struct page *victim;
+  int dirty;
+
+  for (int n = 0; n < EVICT_TRIES; n++) {
+    if ((victim = select_victim()) == 0)
+      return 0;
+    if (!victim->ip || myproc() == kswapdp)
       return victim;
+    acquire(&page_lock.lock);
+    dirty = page_dirty(victim);
+    release(&page_lock.lock);
+    if (!dirty)
+      return victim;
+    acquire(&page_lock.lock);
+    acquire(&lru_lock.lock);
+    if (victim->in_lru == 1) {
+      list_unlink(victim);
+      victim->active = 0;
+      victim->referenced = 0;
+      list_append(&inactive_list, victim);
     }
+    release(&lru_lock.lock);
+    release(&page_lock.lock);
+  }
+  return 0;
+}
 
-    /* 리스트 한 바퀴를 돌았는데도 못 찾으면 그냥 현재 손가락 */
-    if (clock_hand == start) {
-      // printf("[CLOCK] clock_hand returned to start, using current page as victim\n");
-      struct page *victim = clock_hand;
-      clock_hand = clock_hand->next;
-      release(&lru_lock.lock);
-      release(&page_lock.lock);
-      return victim;
+// superpage victim: 첫 4KB frame을 swap(전부 0이면 zero page)으로
+// 내보내고, 그 frame을 superpage를 쪼갠 L0 page table로 씀. 나머지
+// 511개는 각자 LRU로 돌아감. 늘어난 free page는 없지만 다음
+// evictpage()는 4KB victim을 고를 수 있음. 내용을 보기 전에 L1 PTE를
+// evictpte로 바꾸고 TLB를 비움. 1, swap이 꽉 찼으면 0
+static int
+superpage_evict(pagetable_t pagetable, uint64 va, pte_t *pte)
+{
+  uint64 pa = PTE2PA(*pte);
+  pte_t old, keep;
+  int blkno = -1;
+
+  acquire(ptlock(pte));
+  if (!pte_super(*pte) || PTE2PA(*pte) != pa) {
+    release(ptlock(pte));
+    return 0;
+  }
+  old = pte_hold(pte);
+  release(ptlock(pte));
+  tlb_flush_page(pagetable, va);
+
+  if (page_zero(pa)) {
+    keep = zeropte(old);
+  } else {
+    blkno = allocswap();
+    if (blkno < 0 && swapcache_reclaim() > 0)
+      blkno = allocswap();
+    if (blkno < 0) {
+      // 원래대로 되돌림. 그사이 uvmunmap()이 떼어 갔으면 free
+      acquire(ptlock(pte));
+      int mine = (*pte & PTE_EVICT) && EVICT2PA(*pte) == pa;
+      if (mine)
+        *pte = (*pte & ~PTE_EVICT) | PTE_V;
+      release(ptlock(pte));
+      if (!mine) {
+        lru_remove(PA2PG(pa), LRU_LOCKED);
+        superfree((void*)pa);
+      }
+      evict_done();
+      return 0;
     }
+    swapwrite(pa, blkno);
+    keep = PPN2PTE(blkno) | (PTE_FLAGS(old) & (PTE_R|PTE_W|PTE_X|PTE_U)) | PTE_SWAP;
+    acquire(&swap_stats_lock.lock);
+    swap_out_count++;
+    release(&swap_stats_lock.lock);
   }
+  if (superpage_split(pagetable, va, pte, (char*)pa, keep) < 0) {
+    // uvmunmap()이 떼어 감
+    if (blkno >= 0)
+      freeswap(blkno);
+    superfree((void*)pa);
+  }
+  evict_done();
+  return 1;
 }
 
 // Evict one page: swap out to disk, update PTE, free physical page
@@ -868,10 +3014,19 @@ select_victim(void)
 int
 evictpage(void)
 {
-  struct page *victim = select_victim();
+  struct page *victim = select_victim_file();
   if (!victim)
     return 0;                       // LRU 비어 있음
+  return evict(victim);
+}
 
+// pa4: LRU에 있는 victim 하나를 내보냄 (evictpage()와 local_evict()).
+// 먼저 page_hold()로 모든 매핑을 떼고 TLB를 비운 뒤, 그때 모은 PTE_D와
+// 더는 바뀌지 않는 내용을 보고 버릴지, swap cache 슬롯을 쓸지, 새로
+// 쓸지 정함. 1, 내보내지 못했으면 0
+static int
+evict(struct page *victim)
+{
   // victim의 필드들을 안전하게 복사
   pagetable_t victim_pagetable = victim->pagetable;
   uint64 victim_vaddr = (uint64)victim->vaddr;
@@ -885,52 +3040,174 @@ evictpage(void)
   // printf("[DEBUG] evictpage: victim_vaddr = 0x%lx\n", victim_vaddr);
   // printf("[DEBUG] evictpage: victim_pagetable = %p\n", victim_pagetable);
 
-  /* victim의 PTE 찾기 */
-  // printf("[DEBUG] evictpage: walking va = 0x%lx\n", victim_vaddr);
-  pte_t *pte = walk(victim_pagetable, (uint64)victim_vaddr, 0);
-  if (!pte || !(*pte & PTE_V))
+  /* victim의 PTE: lru_add()가 캐시해 둔 것 */
+  pte_t *pte = victim->pte;
+  if (!pte || !(*pte & PTE_V) || PA2PG(PTE2PA(*pte)) != victim)
     return 0;
   uint64 pa = PTE2PA(*pte);
 
   // printf("[EVICT] va: 0x%lx, pa: 0x%lx, pte: 0x%lx\n", victim_vaddr, pa, *pte);
 
-  /* 1. 빈 swap 슬롯 할당 */
-  int blkno = allocswap();  // 이제 panic이 발생할 수 있음
-  if (blkno < 0)  // unreachable
-    return 0;                       // swap 공간 부족
+  /* superpage는 쪼개서 첫 4KB만 내보냄 */
+  if (pte_super(*pte))
+    return superpage_evict(victim_pagetable, victim_vaddr, pte);
+
+  /* 0. 모든 매핑을 떼고 TLB를 비움. MAP_SHARED 페이지를 kswapd가 파일에
+   *    쓸 수도 있으면 그 전에 transaction과 inode 락부터 (begin_op ->
+   *    ilock -> page_hold 순서. evictwait()는 inode 락을 쥐고 부르지
+   *    않음: readi()/writei()는 락을 놓고 fault를 냄) */
+  struct page *pg = PA2PG(pa);
+  struct inode *ip = pg->ip;
+  uint off = pg->fileoff;
+  int wb = ip && myproc() == kswapdp;
+  if (wb) {
+    begin_op();
+    ilock(ip);
+  }
+  int dirty = page_hold(victim, pa);
+  if (dirty < 0) {
+    if (wb) {
+      iunlock(ip);
+      end_op();
+    }
+    return 0;                       // 다른 hart가 먼저 잡았거나 unmap됨
+  }
+
+  /* 0-1. 쓰인 MAP_SHARED 페이지는 swap 대신 파일에 써 두고 버림
+   *      (select_victim_file()이 kswapd에서만 고름). 그사이 다시 fault 난
+   *      vma_fill()은 inode 락에서 다 쓸 때까지 기다렸다가 새 내용을 읽음 */
+  if (ip && dirty) {
+    if (!wb) {
+      page_release(victim, pa, EV_KEEP, 0);
+      return 0;                     // 고른 뒤에 쓰였음
+    }
+    pagewritei(ip, off, pa);
+    page_release(victim, pa, EV_DROP, 0);
+    iunlock(ip);
+    end_op();
+    kfree((void*)pa);
+    acquire(&swap_stats_lock.lock);
+    mmap_writebacks++;
+    release(&swap_stats_lock.lock);
+    return 1;
+  }
+  if (wb) {
+    iunlock(ip);
+    end_op();
+  }
+
+  /* 1. VMA에서 채운 뒤 쓰이지 않은 페이지는 swap 없이 버림:
+   *    PTE를 비워 두면 다음 fault에 vmfault()가 다시 채움 */
+  if (pg->refill && !dirty) {
+    page_release(victim, pa, EV_DROP, 0);
+    kfree((void*)pa);
+    acquire(&swap_stats_lock.lock);
+    refill_drops++;
+    release(&swap_stats_lock.lock);
+    return 1;
+  }
+
+  /* 2. 내용이 전부 0이면 쓰지 않고 모든 매핑을 zero page로 돌림 */
+  if (page_zero(pa)) {
+    page_release(victim, pa, EV_ZERO, 0);
+    kfree((void*)pa);
+    acquire(&swap_stats_lock.lock);
+    zero_drops++;
+    release(&swap_stats_lock.lock);
+    return 1;
+  }
+
+  /* 3. swap cache: swap-in 이후 쓰이지 않았으면 디스크 사본이 그대로
+   *    유효하므로 그 슬롯을 씀 (슬롯 참조는 이제 대표 PTE가 가짐) */
+  acquire(&page_lock.lock);
+  int blkno = pg->swapslot;
+  if (blkno >= 0 && dirty) {
+    freeswap(blkno);
+    blkno = -1;
+  }
+  pg->swapslot = -1;
+  release(&page_lock.lock);
 
-  /* 2. 디스크로 write-out */
-  swapwrite(pa, blkno);
+  int clean = blkno >= 0;
+  if (!clean) {
+    /* 4. 빈 swap 슬롯 할당 후 디스크로 write-out */
+    blkno = allocswap();
+    if (blkno < 0 && swapcache_reclaim() > 0)
+      blkno = allocswap();
+    if (blkno < 0) {
+      page_release(victim, pa, EV_KEEP, 0);
+      return 0;                       // swap 공간 부족
+    }
+    swapwrite(pa, blkno);
+  }
   
   // 스왑 아웃 통계 업데이트
   acquire(&swap_stats_lock.lock);
   swap_out_count++;
+  if (clean)
+    swap_clean_evicts++;
   // printf("[SWAP OUT] pa = 0x%lx → blkno = %d (total: %d)\n", pa, blkno, swap_out_count);
   release(&swap_stats_lock.lock);
 
-  /* 3. LRU 리스트에서 제거 (이미 락을 획득했으므로 use_lock=0) */
-  lru_remove(victim, LRU_LOCKED);
+  /* 5. 모든 매핑이 swap 슬롯을 가리키게 하고 (COW로 공유된 페이지면
+   *    rmap의 PTE마다 슬롯 참조 하나씩) 물리 페이지 free */
+  page_release(victim, pa, EV_SWAP, blkno);
+  kfree((void*)pa);
+  ws_record(victim_pagetable, victim_vaddr);
+  trace(TR_EVICT, victim_vaddr, blkno);
 
-  /* 4. PTE 업데이트: V 비트 끄고 SWAP 슬롯 번호 저장 */
-  uint64 flags = PTE_FLAGS(*pte) & (PTE_R|PTE_W|PTE_X|PTE_U);
-  acquire(&pte_lock.lock);
-  *pte = (blkno << 12) | (flags & ~PTE_V) | PTE_SWAP;
-  sfence_vma();
-  release(&pte_lock.lock);
-  // printf("[EVICT] Updated PTE: 0x%lx\n", *pte);
+  return 1;
+}
 
-  /* 5. 물리 페이지 free */
-  kfree((void*)pa);
+// pa4: 지금의 메모리 압박 정도 (MP_*). kswapd 워터마크와, 최근
+// MP_HOLD tick 안에 kalloc()이 직접 evict해야 했는지로 정함
+int
+mempressure(void)
+{
+  if ((int)(reclaim_until - ticks) > 0)
+    return MP_CRITICAL;
+  if (num_free_pages < KSWAPD_LOW)
+    return MP_MEDIUM;
+  if (num_free_pages < KSWAPD_HIGH)
+    return MP_LOW;
+  return MP_NONE;
+}
 
-  /* 6. struct page 메타데이터 초기화 */
-  struct page *pg = &pages[pa/PGSIZE];
-  pg->pagetable = 0;
-  pg->vaddr = 0;
-  pg->in_lru = 0;
-  pg->is_page_table = 0;
-  // printf("[EVICT] Cleared page metadata for pa=0x%lx\n", pa);
+// pa4: background page-out daemon.
+// free page 수가 KSWAPD_LOW 아래로 떨어지면 KSWAPD_HIGH까지
+// clock victim들을 KSWAPD_BATCH 단위로 미리 내보내서,
+// kalloc()을 호출한 프로세스가 동기 eviction 비용을 치르지 않게 함.
+//
+// kalloc()은 p->lock 등을 잡은 상태에서도 불리므로 거기서 wakeup()을
+// 부를 수 없다. 대신 매 tick마다 깨어나 워터마크를 확인한다.
+// (모든 hart가 idle이면 tick이 없지만 그동안은 kalloc()도 없음)
+void
+kswapd(void)
+{
+  int n;
 
-  return 1;
+  kswapdp = myproc();
+  for(;;){
+    acquire(&tickslock);
+    while(num_free_pages >= KSWAPD_LOW)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    while(num_free_pages < KSWAPD_HIGH){
+      for(n = 0; n < KSWAPD_BATCH && num_free_pages < KSWAPD_HIGH; n++){
+        if(!evictpage())
+          break;
+      }
+      if(n < KSWAPD_BATCH && num_free_pages < KSWAPD_HIGH){
+        // 더 내보낼 페이지나 swap 슬롯이 없음: 다음 tick에 다시 시도
+        acquire(&tickslock);
+        sleep(&ticks, &tickslock);
+        release(&tickslock);
+        break;
+      }
+      yield();
+    }
+  }
 }
 
 // 스왑 통계 출력
@@ -938,9 +3215,23 @@ void
 print_swap_stats(void)
 {
   acquire(&swap_stats_lock.lock);
-  // printf("Swap Statistics:\n");
-  // printf("  Swap Out: %d pages\n", swap_out_count);
-  // printf("  Swap In: %d pages\n", swap_in_count);
-  // printf("  Total Swaps: %d pages\n", swap_out_count + swap_in_count);
+  printf("Swap Statistics:\n");
+  printf("  Swap Out: %d pages\n", swap_out_count);
+  printf("  Swap In: %d pages\n", swap_in_count);
+  printf("  Total Swaps: %d pages\n", swap_out_count + swap_in_count);
+  printf("  Clean evictions (no write): %d pages\n", swap_clean_evicts);
+  printf("  Dropped unwritten VMA pages: %d pages\n", refill_drops);
+  printf("  Zero-filled pages dropped: %d pages\n", zero_drops);
+  printf("  Shared mmap pages written back: %d pages\n", mmap_writebacks);
+  printf("  Superpages: %d mapped, %d split\n", super_maps, super_splits);
+  printf("  Page-table pages reclaimed: %d pages\n", pt_reclaims);
+  struct vmstat st;
+  zswapstats(&st);
+  printf("  Compressed: %ld slots in %ld pool pages, %ld read back\n",
+         st.zswapped, st.zpoolpages, st.zloads);
+  printf("  Readahead: %d pages, %d hit", swap_ra_pages, swap_ra_hits);
+  if (swap_ra_pages > 0)
+    printf(" (%d%%)", swap_ra_hits * 100 / swap_ra_pages);
+  printf("\n");
   release(&swap_stats_lock.lock);
 }
\ No newline at end of file
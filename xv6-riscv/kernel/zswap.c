@@ -0,0 +1,218 @@
+// pa4: compressed swap cache (zswap).
+//
+// swapwrite() first tries to keep a page here, compressed, in
+// pages taken from the free lists. only a page that does not
+// compress well, or does not fit in a full pool, goes to the
+// disk slot. the slot is allocated either way, so PTE_SWAP
+// entries, swap_count[] and the swap cache work unchanged, and
+// the pool copy goes away when freeswap() frees the slot.
+//
+// encoding: a page whose words are all equal keeps only that
+// word and no pool space. any other page is a 512-bit map of
+// its non-zero words followed by those words, kept if it fits
+// in ZMAXCHUNK chunks. each pool page is ZCHUNKS chunks.
+//
+// only the first NSLOTS swap slots can be kept here; the ones
+// past them always go to the disk.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "fs.h"
+#include "stat.h"
+
+#define NSLOTS    NSWAPSLOT
+#define NWORDS    (PGSIZE / sizeof(uint64))
+#define MAPBYTES  (NWORDS / 8)
+#define ZCHUNK    256
+#define ZCHUNKS   (PGSIZE / ZCHUNK)
+#define ZMAXCHUNK (ZCHUNKS / 2)   // must at least halve the page
+
+struct zentry {
+  uchar stored;   // the slot's contents are here, not on disk
+  uchar chunk;    // first chunk in the pool page
+  uchar nchunk;   // 0 if same-filled
+  short zpage;    // index in zpool.pages
+  uint64 word;    // the word a same-filled page repeats
+};
+
+struct {
+  struct spinlock lock;
+  char *pages[ZSWAP_PAGES];
+  ushort used[ZSWAP_PAGES];  // bit i set: chunk i in use
+  int npages;                // pool pages allocated
+  int nstored;               // slots held here
+  int stores;                // pages kept here by swapwrite()
+  int loads;                 // and read back by swapread()
+  struct zentry ent[NSLOTS];
+} zpool;
+
+void
+zswapinit(void)
+{
+  initlock(&zpool.lock, "zswap");
+}
+
+// find n free contiguous chunks, allocating a pool page if no
+// page has them. returns the address, or 0 if the pool is full.
+// caller holds zpool.lock.
+static char*
+zalloc(int n, struct zentry *e)
+{
+  uint run = (1 << n) - 1;
+  int free = -1;
+
+  for(int i = 0; i < ZSWAP_PAGES; i++){
+    if(zpool.pages[i] == 0){
+      if(free < 0)
+        free = i;
+      continue;
+    }
+    for(int c = 0; c + n <= ZCHUNKS; c++){
+      if((zpool.used[i] & (run << c)) == 0){
+        zpool.used[i] |= run << c;
+        e->zpage = i;
+        e->chunk = c;
+        return zpool.pages[i] + c * ZCHUNK;
+      }
+    }
+  }
+  // only take what is already free: we may be evicting for kalloc().
+  if(free < 0 || (zpool.pages[free] = kalloc_noevict()) == 0)
+    return 0;
+  zpool.npages++;
+  zpool.used[free] = run;
+  e->zpage = free;
+  e->chunk = 0;
+  return zpool.pages[free];
+}
+
+// keep the page at pa as the contents of swap slot slot.
+// returns 1 if it is kept here, 0 if it must go to disk.
+int
+zswap_store(uint64 pa, int slot)
+{
+  uint64 *w = (uint64*)pa;
+  struct zentry *e = &zpool.ent[slot];
+  int nz = 0, same = 1;
+  char *dst;
+
+  if(ZSWAP_PAGES == 0 || slot >= NSLOTS)
+    return 0;
+  for(int i = 0; i < NWORDS; i++){
+    if(w[i])
+      nz++;
+    if(w[i] != w[0])
+      same = 0;
+  }
+  int n = (MAPBYTES + nz * sizeof(uint64) + ZCHUNK - 1) / ZCHUNK;
+  if(!same && n > ZMAXCHUNK)
+    return 0;
+
+  acquire(&zpool.lock);
+  if(e->stored)
+    panic("zswap_store");
+  if(same){
+    e->nchunk = 0;
+    e->word = w[0];
+  } else {
+    if((dst = zalloc(n, e)) == 0){
+      release(&zpool.lock);
+      return 0;
+    }
+    e->nchunk = n;
+    uchar *map = (uchar*)dst;
+    uint64 *out = (uint64*)(dst + MAPBYTES);
+    memset(map, 0, MAPBYTES);
+    for(int i = 0; i < NWORDS; i++){
+      if(w[i]){
+        map[i / 8] |= 1 << (i % 8);
+        *out++ = w[i];
+      }
+    }
+  }
+  e->stored = 1;
+  zpool.nstored++;
+  zpool.stores++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// if swap slot slot is held here, decompress it into the page
+// at pa and return 1, else return 0.
+int
+zswap_load(uint64 pa, int slot)
+{
+  uint64 *w = (uint64*)pa;
+  struct zentry *e = &zpool.ent[slot];
+
+  if(slot >= NSLOTS)
+    return 0;
+  acquire(&zpool.lock);
+  if(!e->stored){
+    release(&zpool.lock);
+    return 0;
+  }
+  if(e->nchunk == 0){
+    for(int i = 0; i < NWORDS; i++)
+      w[i] = e->word;
+  } else {
+    char *src = zpool.pages[e->zpage] + e->chunk * ZCHUNK;
+    uchar *map = (uchar*)src;
+    uint64 *in = (uint64*)(src + MAPBYTES);
+    for(int i = 0; i < NWORDS; i++)
+      w[i] = (map[i / 8] & (1 << (i % 8))) ? *in++ : 0;
+  }
+  zpool.loads++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// is swap slot slot held here?
+int
+zswap_has(int slot)
+{
+  return slot < NSLOTS && zpool.ent[slot].stored;
+}
+
+// swap slot slot has been freed: drop its copy, and the pool
+// page if that was the last one in it. called by freeswap()
+// with the swap bitmap lock held, so the slot cannot be reused
+// before its copy is gone.
+void
+zswap_free(int slot)
+{
+  struct zentry *e = &zpool.ent[slot];
+
+  if(slot >= NSLOTS)
+    return;
+  acquire(&zpool.lock);
+  if(e->stored){
+    if(e->nchunk){
+      int i = e->zpage;
+      zpool.used[i] &= ~(((1 << e->nchunk) - 1) << e->chunk);
+      if(zpool.used[i] == 0){
+        kfree(zpool.pages[i]);
+        zpool.pages[i] = 0;
+        zpool.npages--;
+      }
+    }
+    e->stored = 0;
+    zpool.nstored--;
+  }
+  release(&zpool.lock);
+}
+
+// fill the zswap counters of vmstat().
+void
+zswapstats(struct vmstat *st)
+{
+  acquire(&zpool.lock);
+  st->zswapped = zpool.nstored;
+  st->zpoolpages = zpool.npages;
+  st->zloads = zpool.loads;
+  release(&zpool.lock);
+}
@@ -0,0 +1,92 @@
+// Physical page allocator microbenchmark.
+//
+// allocbench [maxworkers]
+//
+// For 1..maxworkers concurrent worker processes, each worker
+// repeatedly grows its heap by NPG pages with sbrk(), touches
+// every page, and shrinks it again, for DURATION ticks.
+// Every sbrk() round trip is NPG kalloc()s and NPG kfree()s,
+// so the aggregate rate shows how the allocator scales with
+// the number of CPUs (run with make CPUS=n).
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define PGSIZE   4096
+#define NPG      16   // pages per sbrk() round trip
+#define DURATION 20   // ticks per measurement (~100ms each)
+
+// allocate and free pages until the deadline,
+// and return how many pages were allocated.
+int
+worker(int deadline)
+{
+  int n = 0;
+
+  while(uptime() < deadline){
+    char *p = sbrk(NPG * PGSIZE);
+    if(p == (char*)-1){
+      printf("allocbench: sbrk failed\n");
+      exit(1);
+    }
+    for(int i = 0; i < NPG; i++)
+      p[i * PGSIZE] = i;
+    sbrk(-(NPG * PGSIZE));
+    n += NPG;
+  }
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxworkers = 4;
+
+  if(argc > 1)
+    maxworkers = atoi(argv[1]);
+  if(maxworkers < 1){
+    printf("usage: allocbench [maxworkers]\n");
+    exit(1);
+  }
+
+  printf("allocbench: %d pages per sbrk, %d ticks per run\n", NPG, DURATION);
+  for(int nw = 1; nw <= maxworkers; nw++){
+    int fds[2];
+    if(pipe(fds) < 0){
+      printf("allocbench: pipe failed\n");
+      exit(1);
+    }
+
+    // start everyone at the same tick.
+    int start = uptime() + 1;
+    for(int w = 0; w < nw; w++){
+      int pid = fork();
+      if(pid < 0){
+        printf("allocbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        close(fds[0]);
+        while(uptime() < start)
+          ;
+        int n = worker(start + DURATION);
+        write(fds[1], &n, sizeof(n));
+        exit(0);
+      }
+    }
+    close(fds[1]);
+
+    int total = 0, n;
+    while(read(fds[0], &n, sizeof(n)) == sizeof(n))
+      total += n;
+    close(fds[0]);
+    for(int w = 0; w < nw; w++)
+      wait(0);
+
+    // one tick is about 1/10 of a second.
+    printf("%d workers: %d allocs in %d ticks, %d allocs/sec\n",
+           nw, total, DURATION, total * 10 / DURATION);
+  }
+  exit(0);
+}
@@ -0,0 +1,50 @@
+// Print scheduler counters, one line per CPU.
+//
+// cpustat [cmd args...]
+//
+// With a command, run it and print only what happened while it
+// ran. CPUs that never switched to a process are left out.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+struct cpustat a[NCPU], b[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+  if(cpustat(a, NCPU) < 0){
+    printf("cpustat: cpustat failed\n");
+    exit(1);
+  }
+
+  if(argc > 1){
+    int pid = fork();
+    if(pid < 0){
+      printf("cpustat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf("cpustat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else {
+    memset(a, 0, sizeof(a));
+  }
+  cpustat(b, NCPU);
+
+  printf("%s %s %s %s %s %s\n", "cpu", "switches", "migrations", "steals", "idles",
+         "timer-intrs");
+  for(int i = 0; i < NCPU; i++){
+    if(b[i].switches == 0)
+      continue;
+    printf("%d %ld %ld %ld %ld %ld\n", i, b[i].switches - a[i].switches,
+           b[i].migrations - a[i].migrations, b[i].steals - a[i].steals,
+           b[i].idles - a[i].idles, b[i].timers - a[i].timers);
+  }
+  exit(0);
+}
@@ -0,0 +1,263 @@
+// File-system benchmark.
+//
+// fsbench [size-KB [nwriters]]
+//
+// Phases, each reported with its ticks and buffer cache hit rate
+// (bread()s that found the block cached or read ahead):
+//
+//   seqwrite  write a size-KB file in 4KB writes
+//   seqread   read it back
+//   randwrite rewrite NRAND chunks of one file with pwrite(), at
+//             offsets picked from a fixed seed
+//   randread  read NRAND chunks of it with pread()
+//   create    create NSMALL small files
+//   unlink    remove them
+//   lookup    open a file DEPTH directories down, NLOOKUP times
+//   parallel  nwriters processes each write size-KB/nwriters
+//             to their own file at the same time
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define CHUNK   4096
+#define NRAND   64
+#define NSMALL  200
+#define DEPTH   16
+#define NLOOKUP 200
+
+char buf[CHUNK];
+uint64 seed = 1;
+struct fsstat before;
+int start;
+
+int
+rnd(void)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 33;
+}
+
+void
+begin(void)
+{
+  fsstat(&before);
+  start = uptime();
+}
+
+void
+end(char *phase, int kb)
+{
+  struct fsstat after;
+  int t = uptime() - start;
+
+  fsstat(&after);
+  uint64 reads = after.breads - before.breads;
+  uint64 misses = after.bmisses - before.bmisses;
+  printf("%s: %d ticks", phase, t);
+  // one tick is about 1/10 of a second.
+  if(kb > 0)
+    printf(", %d KB/sec", kb * 10 / (t ? t : 1));
+  printf(", %ld block reads", reads);
+  if(reads > 0)
+    printf(", %ld%% cached", (reads - misses) * 100 / reads);
+  printf("\n");
+}
+
+void
+writefile(char *name, int kb)
+{
+  int fd = open(name, O_CREATE | O_RDWR | O_TRUNC);
+  if(fd < 0){
+    printf("fsbench: create %s failed\n", name);
+    exit(1);
+  }
+  for(int n = 0; n < kb * 1024; n += CHUNK){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf("fsbench: write %s failed\n", name);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+readfile(char *name)
+{
+  int fd = open(name, O_RDONLY);
+  if(fd < 0){
+    printf("fsbench: open %s failed\n", name);
+    exit(1);
+  }
+  while(read(fd, buf, CHUNK) > 0)
+    ;
+  close(fd);
+}
+
+void
+name(char *s, char c, int i)
+{
+  s[0] = 'f';
+  s[1] = c;
+  s[2] = '0' + i / 100;
+  s[3] = '0' + i / 10 % 10;
+  s[4] = '0' + i % 10;
+  s[5] = 0;
+}
+
+void
+sequential(int kb)
+{
+  begin();
+  writefile("fsb.seq", kb);
+  end("seqwrite", kb);
+  begin();
+  readfile("fsb.seq");
+  end("seqread", kb);
+  unlink("fsb.seq");
+}
+
+void
+random(void)
+{
+  writefile("fsb.rand", NRAND * CHUNK / 1024);
+  int fd = open("fsb.rand", O_RDWR);
+  if(fd < 0){
+    printf("fsbench: open fsb.rand failed\n");
+    exit(1);
+  }
+  begin();
+  for(int i = 0; i < NRAND; i++){
+    if(pwrite(fd, buf, CHUNK, rnd() % NRAND * CHUNK) != CHUNK){
+      printf("fsbench: pwrite failed\n");
+      exit(1);
+    }
+  }
+  end("randwrite", NRAND * CHUNK / 1024);
+  begin();
+  for(int i = 0; i < NRAND; i++){
+    if(pread(fd, buf, CHUNK, rnd() % NRAND * CHUNK) != CHUNK){
+      printf("fsbench: pread failed\n");
+      exit(1);
+    }
+  }
+  end("randread", NRAND * CHUNK / 1024);
+  close(fd);
+  unlink("fsb.rand");
+}
+
+void
+smallfiles(void)
+{
+  char s[8];
+
+  begin();
+  for(int i = 0; i < NSMALL; i++){
+    name(s, 's', i);
+    int fd = open(s, O_CREATE | O_RDWR);
+    if(fd < 0 || write(fd, buf, 100) != 100){
+      printf("fsbench: create %s failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  end("create", 0);
+  begin();
+  for(int i = 0; i < NSMALL; i++){
+    name(s, 's', i);
+    if(unlink(s) < 0){
+      printf("fsbench: unlink %s failed\n", s);
+      exit(1);
+    }
+  }
+  end("unlink", 0);
+}
+
+void
+lookup(void)
+{
+  char path[2 * DEPTH + 8];
+  int n = 0;
+
+  for(int i = 0; i < DEPTH; i++){
+    path[n++] = 'd';
+    path[n] = 0;
+    if(mkdir(path) < 0){
+      printf("fsbench: mkdir %s failed\n", path);
+      exit(1);
+    }
+    path[n++] = '/';
+  }
+  strcpy(path + n, "f");
+  writefile(path, 1);
+
+  begin();
+  for(int i = 0; i < NLOOKUP; i++){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+      printf("fsbench: open %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  end("lookup", 0);
+
+  unlink(path);
+  for(int i = DEPTH; i > 0; i--){
+    path[2 * i - 1] = 0;
+    unlink(path);
+  }
+}
+
+void
+parallel(int kb, int nw)
+{
+  char s[8];
+
+  begin();
+  for(int i = 0; i < nw; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fsbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      name(s, 'p', i);
+      writefile(s, kb / nw);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < nw; i++)
+    wait(0);
+  end("parallel", kb / nw * nw);
+  for(int i = 0; i < nw; i++){
+    name(s, 'p', i);
+    unlink(s);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 512, nw = 4;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    nw = atoi(argv[2]);
+  if(kb < 4 || nw < 1 || nw > 100){
+    printf("usage: fsbench [size-KB [nwriters]]\n");
+    exit(1);
+  }
+  kb = kb / 4 * 4;
+  memset(buf, 'x', sizeof(buf));
+
+  printf("fsbench: %d KB, %d writers\n", kb, nw);
+  sequential(kb);
+  random();
+  smallfiles();
+  lookup();
+  parallel(kb, nw);
+  exit(0);
+}
@@ -0,0 +1,87 @@
+// Dump the kernel event trace.
+//
+// ktrace [command [args ...]]
+//
+// With a command, starts tracing, runs the command, stops, and
+// prints what it recorded. Without one, prints (and consumes)
+// whatever is recorded so far. Events are merged across CPUs in
+// time order; times are microseconds since the first event.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXEV (NCPU * NTRACE)
+
+char *names[] = {
+  [TR_FAULT]   "fault",
+  [TR_EVICT]   "evict",
+  [TR_SWAPIN]  "swapin",
+  [TR_BMISS]   "bmiss",
+  [TR_DSUBMIT] "dsubmit",
+  [TR_DDONE]   "ddone",
+  [TR_SWITCH]  "switch",
+};
+
+struct traceent ev[MAXEV];
+
+void
+print(struct traceent *e, uint64 t0)
+{
+  char *name = e->event < sizeof(names)/sizeof(names[0]) && names[e->event] ?
+               names[e->event] : "?";
+
+  // qemu's timer runs at 10MHz.
+  printf("%ld cpu%d pid %d %s 0x%lx %ld\n",
+         (e->time - t0) / 10, e->cpu, e->pid, name, e->a0, e->a1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1){
+    ktrace(KTRACE_ON, 0, 0);
+    int pid = fork();
+    if(pid < 0){
+      printf("ktrace: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf("ktrace: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+    ktrace(KTRACE_OFF, 0, 0);
+  }
+
+  int n = ktrace(KTRACE_READ, ev, MAXEV);
+  if(n < 0){
+    printf("ktrace: read failed\n");
+    exit(1);
+  }
+
+  // ev[] holds one time-ordered run per CPU; merge them.
+  int start[NCPU+1], pos[NCPU], nrun = 0;
+  for(int i = 0; i < n; i++)
+    if(i == 0 || ev[i].cpu != ev[i-1].cpu)
+      start[nrun++] = i;
+  start[nrun] = n;
+  for(int r = 0; r < nrun; r++)
+    pos[r] = start[r];
+
+  uint64 t0 = 0;
+  for(int k = 0; k < n; k++){
+    int best = -1;
+    for(int r = 0; r < nrun; r++)
+      if(pos[r] < start[r+1] &&
+         (best < 0 || ev[pos[r]].time < ev[pos[best]].time))
+        best = r;
+    if(k == 0)
+      t0 = ev[pos[best]].time;
+    print(&ev[pos[best]++], t0);
+  }
+  printf("ktrace: %d events\n", n);
+  exit(0);
+}
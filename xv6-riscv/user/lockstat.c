@@ -0,0 +1,69 @@
+// Print lock contention counters, one line per lock name.
+//
+// lockstat [cmd args...]
+//
+// With a command, run it and print only what happened while it
+// ran. Classes are sorted by time spent waiting, most first;
+// classes that were not acquired are left out.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+struct lockstat a[NLOCKCLASS], b[NLOCKCLASS];
+int order[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  int n = lockstat(a, NLOCKCLASS);
+  if(n < 0){
+    printf("lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  if(argc > 1){
+    int pid = fork();
+    if(pid < 0){
+      printf("lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf("lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else {
+    memset(a, 0, sizeof(a));
+  }
+  // classes made while the command ran start from zero in a[].
+  n = lockstat(b, NLOCKCLASS);
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+  for(int i = 0; i < n; i++){
+    b[i].acquires -= a[i].acquires;
+    b[i].contended -= a[i].contended;
+    b[i].spins -= a[i].spins;
+    order[i] = i;
+  }
+
+  // insertion sort by spin time.
+  for(int i = 1; i < n; i++){
+    int k = order[i], j = i;
+    for(; j > 0 && b[order[j-1]].spins < b[k].spins; j--)
+      order[j] = order[j-1];
+    order[j] = k;
+  }
+
+  printf("%s %s %s %s\n", "name", "acquires", "contended", "wait-us");
+  for(int i = 0; i < n; i++){
+    struct lockstat *s = &b[order[i]];
+    if(s->acquires == 0)
+      continue;
+    // qemu's timer runs at 10MHz.
+    printf("%s %ld %ld %ld\n", s->name, s->acquires, s->contended, s->spins / 10);
+  }
+  exit(0);
+}
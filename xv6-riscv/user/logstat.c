@@ -0,0 +1,56 @@
+// Print the logging layer's group commit counters
+// and the buffer cache's readahead counters.
+//
+// logstat [cmd args...]
+//
+// With a command, run it and print only the counts it caused.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat a, b;
+
+  if(fsstat(&a) < 0){
+    printf("logstat: fsstat failed\n");
+    exit(1);
+  }
+  if(argc > 1){
+    int pid = fork();
+    if(pid < 0){
+      printf("logstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf("logstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+    fsstat(&b);
+    b.commits -= a.commits;
+    b.trans -= a.trans;
+    b.logblocks -= a.logblocks;
+    b.datablocks -= a.datablocks;
+    b.grouped -= a.grouped;
+    b.rablocks -= a.rablocks;
+    b.rahits -= a.rahits;
+    b.bmisses -= a.bmisses;
+  } else {
+    b = a;
+  }
+
+  printf("commits %ld, fs calls %ld, log blocks %ld, grouped commits %ld\n",
+         b.commits, b.trans, b.logblocks, b.grouped);
+  if(b.commits > 0)
+    printf("per commit: %ld.%ld calls, %ld blocks; max %ld calls\n",
+           b.trans / b.commits, (b.trans * 10 / b.commits) % 10,
+           b.logblocks / b.commits, b.maxtrans);
+  printf("file blocks written in place %ld\n", b.datablocks);
+  printf("readahead %ld blocks, %ld hits; %ld reads waited for the disk\n",
+         b.rablocks, b.rahits, b.bmisses);
+  exit(0);
+}
@@ -0,0 +1,189 @@
+// Paging benchmark.
+//
+// pagebench [npages [resident [passes]]]
+//
+// Each workload runs in a fresh child that allocates npages
+// heap pages, fills them, and limits itself to resident pages
+// with rsslimit(), so that paging does not depend on how much
+// memory this machine or other processes have. It then touches
+// npages * passes pages in one of these orders:
+//
+//   seq    0, 1, ..., npages-1, again
+//   random uniform, from a fixed seed
+//   zipf   Zipf(1) over the pages, from a fixed seed
+//   fork   fork, then the child writes every page (COW + swap-in)
+//
+// and reports touches per second, its faults and the average
+// time per fault, the system's swap-ins and swap-outs, and the
+// swap sectors read and written, all measured over uptime()
+// ticks. Runs with the same arguments touch the same pages in
+// the same order.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define PGSIZE 4096
+
+int npages = 256, resident = 64, passes = 4;
+char *mem;
+uint64 *zcdf;   // zcdf[i]: total Zipf weight of pages 0..i
+uint64 seed;
+
+uint64
+rnd(void)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 33;
+}
+
+void
+touch(int i)
+{
+  mem[(uint64)i * PGSIZE + (i % (PGSIZE / 8)) * 8]++;
+}
+
+void
+seqrun(void)
+{
+  for(int k = 0; k < passes; k++)
+    for(int i = 0; i < npages; i++)
+      touch(i);
+}
+
+void
+randrun(void)
+{
+  for(int k = 0; k < passes * npages; k++)
+    touch(rnd() % npages);
+}
+
+void
+zipfrun(void)
+{
+  for(int k = 0; k < passes * npages; k++){
+    uint64 r = rnd() % zcdf[npages - 1];
+    int lo = 0, hi = npages - 1;
+    while(lo < hi){
+      int mid = (lo + hi) / 2;
+      if(zcdf[mid] > r)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    touch(lo);
+  }
+}
+
+void
+forkrun(void)
+{
+  int pid = fork();
+  if(pid < 0){
+    printf("pagebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(int k = 0; k < passes; k++)
+      for(int i = 0; i < npages; i++)
+        touch(i);
+    exit(0);
+  }
+  wait(0);
+}
+
+struct workload {
+  char *name;
+  void (*run)(void);
+  int forks;   // its faults happen in a child
+} workloads[] = {
+  { "seq",    seqrun,  0 },
+  { "random", randrun, 0 },
+  { "zipf",   zipfrun, 0 },
+  { "fork",   forkrun, 1 },
+};
+
+void
+bench(struct workload *w)
+{
+  struct vmstat a, b;
+  int ra, wa, rb, wb;
+
+  mem = sbrk(npages * PGSIZE);
+  if(mem == (char*)-1){
+    printf("pagebench: sbrk failed\n");
+    exit(1);
+  }
+  rsslimit(resident);
+  for(int i = 0; i < npages; i++)
+    memset(mem + (uint64)i * PGSIZE, i, PGSIZE);
+  seed = 1;
+
+  vmstat(getpid(), &a);
+  swapstat(&ra, &wa);
+  int start = uptime();
+  w->run();
+  int t = uptime() - start;
+  vmstat(getpid(), &b);
+  swapstat(&rb, &wb);
+  if(t == 0)
+    t = 1;
+
+  int ops = passes * npages;
+  uint64 minflt, majflt;
+  if(w->forks){
+    minflt = b.minflt - a.minflt;
+    majflt = b.majflt - a.majflt;
+  } else {
+    minflt = b.pminflt - a.pminflt;
+    majflt = b.pmajflt - a.pmajflt;
+  }
+  // one tick is about 1/10 of a second.
+  printf("%s: %d touches in %d ticks, %d/sec; ", w->name, ops, t, ops * 10 / t);
+  printf("faults%s %ld minor %ld major", w->forks ? " (system)" : "", minflt, majflt);
+  // touches that hit cost next to nothing, so this is about
+  // the time one fault takes.
+  if(minflt + majflt > 0)
+    printf(", %ld us each", (uint64)t * 100000 / (minflt + majflt));
+  printf("; swap in %ld out %ld; sectors read %d written %d\n",
+         b.swapins - a.swapins, b.swapouts - a.swapouts, rb - ra, wb - wa);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    npages = atoi(argv[1]);
+  if(argc > 2)
+    resident = atoi(argv[2]);
+  if(argc > 3)
+    passes = atoi(argv[3]);
+  if(npages < 1 || resident < 1 || passes < 1){
+    printf("usage: pagebench [npages [resident [passes]]]\n");
+    exit(1);
+  }
+
+  // Zipf(1): page i has weight 1/(i+1).
+  zcdf = malloc(npages * sizeof(uint64));
+  if(zcdf == 0){
+    printf("pagebench: out of memory\n");
+    exit(1);
+  }
+  for(int i = 0; i < npages; i++)
+    zcdf[i] = (i ? zcdf[i-1] : 0) + 1000000 / (i + 1);
+
+  printf("pagebench: %d pages, %d resident, %d passes\n", npages, resident, passes);
+  for(int i = 0; i < sizeof(workloads)/sizeof(workloads[0]); i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("pagebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      bench(&workloads[i]);
+      exit(0);
+    }
+    wait(0);
+  }
+  exit(0);
+}
@@ -0,0 +1,85 @@
+// Pipe throughput benchmark.
+//
+// pipebench [total-KB]
+//
+// A child writes total-KB kilobytes into a pipe in chunks of
+// each size below, and the parent reads them back. Small
+// chunks mostly measure the per-call cost, large ones the cost
+// of moving the bytes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXCHUNK 16384
+
+char buf[MAXCHUNK];
+
+int sizes[] = { 1, 64, 512, 4096, MAXCHUNK };
+
+// move total bytes through a pipe in chunk-sized writes,
+// and return the number of ticks it took.
+int
+run(int total, int chunk)
+{
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  int start = uptime();
+  int pid = fork();
+  if(pid < 0){
+    printf("pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(int n = 0; n < total; n += chunk){
+      if(write(fds[1], buf, chunk) != chunk){
+        printf("pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+
+  int n, got = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    got += n;
+  close(fds[0]);
+  wait(0);
+  if(got != total / chunk * chunk){
+    printf("pipebench: read %d bytes, expected %d\n", got, total / chunk * chunk);
+    exit(1);
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 1024;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb < 1){
+    printf("usage: pipebench [total-KB]\n");
+    exit(1);
+  }
+
+  printf("pipebench: %d KB per run\n", kb);
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    // single bytes are slow; send less of them.
+    int total = sizes[i] == 1 ? kb * 16 : kb * 1024;
+    int t = run(total, sizes[i]);
+    if(t == 0)
+      t = 1;
+    // one tick is about 1/10 of a second.
+    printf("%d-byte writes: %d KB in %d ticks, %d KB/sec\n",
+           sizes[i], total / 1024, t, total / 1024 * 10 / t);
+  }
+  exit(0);
+}
@@ -0,0 +1,166 @@
+// Scheduler benchmark.
+//
+// schedbench [nhogs]
+//
+// 1. Two processes bounce a byte over a pair of pipes for
+//    DURATION ticks. Every round trip is two sleeps and two
+//    wakeups, so its cost is the context switch latency.
+// 2. The same, while nhogs CPU-bound processes spin, as under
+//    grind. Processes that mostly sleep should keep their rate.
+// 3. nhogs CPU-bound processes count loop iterations for
+//    DURATION ticks; their shares show how fair the CPU time
+//    is split.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define DURATION 20   // ticks per measurement (~100ms each)
+#define MAXHOGS  16
+
+// spin until the deadline, then report iterations on fd.
+void
+hog(int fd, int start, int deadline)
+{
+  int n = 0;
+
+  while(uptime() < start)
+    ;
+  while(uptime() < deadline){
+    for(volatile int i = 0; i < 1000; i++)
+      ;
+    n++;
+  }
+  if(fd >= 0)
+    write(fd, &n, sizeof(n));
+  exit(0);
+}
+
+// start nhogs hogs; with fd >= 0 they report on it.
+void
+starthogs(int nhogs, int fd, int start, int deadline)
+{
+  for(int i = 0; i < nhogs; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      hog(fd, start, deadline);
+  }
+}
+
+// bounce a byte between two processes until the deadline,
+// and return the number of round trips.
+int
+pingpong(int deadline)
+{
+  int ping[2], pong[2], n = 0;
+  char c = 0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("schedbench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    printf("schedbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+  while(uptime() < deadline){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1){
+      printf("schedbench: pong failed\n");
+      exit(1);
+    }
+    n++;
+  }
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+  return n;
+}
+
+void
+latency(int nhogs)
+{
+  int start = uptime() + 1;
+  int deadline = start + DURATION;
+
+  starthogs(nhogs, -1, start, deadline);
+  while(uptime() < start)
+    ;
+  int n = pingpong(deadline);
+  for(int i = 0; i < nhogs; i++)
+    wait(0);
+
+  // one tick is about 1/10 of a second.
+  printf("%d hogs: %d round trips, %d/sec", nhogs, n, n * 10 / DURATION);
+  if(n > 0)
+    printf(", %d us each", DURATION * 100000 / n);
+  printf("\n");
+}
+
+void
+fairness(int nhogs)
+{
+  int fds[2], n[MAXHOGS], k = 0, total = 0, min, max;
+
+  if(pipe(fds) < 0){
+    printf("schedbench: pipe failed\n");
+    exit(1);
+  }
+  int start = uptime() + 1;
+  starthogs(nhogs, fds[1], start, start + DURATION);
+  close(fds[1]);
+  while(k < nhogs && read(fds[0], &n[k], sizeof(n[k])) == sizeof(n[k]))
+    total += n[k++];
+  close(fds[0]);
+  for(int i = 0; i < nhogs; i++)
+    wait(0);
+  if(k == 0 || total == 0){
+    printf("schedbench: no hog reported\n");
+    exit(1);
+  }
+
+  min = max = n[0];
+  printf("shares:");
+  for(int i = 0; i < k; i++){
+    printf(" %d%%", n[i] * 100 / total);
+    if(n[i] < min)
+      min = n[i];
+    if(n[i] > max)
+      max = n[i];
+  }
+  printf("\nslowest hog got %d%% of the fastest one's iterations\n",
+         min * 100 / max);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nhogs = 4;
+
+  if(argc > 1)
+    nhogs = atoi(argv[1]);
+  if(nhogs < 1 || nhogs > MAXHOGS){
+    printf("usage: schedbench [nhogs], 1 <= nhogs <= %d\n", MAXHOGS);
+    exit(1);
+  }
+
+  printf("schedbench: %d ticks per run\n", DURATION);
+  latency(0);
+  latency(nhogs);
+  fairness(nhogs);
+  exit(0);
+}
@@ -0,0 +1,109 @@
+// Print per-system-call counts and latency histograms.
+//
+// scstat [cmd args...]
+//
+// With a command, run it and print only the calls made while it
+// ran (by anyone). For each system call that was called: the
+// count, the mean latency, and the log2 latency histogram, one
+// "<=N us:count" pair per non-empty bucket.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/syscall.h"
+#include "user/user.h"
+
+#define MAXSYS 64
+
+char *names[MAXSYS] = {
+[SYS_fork]      "fork",
+[SYS_exit]      "exit",
+[SYS_wait]      "wait",
+[SYS_pipe]      "pipe",
+[SYS_read]      "read",
+[SYS_kill]      "kill",
+[SYS_exec]      "exec",
+[SYS_fstat]     "fstat",
+[SYS_chdir]     "chdir",
+[SYS_dup]       "dup",
+[SYS_getpid]    "getpid",
+[SYS_sbrk]      "sbrk",
+[SYS_sleep]     "sleep",
+[SYS_uptime]    "uptime",
+[SYS_open]      "open",
+[SYS_write]     "write",
+[SYS_mknod]     "mknod",
+[SYS_unlink]    "unlink",
+[SYS_link]      "link",
+[SYS_mkdir]     "mkdir",
+[SYS_close]     "close",
+[SYS_swapread]  "swapread",
+[SYS_swapwrite] "swapwrite",
+[SYS_swapstat]  "swapstat",
+[SYS_fsstat]    "fsstat",
+[SYS_mmap]      "mmap",
+[SYS_munmap]    "munmap",
+[SYS_vmstat]    "vmstat",
+[SYS_rsslimit]  "rsslimit",
+[SYS_ktrace]    "ktrace",
+[SYS_scstat]    "scstat",
+[SYS_lockstat]  "lockstat",
+[SYS_setaffinity] "setaffinity",
+[SYS_cpustat]   "cpustat",
+[SYS_readv]     "readv",
+[SYS_writev]    "writev",
+[SYS_pread]     "pread",
+[SYS_pwrite]    "pwrite",
+[SYS_ringsetup] "ringsetup",
+[SYS_ringenter] "ringenter",
+[SYS_spawn]     "spawn",
+[SYS_madvise]   "madvise",
+[SYS_mempressure] "mempressure",
+};
+
+struct scstat a[MAXSYS], b[MAXSYS];
+
+int
+main(int argc, char *argv[])
+{
+  int n = scstat(a, MAXSYS);
+  if(n < 0){
+    printf("scstat: scstat failed\n");
+    exit(1);
+  }
+  if(n > MAXSYS)
+    n = MAXSYS;
+
+  if(argc > 1){
+    int pid = fork();
+    if(pid < 0){
+      printf("scstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf("scstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else {
+    memset(a, 0, sizeof(a));
+  }
+  scstat(b, MAXSYS);
+
+  for(int i = 0; i < n; i++){
+    uint64 count = b[i].count - a[i].count;
+    if(count == 0)
+      continue;
+    // qemu's timer runs at 10MHz: 10 ticks per microsecond.
+    uint64 t = b[i].time - a[i].time;
+    printf("%s: %ld calls, %ld.%ld us mean\n ", names[i] ? names[i] : "?",
+           count, t / count / 10, t / count % 10);
+    for(int k = 0; k < NSCHIST; k++){
+      uint64 c = b[i].hist[k] - a[i].hist[k];
+      if(c)
+        printf(" <=%ldus:%ld", ((2UL << k) + 9) / 10, c);
+    }
+    printf("\n");
+  }
+  exit(0);
+}
@@ -50,6 +50,7 @@ struct backcmd {
 };
 
 int fork1(void);  // Fork but panics on failure.
+int simplecmd(char*);
 void panic(char*);
 struct cmd *parsecmd(char*);
 void runcmd(struct cmd*) __attribute__((noreturn));
@@ -165,6 +166,17 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(simplecmd(buf)){
+      // pa4: a plain command needs no forked copy of the shell
+      // to set things up in; spawn it directly.
+      struct execcmd *ecmd = (struct execcmd*)parsecmd(buf);
+      if(ecmd->argv[0] && spawn(ecmd->argv[0], ecmd->argv) < 0)
+        fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      else if(ecmd->argv[0])
+        wait(0);
+      free(ecmd);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -263,6 +275,23 @@ backcmd(struct cmd *subcmd)
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// is buf just a few words, with no redirection, pipe, list or
+// background? parsecmd() makes a single execcmd of it then,
+// and cannot fail.
+int
+simplecmd(char *buf)
+{
+  int words = 0;
+
+  for(char *s = buf; *s; s++){
+    if(strchr(symbols, *s))
+      return 0;
+    if(!strchr(whitespace, *s) && (s == buf || strchr(whitespace, s[-1])))
+      words++;
+  }
+  return words < MAXARGS;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
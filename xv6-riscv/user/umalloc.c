@@ -5,6 +5,12 @@
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// Blocks of up to MAXSMALL units come from size classes
+// instead: one free list per block size, so that malloc() and
+// free() of a small block are a push or a pop. Small blocks
+// are cut from a chunk got in bulk from sbrk(), and are never
+// merged. Larger blocks use the K&R first-fit list.
 
 typedef long Align;
 
@@ -18,15 +24,23 @@ union header {
 
 typedef union header Header;
 
+#define MAXSMALL 129      // units in the largest small block, 2KB of data
+#define MINGROW  4096     // units sbrk()ed at first
+#define MAXGROW  65536    // at most, after doubling
+
 static Header base;
 static Header *freep;
+static Header *smallfree[MAXSMALL+1];  // free small blocks, by size
+static Header *chunk;     // not yet cut into small blocks
+static uint chunkleft;    // units in it
+static uint grow = MINGROW;
 
-void
-free(void *ap)
+// put a large block on the K&R free list.
+static void
+bigfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -43,23 +57,77 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  Header *bp;
+
+  bp = (Header*)ap - 1;
+  if(bp->s.size <= MAXSMALL){
+    bp->s.ptr = smallfree[bp->s.size];
+    smallfree[bp->s.size] = bp;
+  } else
+    bigfree(bp);
+}
+
+// get at least nu units from sbrk(), doubling the amount each
+// time up to MAXGROW so that a growing heap makes few calls.
+// if that much is not available, try for just nu.
 static Header*
-morecore(uint nu)
+getcore(uint *nu)
 {
   char *p;
+  uint n = *nu < grow ? grow : *nu;
+
+  p = sbrk(n * sizeof(Header));
+  if(p == (char*)-1){
+    n = *nu;
+    if((p = sbrk(n * sizeof(Header))) == (char*)-1)
+      return 0;
+  } else if(grow < MAXGROW)
+    grow *= 2;
+  *nu = n;
+  return (Header*)p;
+}
+
+static Header*
+morecore(uint nu)
+{
   Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  if((hp = getcore(&nu)) == 0)
     return 0;
-  hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  bigfree(hp);
   return freep;
 }
 
+// cut a small block of nunits units from the chunk.
+static Header*
+smallalloc(uint nunits)
+{
+  Header *p;
+
+  if(chunkleft < nunits){
+    // file what is left of the old chunk under its size.
+    if(chunkleft > 0){
+      chunk->s.size = chunkleft;
+      free((void*)(chunk + 1));
+    }
+    uint nu = nunits;
+    if((chunk = getcore(&nu)) == 0){
+      chunkleft = 0;
+      return 0;
+    }
+    chunkleft = nu;
+  }
+  p = chunk;
+  p->s.size = nunits;
+  chunk += nunits;
+  chunkleft -= nunits;
+  return p + 1;
+}
+
 void*
 malloc(uint nbytes)
 {
@@ -67,6 +135,15 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if(nunits <= MAXSMALL){
+    if((p = smallfree[nunits]) != 0){
+      smallfree[nunits] = p->s.ptr;
+      return (void*)(p + 1);
+    }
+    if((p = smallalloc(nunits)) != 0)
+      return (void*)p;
+    // out of core: a free large block may still have room.
+  }
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
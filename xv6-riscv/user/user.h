@@ -1,4 +1,12 @@
 struct stat;
+struct fsstat;
+struct vmstat;
+struct traceent;
+struct scstat;
+struct lockstat;
+struct cpustat;
+struct iovec;
+struct ring;
 
 // system calls
 int fork(void);
@@ -26,6 +34,25 @@ int uptime(void);
 void swapread(const char*, int);
 void swapwrite(const char*, int);
 void swapstat(int*, int*);
+int fsstat(struct fsstat*);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int vmstat(int, struct vmstat*);
+int rsslimit(int);
+int ktrace(int, struct traceent*, int);
+int scstat(struct scstat*, int);
+int lockstat(struct lockstat*, int);
+int setaffinity(int, int);
+int cpustat(struct cpustat*, int);
+int readv(int, struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+struct ring* ringsetup(void);
+int ringenter(int);
+int spawn(const char*, char**);
+int madvise(void*, uint, int);
+int mempressure(int);
 
 
 
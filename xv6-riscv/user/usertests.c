@@ -578,6 +578,10 @@ writetest(char *s)
   }
 }
 
+// MAXFILE no longer fits on the disk now that there is a
+// double-indirect block, so write far enough to use some of it.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + 2*NINDIRECT + 7)
+
 void
 writebig(char *s)
 {
@@ -589,7 +593,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed i=%d\n", s, i);
@@ -609,7 +613,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n != MAXFILE){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -678,6 +682,62 @@ void dirtest(char *s)
   }
 }
 
+// the directory name cache must follow creates
+// and unlinks, including of names it has seen fail.
+void
+dcachetest(char *s)
+{
+  int fd;
+
+  unlink("dcdir/f");
+  unlink("dcdir");
+  if(open("dcdir/f", O_RDONLY) >= 0){
+    printf("%s: open of missing file succeeded\n", s);
+    exit(1);
+  }
+  if(mkdir("dcdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 2; i++){
+    if(open("dcdir/f", O_RDONLY) >= 0){
+      printf("%s: open of unlinked file succeeded\n", s);
+      exit(1);
+    }
+    fd = open("dcdir/f", O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    fd = open("dcdir/f", O_RDONLY);
+    if(fd < 0){
+      printf("%s: open after create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(unlink("dcdir/f") < 0){
+      printf("%s: unlink failed\n", s);
+      exit(1);
+    }
+  }
+
+  // a new directory that reuses dcdir's inode must not
+  // inherit its entries.
+  if(unlink("dcdir") < 0 || mkdir("dcdir") < 0 ||
+     (fd = open("dcdir/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: recreate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(unlink("dcdir") == 0){
+    printf("%s: unlinked non-empty directory\n", s);
+    exit(1);
+  }
+  unlink("dcdir/f");
+  unlink("dcdir");
+}
+
 void
 exectest(char *s)
 {
@@ -2569,21 +2629,1142 @@ sbrk8000(char *s)
   *(top-1) = *(top-1) + 1;
 }
 
+// sbrk() only reserves address space; pages appear zeroed on
+// first touch, from user code or from the kernel (read() into
+// a page nobody has touched yet).
+void
+lazysbrk(char *s)
+{
+  enum { BIG=64*1024*1024 };
+  int fds[2];
+  char *a;
 
+  // more than physical memory, as long as it's not touched.
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk of untouched memory failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < BIG; i += BIG/16){
+    if(a[i] != 0){
+      printf("%s: fresh page not zero\n", s);
+      exit(1);
+    }
+    a[i] = 1;
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  if(read(fds[0], a + BIG - 1, 1) != 1 || a[BIG-1] != 'x'){
+    printf("%s: read into untouched page failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-BIG);
+}
 
-// regression test. test whether exec() leaks memory if one of the
-// arguments is invalid. the test passes if the kernel doesn't panic.
+// pages that have only been read share one zero page; a store
+// to one of them, or to the same page in a forked child, must
+// not show up anywhere else.
 void
-badarg(char *s)
+zeropage(char *s)
 {
-  for(int i = 0; i < 50000; i++){
-    char *argv[2];
-    argv[0] = (char*)0xffffffff;
-    argv[1] = 0;
-    exec("echo", argv);
+  enum { N=64 };
+  char *a = sbrk(N*PGSIZE);
+  int sum = 0, pid, xstatus;
+
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    sum += a[i*PGSIZE];
+  a[5*PGSIZE] = 1;
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[6*PGSIZE] = 2;
+    exit(a[5*PGSIZE] != 1 || a[6*PGSIZE] != 2);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    sum += a[i*PGSIZE];
+  if(sum != 1){
+    printf("%s: zero page was written, sum %d\n", s, sum);
+    exit(1);
+  }
+  sbrk(-N*PGSIZE);
+}
+
+// a big sbrk() region may be backed by 2MB superpages, which
+// fork, a partial shrink, and reads by the kernel must see
+// page by page.
+void
+superpage(char *s)
+{
+  enum { BIG=6*1024*1024, CUT=1024*1024+3*PGSIZE };
+  char *a = sbrk(BIG);
+  int fds[2], pid, xstatus;
+
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < BIG; i += PGSIZE)
+    a[i] = i / PGSIZE;
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < BIG; i += PGSIZE)
+      if(a[i] != (char)(i / PGSIZE))
+        exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+
+  sbrk(-CUT);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], a + BIG - CUT - PGSIZE, 1) != 1 ||
+     read(fds[0], a + 1, 1) != 1 ||
+     a[1] != (char)((BIG - CUT - PGSIZE) / PGSIZE)){
+    printf("%s: copyin/copyout through superpage failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(int i = PGSIZE; i < BIG - CUT; i += PGSIZE){
+    if(a[i] != (char)(i / PGSIZE)){
+      printf("%s: wrong data at page %d after shrink\n", s, i / PGSIZE);
+      exit(1);
+    }
+  }
+  sbrk(-(BIG - CUT));
+}
+
+// vmstat() must count the pages a process touches, and the
+// faults that brought them in.
+void
+vmstattest(char *s)
+{
+  enum { N=16 };
+  struct vmstat a, b;
+  char *p;
+
+  if(vmstat(0, &a) < 0){
+    printf("%s: vmstat failed\n", s);
+    exit(1);
+  }
+  p = sbrk(N*PGSIZE);
+  for(int i = 0; i < N; i++)
+    p[i*PGSIZE] = 1;
+  if(vmstat(getpid(), &b) < 0){
+    printf("%s: vmstat of own pid failed\n", s);
+    exit(1);
+  }
+  if(b.rss < a.rss + N || b.pminflt < a.pminflt + N){
+    printf("%s: rss %ld -> %ld, minor faults %ld -> %ld\n",
+           s, a.rss, b.rss, a.pminflt, b.pminflt);
+    exit(1);
+  }
+  if(vmstat(0x7fffffff, &b) == 0){
+    printf("%s: vmstat of missing pid succeeded\n", s);
+    exit(1);
+  }
+  sbrk(-N*PGSIZE);
+}
+
+// a child limited by rsslimit() keeps at most that many pages
+// resident, paging its own ones out, and still sees its data.
+void
+rsslimittest(char *s)
+{
+  enum { N=128, LIMIT=32 };
+  struct vmstat st;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(rsslimit(LIMIT) != 0 || rsslimit(-1) != -1){
+      printf("%s: rsslimit failed\n", s);
+      exit(1);
+    }
+    char *p = sbrk(N*PGSIZE);
+    for(int i = 0; i < N; i++)
+      p[i*PGSIZE] = i;
+    if(vmstat(0, &st) < 0 || st.prsslimit != LIMIT || st.rss > LIMIT){
+      printf("%s: rss %ld with limit %d\n", s, st.rss, LIMIT);
+      exit(1);
+    }
+    for(int i = 0; i < N; i++){
+      if(p[i*PGSIZE] != (char)i){
+        printf("%s: page %d lost\n", s, i);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// pages pushed out by rsslimit() come back intact whether
+// zswap keeps them (sparse or same-filled) or they go to disk
+// (dense), and the sparse ones are read back from memory.
+void
+zswaptest(char *s)
+{
+  enum { N=64, LIMIT=16 };
+  struct vmstat a, b;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    uint64 *p = (uint64*)sbrk(N*PGSIZE);
+    uint64 seed = 1;
+    vmstat(0, &a);
+    rsslimit(LIMIT);
+    for(int i = 0; i < N; i++){
+      uint64 *w = p + i*PGSIZE/8;
+      for(int j = 0; j < PGSIZE/8; j++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if(i % 3 == 0)
+          w[j] = seed;             // dense
+        else if(i % 3 == 1)
+          w[j] = j % 16 ? 0 : i;   // sparse
+        else
+          w[j] = 0x5a5a5a5a00000000ULL | i;  // same-filled
+      }
+    }
+    seed = 1;
+    for(int i = 0; i < N; i++){
+      uint64 *w = p + i*PGSIZE/8;
+      for(int j = 0; j < PGSIZE/8; j++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64 want = i % 3 == 0 ? seed : i % 3 == 1 ? (j % 16 ? 0 : i) :
+                      0x5a5a5a5a00000000ULL | i;
+        if(w[j] != want){
+          printf("%s: page %d word %d corrupted\n", s, i, j);
+          exit(1);
+        }
+      }
+    }
+    vmstat(0, &b);
+    if(b.zloads <= a.zloads){
+      printf("%s: nothing read back from zswap\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// pages evicted while a process works are read back
+// when it wakes up from a long sleep.
+void
+wsprefetchtest(char *s)
+{
+  enum { N=32, LIMIT=8 };
+  struct vmstat a, b;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char *p = sbrk(N*PGSIZE);
+    rsslimit(LIMIT);
+    for(int i = 0; i < N; i++)
+      memset(p + i*PGSIZE, i + 1, PGSIZE);
+    rsslimit(0);
+    vmstat(0, &a);
+    sleep(10);
+    vmstat(0, &b);
+    if(b.wsprefetch <= a.wsprefetch){
+      printf("%s: nothing prefetched on wakeup\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < N; i++){
+      for(int j = 0; j < PGSIZE; j++){
+        if(p[i*PGSIZE + j] != i + 1){
+          printf("%s: page %d byte %d corrupted\n", s, i, j);
+          exit(1);
+        }
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// a process that exits with pages in swap gives their slots back,
+// and so does shrinking a swapped-out heap.
+void
+swapexittest(char *s)
+{
+  enum { N=32, LIMIT=8 };
+  struct vmstat a, b;
+  int pid, xstatus;
+
+  vmstat(0, &a);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    struct vmstat c, d;
+    char *p = sbrk(2*N*PGSIZE);
+    rsslimit(LIMIT);
+    for(int i = 0; i < 2*N; i++)
+      memset(p + i*PGSIZE, i + 1, PGSIZE);
+    vmstat(0, &c);
+    sbrk(-N*PGSIZE);
+    vmstat(0, &d);
+    if(c.swapped == 0 || d.swapused >= c.swapused){
+      printf("%s: shrinking kept %ld of %ld swap slots\n", s, d.swapused, c.swapused);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  vmstat(0, &b);
+  if(b.swapused > a.swapused){
+    printf("%s: %ld swap slots leaked\n", s, b.swapused - a.swapused);
+    exit(1);
+  }
+}
+
+// page faults and context switches show up in the kernel trace.
+void
+ktracetest(char *s)
+{
+  static struct traceent ev[256];
+  int faults = 0, switches = 0;
+
+  if(ktrace(KTRACE_ON, 0, 0) < 0){
+    printf("%s: ktrace on failed\n", s);
+    exit(1);
+  }
+  char *p = sbrk(4*PGSIZE);
+  for(int i = 0; i < 4; i++)
+    p[i*PGSIZE] = i;
+  sleep(1);
+  ktrace(KTRACE_OFF, 0, 0);
+  sbrk(-4*PGSIZE);
+
+  int n;
+  while((n = ktrace(KTRACE_READ, ev, 256)) > 0){
+    for(int i = 0; i < n; i++){
+      if(ev[i].event == TR_FAULT && ev[i].pid == getpid())
+        faults++;
+      if(ev[i].event == TR_SWITCH)
+        switches++;
+    }
+  }
+  if(n < 0 || faults == 0 || switches == 0){
+    printf("%s: %d faults, %d switches traced\n", s, faults, switches);
+    exit(1);
+  }
+}
+
+// every system call is counted in its histogram.
+void
+scstattest(char *s)
+{
+  static struct scstat a[SYS_getpid+1], b[SYS_getpid+1];
+
+  if(scstat(a, SYS_getpid+1) <= SYS_getpid){
+    printf("%s: scstat failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 10; i++)
+    getpid();
+  scstat(b, SYS_getpid+1);
+  uint64 n = 0;
+  for(int k = 0; k < NSCHIST; k++)
+    n += b[SYS_getpid].hist[k] - a[SYS_getpid].hist[k];
+  if(b[SYS_getpid].count - a[SYS_getpid].count < 10 || n < 10){
+    printf("%s: getpid calls not counted\n", s);
+    exit(1);
+  }
+}
+
+// a process pinned with setaffinity() still runs, its children
+// inherit the pinning, and switches show up in cpustat().
+void
+affinitytest(char *s)
+{
+  struct cpustat a[NCPU], b[NCPU];
+  uint64 na = 0, nb = 0;
+  int pid, xstatus;
+
+  if(setaffinity(0, 0) >= 0){
+    printf("%s: empty mask accepted\n", s);
+    exit(1);
+  }
+  cpustat(a, NCPU);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(setaffinity(0, 1) < 0){
+      printf("%s: setaffinity failed\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < 4; i++){
+      int pid2 = fork();
+      if(pid2 == 0){
+        for(volatile int j = 0; j < 1000000; j++)
+          ;
+        exit(0);
+      }
+      sleep(1);
+    }
+    for(int i = 0; i < 4; i++)
+      wait(0);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  cpustat(b, NCPU);
+  for(int i = 0; i < NCPU; i++){
+    na += a[i].switches;
+    nb += b[i].switches;
+  }
+  if(nb <= na){
+    printf("%s: no switches counted\n", s);
+    exit(1);
+  }
+}
+
+// pread()/pwrite() use their own offset and leave the file's
+// alone; readv()/writev() move several buffers in one call.
+void
+vectoriotest(char *s)
+{
+  char a[10], b[20], c[40];
+  struct iovec iov[2];
+  int fd;
+
+  unlink("vecio");
+  fd = open("vecio", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  iov[0].base = a;
+  iov[0].len = sizeof(a);
+  iov[1].base = b;
+  iov[1].len = sizeof(b);
+  if(writev(fd, iov, 2) != 30){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "xyz", 3, 5) != 3 || pread(fd, c, 4, 4) != 4 ||
+     memcmp(c, "axyz", 4) != 0){
+    printf("%s: pread/pwrite wrong\n", s);
+    exit(1);
+  }
+  // the file offset is still at the end.
+  if(write(fd, "!", 1) != 1 || pread(fd, c, 31, 0) != 31 || c[30] != '!'){
+    printf("%s: file offset moved\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vecio", O_RDONLY);
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  if(readv(fd, iov, 2) != 30 || a[4] != 'a' || a[5] != 'x' || b[0] != 'b' || b[19] != 'b'){
+    printf("%s: readv wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pread(0, c, 1, 0) >= 0){
+    printf("%s: pread on console succeeded\n", s);
+    exit(1);
+  }
+  unlink("vecio");
+}
+
+// one large write() should be one or two log transactions,
+// not one per MAXOPBLOCKS chunk.
+void
+bigtranstest(char *s)
+{
+  enum { N=64*BSIZE };
+  struct fsstat a, b;
+  char *p;
+  int fd;
+
+  p = sbrk(N);
+  if(p == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    p[i] = i % 251;
+  unlink("bigtrans");
+  fd = open("bigtrans", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  fsstat(&a);
+  if(write(fd, p, N) != N){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  fsstat(&b);
+  if(b.trans - a.trans > 2){
+    printf("%s: %d transactions for one write\n", s, (int)(b.trans - a.trans));
+    exit(1);
+  }
+  memset(p, 0, N);
+  if(pread(fd, p, N, 0) != N){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    if(p[i] != (char)(i % 251)){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("bigtrans");
+}
+
+// in ordered mode file contents are written in place, and only
+// the inode, bitmap and indirect blocks go through the log.
+void
+orderedtest(char *s)
+{
+  enum { NB=MAXOPBLOCKS };
+  struct fsstat a, b;
+  int fd;
+
+  if(!LOGORDERED)
+    return;
+  unlink("ordered");
+  fd = open("ordered", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'o', NB*BSIZE);
+  fsstat(&a);
+  if(write(fd, buf, NB*BSIZE) != NB*BSIZE){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  fsstat(&b);
+  if(b.datablocks - a.datablocks < NB || b.logblocks - a.logblocks >= NB){
+    printf("%s: %d blocks in place, %d logged\n", s,
+           (int)(b.datablocks - a.datablocks), (int)(b.logblocks - a.logblocks));
+    exit(1);
+  }
+  close(fd);
+  fd = open("ordered", O_RDONLY);
+  memset(buf, 0, NB*BSIZE);
+  if(read(fd, buf, NB*BSIZE) != NB*BSIZE || buf[0] != 'o' || buf[NB*BSIZE-1] != 'o'){
+    printf("%s: read back wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("ordered");
+}
+
+// a file small enough to fit in its inode takes no data block,
+// and keeps its contents when it grows past that and shrinks.
+void
+inlinetest(char *s)
+{
+  struct fsstat a, b;
+  char small[40], big[100];
+  int fd;
+
+  for(int i = 0; i < sizeof(big); i++)
+    big[i] = 'A' + i % 26;
+  memmove(small, big, sizeof(small));
+  unlink("inline");
+  fd = open("inline", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  fsstat(&a);
+  if(write(fd, small, sizeof(small)) != sizeof(small)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  fsstat(&b);
+  if(LOGORDERED && b.datablocks != a.datablocks){
+    printf("%s: small file took a data block\n", s);
+    exit(1);
+  }
+  memset(buf, 0, sizeof(big));
+  if(pread(fd, buf, sizeof(big), 0) != sizeof(small) || memcmp(buf, small, sizeof(small)) != 0){
+    printf("%s: inline read wrong\n", s);
+    exit(1);
+  }
+  // grow it past the inode.
+  if(write(fd, big + sizeof(small), sizeof(big) - sizeof(small)) != sizeof(big) - sizeof(small)){
+    printf("%s: grow failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inline", O_RDONLY);
+  memset(buf, 0, sizeof(big));
+  if(read(fd, buf, sizeof(big) + 10) != sizeof(big) || memcmp(buf, big, sizeof(big)) != 0){
+    printf("%s: grown file wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inline", O_RDWR | O_TRUNC);
+  if(write(fd, "tiny", 4) != 4 || pread(fd, buf, 10, 0) != 4 || memcmp(buf, "tiny", 4) != 0){
+    printf("%s: truncated file wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inline");
+}
+
+// a directory that outgrows one block is hashed; its entries
+// can still be found, listed and removed, and it can be removed.
+void
+hashdirtest(char *s)
+{
+  enum { N=200 };
+  char name[16];
+  struct stat st;
+  struct dirent de;
+  int fd, n;
+
+  if(mkdir("hdir") < 0 || chdir("hdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    name[0] = 'f';
+    name[1] = '0' + i / 100;
+    name[2] = '0' + i / 10 % 10;
+    name[3] = '0' + i % 10;
+    name[4] = 0;
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  if(stat(".", &st) < 0 || st.size < NDIRCHAIN * BSIZE){
+    printf("%s: directory not hashed\n", s);
+    exit(1);
+  }
+  // every name once, and no others besides . and ..
+  fd = open(".", O_RDONLY);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de)){
+    if(de.inum == 0)
+      continue;
+    if(de.name[0] == 'f')
+      n++;
+    else if(strcmp(de.name, ".") != 0 && strcmp(de.name, "..") != 0){
+      printf("%s: stray entry %s\n", s, de.name);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(n != N){
+    printf("%s: listed %d of %d entries\n", s, n, N);
+    exit(1);
+  }
+  for(int i = N - 1; i >= 0; i--){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + i / 10 % 10;
+    name[3] = '0' + i % 10;
+    if(unlink(name) < 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+    if(open(name, O_RDONLY) >= 0){
+      printf("%s: %s still there\n", s, name);
+      exit(1);
+    }
+  }
+  if(chdir("..") < 0 || unlink("hdir") < 0){
+    printf("%s: rmdir failed\n", s);
+    exit(1);
+  }
+}
+
+// calls queued in the batch ring run in order on one
+// ringenter(), and their results come back in the ring.
+void
+ringtest(char *s)
+{
+  struct ring *r = ringsetup();
+  char data[8];
+  int fd, n = 0;
+
+  if(r == (struct ring*)-1 || ringsetup() != r){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+  fd = open("ringfile", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 4; i++){
+    struct ringsqe *e = &r->sq[r->sqtail % NRING];
+    e->num = SYS_write;
+    e->arg[0] = fd;
+    e->arg[1] = (uint64)"ring";
+    e->arg[2] = 4;
+    e->tag = i;
+    r->sqtail++;
+  }
+  r->sq[r->sqtail % NRING].num = SYS_getpid;
+  r->sq[r->sqtail++ % NRING].tag = 4;
+  r->sq[r->sqtail % NRING].num = SYS_fork;  // not allowed
+  r->sq[r->sqtail++ % NRING].tag = 5;
+  if(ringenter(NRING) != 6 || r->sqhead != r->sqtail){
+    printf("%s: ringenter did not run everything\n", s);
+    exit(1);
+  }
+  while(r->cqhead != r->cqtail){
+    struct ringcqe *c = &r->cq[r->cqhead++ % NRING];
+    int want = c->tag < 4 ? 4 : c->tag == 4 ? getpid() : -1;
+    if(c->tag != n++ || (int)c->res != want){
+      printf("%s: completion %d: res %d\n", s, (int)c->tag, (int)c->res);
+      exit(1);
+    }
+  }
+  if(n != 6 || pread(fd, data, 8, 12) != 4 || memcmp(data, "ring", 4) != 0){
+    printf("%s: ring writes missing\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("ringfile");
+}
+
+// spawn() starts a program as a child without fork(); it gets
+// its arguments and our working directory, and wait() reaps it.
+void
+spawntest(char *s)
+{
+  char *args[] = { "rm", "spawnf", 0 };
+  int fd, pid, xstatus;
+
+  fd = open("spawnf", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((pid = spawn("rm", args)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait for spawned child failed\n", s);
+    exit(1);
+  }
+  if(open("spawnf", O_RDONLY) >= 0){
+    printf("%s: spawned rm did not run\n", s);
+    exit(1);
+  }
+  if(spawn("nosuchprogram", args) >= 0){
+    printf("%s: spawn of missing program succeeded\n", s);
+    exit(1);
+  }
+}
+
+// madvise(DONTNEED) drops heap pages, which then read back as
+// zero; COLD and WILLNEED keep the data. bad ranges fail.
+void
+madvisetest(char *s)
+{
+  enum { N=8 };
+  char *top = sbrk((N + 1) * PGSIZE);
+  char *p = (char*)PGROUNDUP((uint64)top);
+
+  if(top == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    memset(p + i * PGSIZE, 'a' + i, PGSIZE);
+  if(madvise(p, N * PGSIZE, MADV_COLD) != 0 ||
+     madvise(p, N * PGSIZE, MADV_WILLNEED) != 0 ||
+     madvise(p + 2 * PGSIZE, 3 * PGSIZE, MADV_DONTNEED) != 0){
+    printf("%s: madvise failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    char want = (i >= 2 && i < 5) ? 0 : 'a' + i;
+    if(p[i * PGSIZE] != want || p[i * PGSIZE + PGSIZE - 1] != want){
+      printf("%s: page %d has %d, expected %d\n", s, i, p[i * PGSIZE], want);
+      exit(1);
+    }
+  }
+  if(madvise(p + 1, PGSIZE, MADV_COLD) != -1 ||
+     madvise(p, N * PGSIZE, 99) != -1 ||
+     madvise(p + (N + 1) * PGSIZE, 16 * PGSIZE, MADV_DONTNEED) != -1){
+    printf("%s: bad madvise succeeded\n", s);
+    exit(1);
+  }
+  int level = mempressure(MP_NONE);
+  if(level < MP_NONE || level > MP_CRITICAL || mempressure(MP_CRITICAL + 1) != -1){
+    printf("%s: mempressure returned %d\n", s, level);
+    exit(1);
+  }
+  sbrk(-((N + 1) * PGSIZE));
+}
+
+// pages written before a fork keep their data in the child after
+// the parent has copied them away with its own writes, whether
+// they were filled in fresh or came back from swap.
+void
+forkdirtytest(char *s)
+{
+  enum { N=16, LIMIT=8 };
+  int pid, xstatus, fds[2];
+  char c;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char *p = sbrk(2*N*PGSIZE);
+    // the first half goes out to swap and comes back before it
+    // is written: its swap slots hold stale data.
+    rsslimit(LIMIT);
+    for(int i = 0; i < N; i++)
+      memset(p + i*PGSIZE, 0x40, PGSIZE);
+    rsslimit(0);
+    for(int i = 0; i < 2*N; i++)
+      memset(p + i*PGSIZE, i + 1, PGSIZE);
+    if(pipe(fds) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[1]);
+      if(read(fds[0], &c, 1) != 1)
+        exit(1);
+      // push our pages out, then read them back.
+      rsslimit(LIMIT);
+      char *q = sbrk(2*N*PGSIZE);
+      for(int i = 0; i < 2*N; i++)
+        memset(q + i*PGSIZE, 0x7f, PGSIZE);
+      for(int i = 0; i < 2*N; i++){
+        for(int j = 0; j < PGSIZE; j++){
+          if(p[i*PGSIZE + j] != i + 1){
+            printf("%s: page %d byte %d is %d in the child\n", s, i, j, p[i*PGSIZE + j]);
+            exit(1);
+          }
+        }
+      }
+      exit(0);
+    }
+    close(fds[0]);
+    for(int i = 0; i < 2*N; i++)
+      memset(p + i*PGSIZE, 0x60 + i, PGSIZE);
+    write(fds[1], "x", 1);
+    close(fds[1]);
+    wait(&xstatus);
+    for(int i = 0; i < 2*N; i++){
+      if(p[i*PGSIZE] != 0x60 + i){
+        printf("%s: page %d corrupted in the parent\n", s, i);
+        exit(1);
+      }
+    }
+    exit(xstatus);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// pipes and open files come from kernel object caches, and do
+// not take a page each.
+void
+slabtest(char *s)
+{
+  enum { N=6 };
+  int fds[N][2];
+  struct vmstat a, b;
+
+  vmstat(0, &a);
+  for(int i = 0; i < N; i++){
+    if(pipe(fds[i]) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+  }
+  vmstat(0, &b);
+  for(int i = 0; i < N; i++){
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+  if(b.slabpages > a.slabpages + 2){
+    printf("%s: %d pipes took %ld slab pages\n", s, N,
+           b.slabpages - a.slabpages);
+    exit(1);
+  }
+}
+
+// small blocks come from size classes: a freed block is reused
+// by the next malloc() of its size, and blocks of all sizes
+// keep their contents.
+void
+malloctest(char *s)
+{
+  enum { N=500 };
+  static char *p[N];
+
+  for(int i = 0; i < N; i++){
+    if((p[i] = malloc(i * 7 % 3000)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+    memset(p[i], i, i * 7 % 3000);
+  }
+  for(int i = 0; i < N; i += 2){
+    free(p[i]);
+    p[i] = 0;
+  }
+  char *a = malloc(100);
+  free(a);
+  if(malloc(100) != a){
+    printf("%s: freed block not reused\n", s);
+    exit(1);
+  }
+  free(a);
+  for(int i = 1; i < N; i += 2){
+    for(int j = 0; j < i * 7 % 3000; j++){
+      if(p[i][j] != (char)i){
+        printf("%s: block %d corrupted\n", s, i);
+        exit(1);
+      }
+    }
+    free(p[i]);
+  }
+}
+
+// mmap() a file: pages read in on demand, MAP_SHARED stores
+// written back on munmap() and seen by a forked child,
+// MAP_PRIVATE stores never reaching the file.
+void
+mmaptest(char *s)
+{
+  enum { N=3 };
+  char buf[64];
+  char *a;
+  int fd, pid, xstatus;
+
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N*PGSIZE/sizeof(buf); i++){
+    memset(buf, 'a' + i*sizeof(buf)/PGSIZE, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+
+  a = mmap(0, N*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    if(a[i*PGSIZE] != 'a' + i || a[i*PGSIZE+PGSIZE-1] != 'a' + i){
+      printf("%s: wrong contents in page %d\n", s, i);
+      exit(1);
+    }
+  }
+  a[0] = 'X';
+  if(munmap(a, N*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  a = mmap(0, N*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == (char*)-1 || a[0] != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+  a[1] = 'Y';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[PGSIZE] = 'Z';
+    exit(a[1] != 'Y');
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[PGSIZE] != 'Z'){
+    printf("%s: MAP_SHARED page not shared with child\n", s);
+    exit(1);
+  }
+  // unmap the tail, then the rest.
+  if(munmap(a + PGSIZE, (N-1)*PGSIZE) < 0 || munmap(a, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(munmap(a, N*PGSIZE) < 0){
+    printf("%s: munmap of nothing failed\n", s);
+    exit(1);
+  }
+
+  if(read(fd, buf, 1) != 0 || close(fd) < 0){
+    printf("%s: mmap moved the file offset\n", s);
+    exit(1);
+  }
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 2) != 2 || buf[0] != 'a' || buf[1] != 'Y'){
+    printf("%s: shared store not written back\n", s);
+    exit(1);
+  }
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: writable shared mapping of read-only fd\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+}
+
+
+
+// regression test. test whether exec() leaks memory if one of the
+// arguments is invalid. the test passes if the kernel doesn't panic.
+void
+badarg(char *s)
+{
+  for(int i = 0; i < 50000; i++){
+    char *argv[2];
+    argv[0] = (char*)0xffffffff;
+    argv[1] = 0;
+    exec("echo", argv);
+  }
+  
+  exit(0);
+}
+
+// fork shares pages copy-on-write. check that stores by the
+// child, both from user code and from the kernel (read() into a
+// shared page), don't show up in the parent, and vice versa.
+void
+cowfork(char *s)
+{
+  enum { NPG = 64 };
+  char *p = sbrk(NPG*PGSIZE);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < NPG; i++)
+    p[i*PGSIZE] = i;
+
+  for(int k = 0; k < 3; k++){
+    int fds[2];
+    if(pipe(fds) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(int i = 0; i < NPG; i++){
+        if(p[i*PGSIZE] != (char)i){
+          printf("%s: child sees %d at page %d\n", s, p[i*PGSIZE], i);
+          exit(1);
+        }
+        p[i*PGSIZE] = i + 100;
+      }
+      // copyout() into a COW page.
+      close(fds[1]);
+      if(read(fds[0], p + PGSIZE + 1, 1) != 1 || p[PGSIZE + 1] != 'x'){
+        printf("%s: read into cow page failed\n", s);
+        exit(1);
+      }
+      exit(0);
+    }
+    close(fds[0]);
+    write(fds[1], "x", 1);
+    close(fds[1]);
+    // the parent writes too, after the child has its copy.
+    p[0] = 77;
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+    p[0] = 0;
+    for(int i = 0; i < NPG; i++){
+      if(p[i*PGSIZE] != (char)i || p[i*PGSIZE+1] == 'x'){
+        printf("%s: parent page %d changed by child\n", s, i);
+        exit(1);
+      }
+    }
   }
-  
-  exit(0);
 }
 
 struct test {
@@ -2607,6 +3788,7 @@ struct test {
   {writebig, "writebig"},
   {createtest, "createtest"},
   {dirtest, "dirtest"},
+  {dcachetest, "dcache"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
@@ -2649,7 +3831,31 @@ struct test {
   {sbrkbugs, "sbrkbugs" },
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
+  {lazysbrk, "lazysbrk"},
+  {zeropage, "zeropage"},
+  {superpage, "superpage"},
+  {vmstattest, "vmstat"},
+  {rsslimittest, "rsslimit"},
+  {zswaptest, "zswap"},
+  {wsprefetchtest, "wsprefetch"},
+  {ktracetest, "ktrace"},
+  {scstattest, "scstat"},
+  {slabtest, "slab"},
+  {malloctest, "malloc"},
+  {swapexittest, "swapexit"},
+  {affinitytest, "affinity"},
+  {vectoriotest, "vectorio"},
+  {bigtranstest, "bigtrans"},
+  {orderedtest, "ordered"},
+  {inlinetest, "inline"},
+  {hashdirtest, "hashdir"},
+  {ringtest, "ring"},
+  {spawntest, "spawn"},
+  {madvisetest, "madvise"},
+  {forkdirtytest, "forkdirty"},
+  {mmaptest, "mmap"},
   {badarg, "badarg" },
+  {cowfork, "cowfork" },
 
   { 0, 0},
 };
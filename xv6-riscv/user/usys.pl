@@ -40,4 +40,23 @@ entry("uptime");
 entry("swapread");
 entry("swapwrite");
 entry("swapstat");
+entry("fsstat");
+entry("mmap");
+entry("munmap");
+entry("vmstat");
+entry("rsslimit");
+entry("ktrace");
+entry("scstat");
+entry("lockstat");
+entry("setaffinity");
+entry("cpustat");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("ringsetup");
+entry("ringenter");
+entry("spawn");
+entry("madvise");
+entry("mempressure");
 
@@ -0,0 +1,52 @@
+// Print the paging counters.
+//
+// vmstat [pid ...]
+//
+// Prints the system-wide counters, then a line for each pid
+// given: resident and swapped pages, minor and major faults.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat st;
+
+  if(vmstat(0, &st) < 0){
+    printf("vmstat: vmstat failed\n");
+    exit(1);
+  }
+  printf("free %ld pages, lru %ld (%ld active), swap %ld of %ld slots used\n",
+         st.freepages, st.lrupages, st.activepages, st.swapused, st.swapslots);
+  printf("faults %ld minor, %ld major\n", st.minflt, st.majflt);
+  printf("swap in %ld (readahead %ld, %ld used), swap out %ld (%ld from swap cache)\n",
+         st.swapins, st.swapra, st.swaprahits, st.swapouts, st.cleanevicts);
+  printf("working-set prefetch %ld pages\n", st.wsprefetch);
+  printf("dropped %ld unwritten, %ld zero; %ld shared pages written back\n",
+         st.refilldrops, st.zerodrops, st.mmapwrites);
+  printf("victim scans %ld, %ld pages looked at", st.scans, st.scanned);
+  if(st.scans > 0)
+    printf(" (%ld per scan)", st.scanned / st.scans);
+  printf("\nsuperpages %ld, page-table pages reclaimed %ld\n",
+         st.superpages, st.ptreclaims);
+  printf("compressed swap %ld slots in %ld pages, %ld read back\n",
+         st.zswapped, st.zpoolpages, st.zloads);
+  printf("kernel object caches %ld pages\n", st.slabpages);
+  char *levels[] = { "none", "low", "medium", "critical" };
+  printf("memory pressure %s\n", levels[mempressure(MP_NONE)]);
+
+  for(int i = 1; i < argc; i++){
+    int pid = atoi(argv[i]);
+    if(pid <= 0 || vmstat(pid, &st) < 0){
+      printf("vmstat: no process %s\n", argv[i]);
+      continue;
+    }
+    printf("pid %d: rss %ld pages, swapped %ld, faults %ld minor, %ld major\n",
+           pid, st.rss, st.swapped, st.pminflt, st.pmajflt);
+    if(st.prsslimit)
+      printf("pid %d: limited to %ld resident pages\n", pid, st.prsslimit);
+  }
+  exit(0);
+}